@@ -20,6 +20,15 @@ ServiceControl *QmlServiceSingleton::createControlFromName(const QString &backen
 	return ServiceControl::createFromName(backend, serviceName, domain, parent);
 }
 
+QVariantMap QmlServiceSingleton::statusOf(const QString &backend, const QStringList &serviceIds) const
+{
+	const auto states = ServiceControl::statusOf(backend, serviceIds);
+	QVariantMap result;
+	for (auto it = states.constBegin(); it != states.constEnd(); ++it)
+		result.insert(it.key(), QVariant::fromValue(it.value()));
+	return result;
+}
+
 Service *QmlServiceSingleton::service() const
 {
 	return Service::instance();
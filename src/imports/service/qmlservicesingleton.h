@@ -52,6 +52,16 @@ public:
 	//! @copydoc QtService::ServiceControl::createFromName(const QString &, const QString &, const QString &, QObject *)
 	Q_INVOKABLE QtService::ServiceControl *createControlFromName(const QString &backend, const QString &serviceName, const QString &domain, QObject *parent = nullptr) const;
 
+	/*! @brief Returns the status of multiple services of the same backend at once
+	 *
+	 * @param backend The backend the services are controlled by
+	 * @param serviceIds The ids of the services to query the status for
+	 * @returns An object with the service ids as keys and their ServiceControl.Status as values
+	 *
+	 * @sa QtService::ServiceControl::statusOf
+	 */
+	Q_INVOKABLE QVariantMap statusOf(const QString &backend, const QStringList &serviceIds) const;
+
 	//! @private
 	QtService::Service* service() const;
 };
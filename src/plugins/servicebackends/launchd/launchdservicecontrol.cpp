@@ -49,6 +49,9 @@ bool LaunchdServiceControl::isEnabled() const
 
 QVariant LaunchdServiceControl::callGenericCommand(const QByteArray &kind, const QVariantList &args)
 {
+	if (kind == "setLoggingRules" || kind == "invokeCallback")
+		return ServiceControl::callGenericCommand(kind, args);
+
 	QStringList sArgs;
 	sArgs.reserve(args.size());
 	for (const auto &arg : args)
@@ -1,20 +1,27 @@
 TARGET  = qstandard
 
-QT += service
+QT += service network
 QT -= gui
 
 HEADERS += \
 	standardserviceplugin.h \
 	standardservicebackend.h \
-	standardservicecontrol.h
+	standardservicecontrol.h \
+	standardflightrecorder.h
 
 SOURCES += \
 	standardserviceplugin.cpp \
 	standardservicebackend.cpp \
-	standardservicecontrol.cpp
+	standardservicecontrol.cpp \
+	standardflightrecorder.cpp
 
 DISTFILES += standard.json
 
+unix {
+	HEADERS += standardprocesslauncher.h
+	SOURCES += standardprocesslauncher.cpp
+}
+
 win32: LIBS += -lkernel32
 
 PLUGIN_TYPE = servicebackends
@@ -0,0 +1,196 @@
+#include "standardflightrecorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+const QString StandardFlightRecorder::FileName = QStringLiteral("qstandard.flightrecorder");
+
+StandardFlightRecorder::~StandardFlightRecorder()
+{
+	close();
+}
+
+bool StandardFlightRecorder::open(const QString &path, int records)
+{
+	close();
+	if (records <= 0) {
+		_error = QStringLiteral("Invalid number of records: %1").arg(records);
+		return false;
+	}
+
+	_file.setFileName(path);
+	if (!_file.open(QIODevice::ReadWrite)) {
+		_error = _file.errorString();
+		return false;
+	}
+
+	// keep the records of a previous run, so they can still be read after a crash
+	const auto size = headerSize() + static_cast<qint64>(records) * RecordSize;
+	auto reuse = _file.size() == size;
+	if (!reuse && !_file.resize(size)) {
+		_error = _file.errorString();
+		_file.close();
+		return false;
+	}
+
+	auto data = _file.map(0, size);
+	if (!data) {
+		_error = _file.errorString();
+		_file.close();
+		return false;
+	}
+
+	_header = reinterpret_cast<Header*>(data);
+	_records = reinterpret_cast<Record*>(data + headerSize());
+	reuse = reuse &&
+			_header->magic == Magic &&
+			_header->version == Version &&
+			_header->recordSize == RecordSize &&
+			_header->recordCount == static_cast<quint32>(records);
+	if (!reuse) {
+		std::memset(data, 0, static_cast<size_t>(size));
+		_header->magic = Magic;
+		_header->version = Version;
+		_header->recordSize = RecordSize;
+		_header->recordCount = static_cast<quint32>(records);
+		_header->nextSequence.store(0, std::memory_order_release);
+	}
+	return true;
+}
+
+void StandardFlightRecorder::close()
+{
+	if (!_file.isOpen())
+		return;
+	// the mapping is shared, so everything written so far stays in the file
+	_header = nullptr;
+	_records = nullptr;
+	_file.close();
+}
+
+bool StandardFlightRecorder::isOpen() const
+{
+	return _header;
+}
+
+QString StandardFlightRecorder::errorString() const
+{
+	return _error;
+}
+
+void StandardFlightRecorder::record(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+	if (!_header)
+		return;
+
+	const auto sequence = _header->nextSequence.fetch_add(1, std::memory_order_relaxed);
+	auto &rec = _records[sequence % _header->recordCount];
+	rec.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	rec.msecsSinceEpoch = QDateTime::currentMSecsSinceEpoch();
+	rec.type = static_cast<quint32>(type);
+	// the category is truncated to half of the record at most, the message takes the rest
+	const auto categorySize = context.category ?
+								  std::min(std::strlen(context.category), sizeof(rec.data) / 2) :
+								  0;
+	std::memcpy(rec.data, context.category, categorySize);
+	const auto msg = message.toUtf8();
+	const auto messageSize = std::min(static_cast<size_t>(msg.size()), sizeof(rec.data) - categorySize);
+	std::memcpy(rec.data + categorySize, msg.constData(), messageSize);
+	rec.categorySize = static_cast<quint16>(categorySize);
+	rec.messageSize = static_cast<quint16>(messageSize);
+
+	rec.sequence.store(sequence + 1, std::memory_order_release);
+}
+
+QList<StandardFlightRecorder::Entry> StandardFlightRecorder::read(const QString &path, QString *errorString)
+{
+	QFile file{path};
+	if (!file.open(QIODevice::ReadOnly)) {
+		if (errorString)
+			*errorString = file.errorString();
+		return {};
+	}
+
+	const auto size = file.size();
+	const auto data = size >= headerSize() ? file.map(0, size) : nullptr;
+	if (!data) {
+		if (errorString)
+			*errorString = QStringLiteral("Not a valid flight recorder file: %1").arg(path);
+		return {};
+	}
+
+	const auto header = reinterpret_cast<Header*>(data);
+	if (header->magic != Magic ||
+		header->version != Version ||
+		header->recordSize != RecordSize ||
+		size < headerSize() + static_cast<qint64>(header->recordCount) * RecordSize) {
+		if (errorString)
+			*errorString = QStringLiteral("Not a valid flight recorder file: %1").arg(path);
+		return {};
+	}
+
+	const auto records = reinterpret_cast<Record*>(data + headerSize());
+	QList<Entry> entries;
+	entries.reserve(static_cast<int>(header->recordCount));
+	for (auto i = 0u; i < header->recordCount; ++i) {
+		auto &rec = records[i];
+		const auto sequence = rec.sequence.load(std::memory_order_acquire);
+		if (sequence == 0)
+			continue;
+
+		Entry entry;
+		entry.sequence = sequence - 1;
+		entry.time = QDateTime::fromMSecsSinceEpoch(rec.msecsSinceEpoch);
+		entry.type = static_cast<QtMsgType>(rec.type);
+		const auto categorySize = std::min<size_t>(rec.categorySize, sizeof(rec.data));
+		const auto messageSize = std::min<size_t>(rec.messageSize, sizeof(rec.data) - categorySize);
+		entry.category = QString::fromUtf8(rec.data, static_cast<int>(categorySize));
+		entry.message = QString::fromUtf8(rec.data + categorySize, static_cast<int>(messageSize));
+
+		// skip records that were overwritten by the service while being read
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (rec.sequence.load(std::memory_order_relaxed) == sequence)
+			entries.append(entry);
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry &lhs, const Entry &rhs) {
+		return lhs.sequence < rhs.sequence;
+	});
+	return entries;
+}
+
+qint64 StandardFlightRecorder::headerSize()
+{
+	// keep the records cache line aligned
+	return 64;
+}
+
+QString StandardFlightRecorder::Entry::toString() const
+{
+	QString typeName;
+	switch (type) {
+	case QtDebugMsg:
+		typeName = QStringLiteral("Debug]    ");
+		break;
+	case QtInfoMsg:
+		typeName = QStringLiteral("Info]     ");
+		break;
+	case QtWarningMsg:
+		typeName = QStringLiteral("Warning]  ");
+		break;
+	case QtCriticalMsg:
+		typeName = QStringLiteral("Critical] ");
+		break;
+	case QtFatalMsg:
+		typeName = QStringLiteral("Fatal]    ");
+		break;
+	}
+
+	return QStringLiteral("[%1 %2%3%4")
+		.arg(time.toString(Qt::ISODateWithMs),
+			 typeName,
+			 category.isEmpty() ? QString{} : category + QStringLiteral(": "),
+			 message);
+}
@@ -0,0 +1,75 @@
+#ifndef STANDARDFLIGHTRECORDER_H
+#define STANDARDFLIGHTRECORDER_H
+
+#include <atomic>
+
+#include <QtCore/QFile>
+#include <QtCore/QDateTime>
+#include <QtCore/QStringList>
+
+class StandardFlightRecorder
+{
+	Q_DISABLE_COPY(StandardFlightRecorder)
+
+public:
+	static const QString FileName;
+	static constexpr int DefaultRecords = 1024;
+
+	struct Entry {
+		quint64 sequence = 0;
+		QDateTime time;
+		QtMsgType type = QtDebugMsg;
+		QString category;
+		QString message;
+
+		QString toString() const;
+	};
+
+	StandardFlightRecorder() = default;
+	~StandardFlightRecorder();
+
+	bool open(const QString &path, int records);
+	void close();
+	bool isOpen() const;
+	QString errorString() const;
+
+	void record(QtMsgType type, const QMessageLogContext &context, const QString &message);
+
+	static QList<Entry> read(const QString &path, QString *errorString = nullptr);
+
+private:
+	static constexpr quint32 Magic = 0x52465351; // "QSFR"
+	static constexpr quint32 Version = 1;
+	static constexpr int RecordSize = 512;
+
+	struct Header {
+		quint32 magic;
+		quint32 version;
+		quint32 recordSize;
+		quint32 recordCount;
+		std::atomic<quint64> nextSequence;
+	};
+
+	struct Record {
+		// 0 while the record is empty or being written, the sequence number + 1 once complete
+		std::atomic<quint64> sequence;
+		qint64 msecsSinceEpoch;
+		quint32 type;
+		quint16 categorySize;
+		quint16 messageSize;
+		char data[RecordSize - 24];
+	};
+
+	static_assert(std::atomic<quint64>::is_always_lock_free, "the flight recorder requires lock free 64 bit atomics");
+	static_assert(sizeof(Header) <= 64, "unexpected flight recorder header layout");
+	static_assert(sizeof(Record) == RecordSize, "unexpected flight recorder record layout");
+
+	QFile _file;
+	Header *_header = nullptr;
+	Record *_records = nullptr;
+	QString _error;
+
+	static qint64 headerSize();
+};
+
+#endif // STANDARDFLIGHTRECORDER_H
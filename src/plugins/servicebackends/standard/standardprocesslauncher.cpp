@@ -0,0 +1,356 @@
+#include "standardprocesslauncher.h"
+#include <QtCore/QFile>
+#include <QtCore/QScopeGuard>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+namespace {
+
+bool readFully(int fd, void *data, size_t size)
+{
+	auto buffer = static_cast<char*>(data);
+	size_t done = 0;
+	while (done < size) {
+		const auto res = ::read(fd, buffer + done, size - done);
+		if (res > 0)
+			done += static_cast<size_t>(res);
+		else if (res == -1 && errno == EINTR)
+			continue;
+		else
+			return false;
+	}
+	return true;
+}
+
+// async signal safe, so it can be used in the child after forking
+bool writeFully(int fd, const void *data, size_t size)
+{
+	auto buffer = static_cast<const char*>(data);
+	size_t done = 0;
+	while (done < size) {
+		const auto res = ::write(fd, buffer + done, size - done);
+		if (res > 0)
+			done += static_cast<size_t>(res);
+		else if (res == -1 && errno == EINTR)
+			continue;
+		else
+			return false;
+	}
+	return true;
+}
+
+void setCloseOnExec(int fd)
+{
+	::fcntl(fd, F_SETFD, ::fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+// descriptors below the minimum could be overwritten when the child moves the sockets in place
+int moveAbove(int fd, int minFd)
+{
+	if (fd >= minFd) {
+		setCloseOnExec(fd);
+		return fd;
+	}
+	const auto newFd = ::fcntl(fd, F_DUPFD_CLOEXEC, minFd);
+	const auto error = errno;
+	::close(fd);
+	errno = error;
+	return newFd;
+}
+
+}
+
+StandardProcessLauncher::StandardProcessLauncher(const QString &executable, const QByteArrayList &arguments) :
+	_executable{QFile::encodeName(executable)},
+	_arguments{arguments},
+	_environment{QProcessEnvironment::systemEnvironment()}
+{}
+
+void StandardProcessLauncher::setEnvironment(const QProcessEnvironment &environment)
+{
+	_environment = environment;
+}
+
+void StandardProcessLauncher::setWorkingDirectory(const QString &path)
+{
+	_workingDirectory = QFile::encodeName(path);
+}
+
+void StandardProcessLauncher::setDetached(bool detached, bool forwardChannels)
+{
+	_detached = detached;
+	_forwardChannels = forwardChannels;
+}
+
+void StandardProcessLauncher::addSocket(const QByteArray &name, int socket)
+{
+	_names.append(name);
+	_sockets.append(socket);
+}
+
+int StandardProcessLauncher::addDescriptor(int descriptor)
+{
+	_descriptors.append(descriptor);
+	return ListenFdsStart + _sockets.size() + _descriptors.size() - 1;
+}
+
+bool StandardProcessLauncher::start()
+{
+	_pid = -1;
+	_error.clear();
+
+	// copies are placed above the target range, so moving them in place cannot overwrite one
+	const auto allFds = _sockets + _descriptors;
+	QVector<int> tempFds;
+	tempFds.reserve(allFds.size());
+	const auto _sg0 = qScopeGuard([&]() {
+		for (const auto fd : qAsConst(tempFds))
+			::close(fd);
+	});
+	for (const auto fd : allFds) {
+		const auto tempFd = ::fcntl(fd, F_DUPFD_CLOEXEC, ListenFdsStart + allFds.size());
+		if (tempFd == -1) {
+			_error = qt_error_string(errno);
+			return false;
+		}
+		tempFds.append(tempFd);
+	}
+
+	auto environment = _environment;
+	for (const auto &key : {QStringLiteral("LISTEN_PID"), QStringLiteral("LISTEN_FDS"), QStringLiteral("LISTEN_FDNAMES")})
+		environment.remove(key);
+	if (!_sockets.isEmpty()) {
+		environment.insert(QStringLiteral("LISTEN_FDS"), QString::number(_sockets.size()));
+		environment.insert(QStringLiteral("LISTEN_FDNAMES"), QString::fromLocal8Bit(_names.join(':')));
+	}
+
+	// everything is prepared before forking, as the child may only use async signal safe functions
+	QByteArrayList envStrings;
+	for (const auto &entry : environment.toStringList())
+		envStrings.append(entry.toLocal8Bit());
+	// the PID of the child is filled in after forking
+	const QByteArray listenPidPrefix {"LISTEN_PID="};
+	if (!_sockets.isEmpty())
+		envStrings.append(listenPidPrefix + QByteArray(20, '\0'));
+	auto arguments = _arguments;
+	QVector<char*> argvPtrs {_executable.data()};
+	for (auto &arg : arguments)
+		argvPtrs.append(arg.data());
+	argvPtrs.append(nullptr);
+	QVector<char*> envPtrs;
+	for (auto &entry : envStrings)
+		envPtrs.append(entry.data());
+	envPtrs.append(nullptr);
+	const auto fdList = tempFds.constData();
+	const auto fdCount = tempFds.size();
+	const auto listenPidValue = _sockets.isEmpty() ?
+									nullptr :
+									envPtrs[envPtrs.size() - 2] + listenPidPrefix.size();
+	const auto executable = _executable.constData();
+	const auto workingDirectory = _workingDirectory.isEmpty() ? nullptr : _workingDirectory.constData();
+	const auto detached = _detached;
+	const auto nullChannels = _detached && !_forwardChannels;
+
+	// the process that runs the executable reports its PID, and the error if exec failed
+	int statusFds[2];
+	if (::pipe(statusFds) != 0) {
+		_error = qt_error_string(errno);
+		return false;
+	}
+	for (auto &fd : statusFds)
+		fd = moveAbove(fd, ListenFdsStart + allFds.size());
+	if (statusFds[0] == -1 || statusFds[1] == -1) {
+		_error = qt_error_string(errno);
+		for (const auto fd : statusFds) {
+			if (fd != -1)
+				::close(fd);
+		}
+		return false;
+	}
+
+	const auto pid = ::fork();
+	if (pid == 0) {
+		::close(statusFds[0]);
+		sigset_t mask;
+		::sigemptyset(&mask);
+		::sigprocmask(SIG_SETMASK, &mask, nullptr);
+		if (detached) {
+			::setsid();
+			const auto grandchild = ::fork();
+			if (grandchild != 0)
+				::_exit(grandchild == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+		}
+		if (nullChannels) {
+			const auto nullFd = ::open("/dev/null", O_RDWR);
+			if (nullFd != -1) {
+				for (auto i = 0; i < 3; ++i)
+					::dup2(nullFd, i);
+				if (nullFd > 2)
+					::close(nullFd);
+			}
+		}
+
+		const auto selfPid = ::getpid();
+		if (!writeFully(statusFds[1], &selfPid, sizeof(selfPid)))
+			::_exit(127);
+		for (auto i = 0; i < fdCount; ++i) {
+			if (::dup2(fdList[i], ListenFdsStart + i) == -1)
+				::_exit(127);
+		}
+		if (workingDirectory && ::chdir(workingDirectory) != 0)
+			::_exit(127);
+
+		if (listenPidValue) {
+			char digits[24];
+			auto len = 0;
+			for (auto value = selfPid; value > 0; value /= 10)
+				digits[len++] = static_cast<char>('0' + value % 10);
+			auto out = listenPidValue;
+			while (len > 0)
+				*out++ = digits[--len];
+			*out = '\0';
+		}
+
+		::execve(executable, argvPtrs.data(), envPtrs.data());
+		const auto error = errno;
+		// the parent keeps the read end open, so this can only fail if it already gave up on the child
+		writeFully(statusFds[1], &error, sizeof(error));
+		::_exit(127);
+	}
+
+	::close(statusFds[1]);
+	const auto _sg1 = qScopeGuard([&]() {
+		::close(statusFds[0]);
+	});
+	if (pid == -1) {
+		_error = qt_error_string(errno);
+		return false;
+	}
+	if (detached) {
+		// the intermediate child exits right after forking
+		while (::waitpid(pid, nullptr, 0) == -1 && errno == EINTR);
+	}
+
+	pid_t childPid = -1;
+	if (!readFully(statusFds[0], &childPid, sizeof(childPid))) {
+		_error = QStringLiteral("Failed to fork the process");
+		return false;
+	}
+	int error = 0;
+	if (readFully(statusFds[0], &error, sizeof(error))) {
+		_error = qt_error_string(error);
+		if (!detached)
+			while (::waitpid(childPid, nullptr, 0) == -1 && errno == EINTR);
+		return false;
+	}
+
+	_pid = childPid;
+	return true;
+}
+
+qint64 StandardProcessLauncher::processId() const
+{
+	return _pid;
+}
+
+QString StandardProcessLauncher::errorString() const
+{
+	return _error;
+}
+
+int StandardProcessLauncher::openListenSocket(const QString &address, QString *errorString)
+{
+	const auto fail = [errorString](const QString &error) {
+		if (errorString)
+			*errorString = error;
+		return -1;
+	};
+
+	// same formats as ListenStream= of a systemd socket unit: a path, a port or an address with port
+	if (address.startsWith(QLatin1Char('/'))) {
+		const auto path = QFile::encodeName(address);
+		sockaddr_un addr {};
+		addr.sun_family = AF_UNIX;
+		if (static_cast<size_t>(path.size()) >= sizeof(addr.sun_path))
+			return fail(QStringLiteral("Socket path is too long: %1").arg(address));
+		qstrncpy(addr.sun_path, path.constData(), sizeof(addr.sun_path));
+
+		const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == -1)
+			return fail(qt_error_string(errno));
+		setCloseOnExec(fd);
+		// a socket file left behind by a previous run would make binding fail
+		struct stat info;
+		if (::stat(path.constData(), &info) == 0 && S_ISSOCK(info.st_mode))
+			::unlink(path.constData());
+		if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+			::listen(fd, SOMAXCONN) != 0) {
+			const auto error = errno;
+			::close(fd);
+			return fail(qt_error_string(error));
+		}
+		return fd;
+	}
+
+	QByteArray host;
+	QByteArray port;
+	const auto portIndex = address.lastIndexOf(QLatin1Char(':'));
+	if (portIndex == -1)
+		port = address.toUtf8();
+	else {
+		host = address.left(portIndex).toUtf8();
+		port = address.mid(portIndex + 1).toUtf8();
+		if (host.startsWith('[') && host.endsWith(']'))
+			host = host.mid(1, host.size() - 2);
+	}
+
+	addrinfo hints {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	addrinfo *result = nullptr;
+	const auto res = ::getaddrinfo(host.isEmpty() ? nullptr : host.constData(), port.constData(), &hints, &result);
+	if (res != 0)
+		return fail(QStringLiteral("Invalid socket address %1: %2").arg(address, QString::fromLocal8Bit(::gai_strerror(res))));
+	const auto _sg0 = qScopeGuard([result]() {
+		::freeaddrinfo(result);
+	});
+
+	// without a host, prefer a dual stack IPv6 socket, so IPv4 clients can connect as well
+	auto lastError = 0;
+	for (const auto preferIPv6 : {true, false}) {
+		for (auto info = result; info; info = info->ai_next) {
+			if (host.isEmpty() && preferIPv6 != (info->ai_family == AF_INET6))
+				continue;
+			if (!host.isEmpty() && !preferIPv6)
+				break;
+
+			const auto fd = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+			if (fd == -1) {
+				lastError = errno;
+				continue;
+			}
+			setCloseOnExec(fd);
+			const int on = 1;
+			::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			if (host.isEmpty() && info->ai_family == AF_INET6) {
+				const int off = 0;
+				::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+			}
+			if (::bind(fd, info->ai_addr, info->ai_addrlen) == 0 &&
+				::listen(fd, SOMAXCONN) == 0)
+				return fd;
+			lastError = errno;
+			::close(fd);
+		}
+	}
+	return fail(qt_error_string(lastError));
+}
@@ -0,0 +1,48 @@
+#ifndef STANDARDPROCESSLAUNCHER_H
+#define STANDARDPROCESSLAUNCHER_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtCore/QByteArrayList>
+#include <QtCore/QProcessEnvironment>
+
+class StandardProcessLauncher
+{
+	Q_DISABLE_COPY(StandardProcessLauncher)
+
+public:
+	// same layout as systemd socket activation, so the sockets can be passed to any compatible service
+	static constexpr int ListenFdsStart = 3;
+
+	StandardProcessLauncher(const QString &executable, const QByteArrayList &arguments);
+
+	void setEnvironment(const QProcessEnvironment &environment);
+	void setWorkingDirectory(const QString &path);
+	void setDetached(bool detached, bool forwardChannels = false);
+
+	// the descriptors are only duplicated when starting, so they must stay open until then
+	void addSocket(const QByteArray &name, int socket);
+	// passed after the sockets, but not included in LISTEN_FDS - returns the number in the child
+	int addDescriptor(int descriptor);
+
+	bool start();
+	qint64 processId() const;
+	QString errorString() const;
+
+	static int openListenSocket(const QString &address, QString *errorString = nullptr);
+
+private:
+	QByteArray _executable;
+	QByteArrayList _arguments;
+	QProcessEnvironment _environment;
+	QByteArray _workingDirectory;
+	bool _detached = false;
+	bool _forwardChannels = false;
+	QByteArrayList _names;
+	QVector<int> _sockets;
+	QVector<int> _descriptors;
+	qint64 _pid = -1;
+	QString _error;
+};
+
+#endif // STANDARDPROCESSLAUNCHER_H
@@ -1,16 +1,27 @@
 #include "standardservicebackend.h"
 #include "standardserviceplugin.h"
-#include <QtCore/QLockFile>
+#ifdef Q_OS_UNIX
+#include "standardprocesslauncher.h"
+#endif
+#include <QtCore/QProcessEnvironment>
+#include <QtCore/QSaveFile>
 #ifdef Q_OS_WIN
 #include <qt_windows.h>
 #else
 #include <csignal>
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 #endif
 using namespace QtService;
 
 Q_LOGGING_CATEGORY(logBackend, "qt.service.plugin.standard.backend")
 
+QtMessageHandler StandardServiceBackend::_previousHandler = nullptr;
+StandardFlightRecorder *StandardServiceBackend::_activeRecorder = nullptr;
+
 StandardServiceBackend::StandardServiceBackend(bool debugMode, Service *service) :
 	ServiceBackend{service},
 	_debugMode{debugMode}
@@ -42,36 +53,77 @@ int StandardServiceBackend::runService(int &argc, char **argv, int flags)
 									  "%{message}").arg(filePrefix));
 #endif
 
+	for (auto i = 1; i < argc - 1; ++i) {
+		if (qstrcmp(argv[i], "--flight-recorder") == 0) {
+			_flightRecorderSize = QByteArray{argv[i + 1]}.toInt();
+			if (_flightRecorderSize <= 0)
+				_flightRecorderSize = StandardFlightRecorder::DefaultRecords;
+			break;
+		}
+	}
+
+	for (auto i = 1; i < argc; ++i)
+		_arguments.append(argv[i]);
+	readInheritedSockets();
+
 	QCoreApplication app(argc, argv, flags);
+	// resolved now, as the binary is typically replaced before a hot upgrade
+	_executable = QCoreApplication::applicationFilePath();
 	if (!preStartService())
 		return EXIT_FAILURE;
 
 	// create lock
-	qCDebug(logBackend) << "Creating service lock";
 	QLockFile lock{service()->runtimeDir().absoluteFilePath(QStringLiteral("qstandard.lock"))};
 	lock.setStaleLockTime(std::numeric_limits<int>::max()); //disable stale locks
-	if (!lock.tryLock(5000)) {
-		qCCritical(logBackend) << "Failed to create service lock in"
-							   << service()->runtimeDir().absolutePath()
-							   << "with error code:" << lock.error();
-		if (lock.error() == QLockFile::LockFailedError) {
-			qint64 pid = 0;
-			QString hostname, appname;
-			if (lock.getLockInfo(&pid, &hostname, &appname)) {
-				qCCritical(logBackend).noquote() << "Service already running as:"
-												 << "\n\tPID:" << pid
-												 << "\n\tHostname:" << hostname
-												 << "\n\tAppname:" << appname;
-			} else
-				qCCritical(logBackend) << "Unable to determine current lock owner";
+	_lock = &lock;
+	_readyPath = service()->runtimeDir().absoluteFilePath(QStringLiteral("qstandard.ready"));
+	_progressPath = service()->runtimeDir().absoluteFilePath(QStringLiteral("qstandard.progress"));
+	if (_handoverFd != -1) {
+		// the previous instance keeps the lock until this one has started and it has released it
+		qCDebug(logBackend) << "Taking over from a previous instance - acquiring service lock after start";
+	} else {
+		qCDebug(logBackend) << "Creating service lock";
+		if (!lock.tryLock(5000)) {
+			qCCritical(logBackend) << "Failed to create service lock in"
+								   << service()->runtimeDir().absolutePath()
+								   << "with error code:" << lock.error();
+			if (lock.error() == QLockFile::LockFailedError) {
+				qint64 pid = 0;
+				QString hostname, appname;
+				if (lock.getLockInfo(&pid, &hostname, &appname)) {
+					qCCritical(logBackend).noquote() << "Service already running as:"
+													 << "\n\tPID:" << pid
+													 << "\n\tHostname:" << hostname
+													 << "\n\tAppname:" << appname;
+				} else
+					qCCritical(logBackend) << "Unable to determine current lock owner";
+			}
+			return EXIT_FAILURE;
 		}
-		return EXIT_FAILURE;
+		QFile::remove(_readyPath);
+		QFile::remove(_progressPath);
 	}
+	if (_flightRecorderSize > 0)
+		startFlightRecorder();
 
 	//ensure unlocking always works
 	connect(qApp, &QCoreApplication::aboutToQuit,
 			this, [&]() {
+		if (_activeRecorder) {
+			qInstallMessageHandler(_previousHandler);
+			_activeRecorder = nullptr;
+		}
+		finishHandover();
+		removeOwnedFile(_readyPath);
+		removeOwnedFile(_progressPath);
 		lock.unlock();
+		_lock = nullptr;
+		// a new instance that has started takes over the lock as soon as it has been released
+		if (_upgradeSocket && _upgradeSocket->state() == QLocalSocket::ConnectedState) {
+			_upgradeSocket->write("1", 1);
+			_upgradeSocket->waitForBytesWritten(1000);
+		}
+		finishUpgrade();
 	});
 	connect(service(), QOverload<bool>::of(&Service::started),
 			this, &StandardServiceBackend::onStarted);
@@ -81,7 +133,7 @@ int StandardServiceBackend::runService(int &argc, char **argv, int flags)
 #ifdef Q_OS_WIN
 	for (const auto signal : {CTRL_C_EVENT, CTRL_BREAK_EVENT}) {
 #else
-	for (const auto signal : {SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGTSTP, SIGCONT, SIGUSR1, SIGUSR2}) {
+	for (const auto signal : {SIGINT, SIGTERM, SIGQUIT, SIGHUP, SIGTSTP, SIGCONT, SIGUSR1, SIGUSR2, SIGWINCH}) {
 #endif
 		registerForSignal(signal);
 	}
@@ -106,6 +158,78 @@ void StandardServiceBackend::reloadService()
 	processServiceCommand(ServiceCommand::Reload);
 }
 
+QList<int> StandardServiceBackend::getActivatedSockets(const QByteArray &name)
+{
+	QList<int> sockets;
+	for (const auto &socket : qAsConst(_sockets)) {
+		if (name.isNull())
+			return {socket.second};
+		else if (socket.first == name)
+			sockets.append(socket.second);
+	}
+	return sockets;
+}
+
+bool StandardServiceBackend::storeActivatedSocket(const QByteArray &name, int socket)
+{
+#ifdef Q_OS_UNIX
+	if (name.isEmpty() || name.contains(':')) {
+		qCWarning(logBackend) << "Cannot store socket with invalid name" << name;
+		return false;
+	}
+
+	// keep a copy, as the service closes its own descriptor
+	const auto fd = ::fcntl(socket, F_DUPFD_CLOEXEC, 0);
+	if (fd == -1) {
+		qCWarning(logBackend) << "Failed to store socket" << name << "with error:" << qt_error_string(errno);
+		return false;
+	}
+	_sockets.append({name, fd});
+	qCDebug(logBackend) << "Stored socket" << socket << "as" << name;
+	return true;
+#else
+	return ServiceBackend::storeActivatedSocket(name, socket);
+#endif
+}
+
+bool StandardServiceBackend::removeStoredSockets(const QByteArray &name)
+{
+#ifdef Q_OS_UNIX
+	auto removed = false;
+	for (auto it = _sockets.begin(); it != _sockets.end();) {
+		if (it->first == name) {
+			::close(it->second);
+			it = _sockets.erase(it);
+			removed = true;
+		} else
+			++it;
+	}
+	return removed;
+#else
+	return ServiceBackend::removeStoredSockets(name);
+#endif
+}
+
+void StandardServiceBackend::reportProgress(const QString &status, int extendTimeoutMsecs)
+{
+	ServiceBackend::reportProgress(status, extendTimeoutMsecs);
+	if (_progressPath.isEmpty())
+		return;
+
+	// blocking controls poll this file to show the progress and move their deadline
+	QSaveFile progressFile{_progressPath};
+	if (!progressFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		qCWarning(logBackend) << "Failed to create progress file with error:" << progressFile.errorString();
+		return;
+	}
+	progressFile.write(QByteArray::number(QCoreApplication::applicationPid()) + '\n');
+	progressFile.write(QByteArray::number(++_progressCount) + '\n');
+	progressFile.write(QByteArray::number(extendTimeoutMsecs) + '\n');
+	progressFile.write(status.toUtf8() + '\n');
+	if (!progressFile.commit())
+		qCWarning(logBackend) << "Failed to write progress file with error:" << progressFile.errorString();
+}
+
 void StandardServiceBackend::signalTriggered(int signal)
 {
 	qCDebug(logBackend) << "Handeling signal" << signal;
@@ -136,6 +260,9 @@ void StandardServiceBackend::signalTriggered(int signal)
 	case SIGUSR2:
 		processServiceCallback("SIGUSR2");
 		break;
+	case SIGWINCH:
+		startUpgrade();
+		break;
 #endif
 	default:
 		ServiceBackend::signalTriggered(signal);
@@ -143,10 +270,65 @@ void StandardServiceBackend::signalTriggered(int signal)
 	}
 }
 
+void StandardServiceBackend::startFlightRecorder()
+{
+	const auto path = service()->runtimeDir().absoluteFilePath(StandardFlightRecorder::FileName);
+	if (!_flightRecorder.open(path, _flightRecorderSize)) {
+		qCWarning(logBackend) << "Failed to open flight recorder" << path
+							  << "with error:" << _flightRecorder.errorString();
+		return;
+	}
+
+	_activeRecorder = &_flightRecorder;
+	_previousHandler = qInstallMessageHandler(&StandardServiceBackend::recordMessage);
+	qCDebug(logBackend) << "Recording the last" << _flightRecorderSize
+						<< "log messages to" << path;
+}
+
+void StandardServiceBackend::recordMessage(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+	if (_activeRecorder)
+		_activeRecorder->record(type, context, message);
+	if (_previousHandler)
+		_previousHandler(type, context, message);
+}
+
 void StandardServiceBackend::onStarted(bool success)
 {
-	if (!success)
+	if (!success) {
 		qApp->exit(EXIT_FAILURE);
+		return;
+	}
+
+	// lets blocking controls know the start has completed. During a hot upgrade, it also keeps the service
+	// reported as running between the previous instance releasing the lock and this one taking it over
+	QFile readyFile{_readyPath};
+	if (readyFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		readyFile.write(QByteArray::number(QCoreApplication::applicationPid()) + '\n');
+	else
+		qCWarning(logBackend) << "Failed to create ready file with error:" << readyFile.errorString();
+	removeOwnedFile(_progressPath);
+
+#ifdef Q_OS_UNIX
+	if (_handoverFd != -1) {
+		// tells the previous instance to quit, which acknowledges once it has released the lock
+		_handoverSocket = new QLocalSocket{this};
+		connect(_handoverSocket, &QLocalSocket::readyRead,
+				this, &StandardServiceBackend::takeOverLock);
+		connect(_handoverSocket, &QLocalSocket::disconnected,
+				this, &StandardServiceBackend::takeOverLock);
+		_handoverSocket->setSocketDescriptor(_handoverFd);
+		_handoverFd = -1;
+		_handoverSocket->write("1", 1);
+
+		_lockTimer = new QTimer{this};
+		_lockTimer->setSingleShot(true);
+		_lockTimer->setInterval(HandoverTimeout);
+		connect(_lockTimer, &QTimer::timeout,
+				this, &StandardServiceBackend::onHandoverTimeout);
+		_lockTimer->start();
+	}
+#endif
 }
 
 void StandardServiceBackend::onPaused(bool success)
@@ -157,3 +339,173 @@ void StandardServiceBackend::onPaused(bool success)
 #endif
 }
 
+
+void StandardServiceBackend::onUpgradeReply()
+{
+	if (!_upgradeSocket)
+		return;
+
+	// the new instance only replies once it has started, it closes the socket if it failed to
+	if (_upgradeSocket->read(1) == "1") {
+		qCInfo(logBackend) << "New instance with PID" << _upgradePid
+						   << "has started - stopping this instance";
+		// the socket stays open to acknowledge once the lock has been released while quitting
+		_upgradeSocket->disconnect(this);
+		quitService();
+	} else if (_upgradeSocket->state() != QLocalSocket::ConnectedState) {
+		qCWarning(logBackend) << "New instance with PID" << _upgradePid
+							  << "failed to start - continuing with this instance";
+		finishUpgrade();
+	}
+}
+
+void StandardServiceBackend::takeOverLock()
+{
+	if (!_lock || !_handoverSocket)
+		return;
+
+	// waits for the acknowledgement, unless the previous instance closed the socket without one
+	if (_handoverSocket->state() == QLocalSocket::ConnectedState) {
+		if (_handoverSocket->read(1) != "1")
+			return;
+		_handoverSocket->disconnect(this);
+		_handoverSocket->abort();
+	}
+
+	if (!_lock->tryLock(0)) {
+		if (_lock->error() == QLockFile::LockFailedError) {
+			// without an acknowledgement, the lock only becomes stale once the previous instance has exited
+			QTimer::singleShot(LockRetryInterval, this, &StandardServiceBackend::takeOverLock);
+			return;
+		}
+		qCCritical(logBackend) << "Failed to take over service lock with error code:" << _lock->error();
+	} else
+		qCDebug(logBackend) << "Took over service lock from previous instance";
+	finishHandover();
+}
+
+void StandardServiceBackend::onHandoverTimeout()
+{
+	// running without the lock would let the service be started a second time
+	qCCritical(logBackend) << "Previous instance did not release the service lock within"
+						   << HandoverTimeout << "ms - stopping this instance";
+	finishHandover();
+	quitService();
+}
+
+void StandardServiceBackend::readInheritedSockets()
+{
+#ifdef Q_OS_UNIX
+	const auto listenPid = qgetenv("LISTEN_PID").toLongLong();
+	const auto listenFds = qgetenv("LISTEN_FDS").toInt();
+	const auto listenNames = qgetenv("LISTEN_FDNAMES").split(':');
+	const auto handoverFd = qgetenv("QTSERVICE_HANDOVER_FD");
+	// must not be passed on to child processes of the service
+	for (const auto key : {"LISTEN_PID", "LISTEN_FDS", "LISTEN_FDNAMES", "QTSERVICE_HANDOVER_FD"})
+		qunsetenv(key);
+	if (listenPid != ::getpid())
+		return;
+
+	for (auto i = 0; i < listenFds; ++i) {
+		const auto fd = StandardProcessLauncher::ListenFdsStart + i;
+		::fcntl(fd, F_SETFD, FD_CLOEXEC);
+		_sockets.append({listenNames.value(i), fd});
+	}
+	if (!handoverFd.isEmpty()) {
+		_handoverFd = handoverFd.toInt();
+		::fcntl(_handoverFd, F_SETFD, FD_CLOEXEC);
+	}
+	qCDebug(logBackend) << "Inherited" << listenFds << "sockets";
+#endif
+}
+
+void StandardServiceBackend::startUpgrade()
+{
+#ifdef Q_OS_UNIX
+	if (_upgradePid != 0) {
+		qCWarning(logBackend) << "A hot upgrade is already in progress";
+		return;
+	}
+	if (!_lock || !_lock->isLocked()) {
+		qCWarning(logBackend) << "Cannot upgrade before the service lock has been taken over";
+		return;
+	}
+
+	qCInfo(logBackend) << "Starting hot upgrade of" << _executable
+					   << "with" << _sockets.size() << "sockets";
+	int handoverFds[2];
+	if (::socketpair(AF_UNIX, SOCK_STREAM, 0, handoverFds) != 0) {
+		qCWarning(logBackend) << "Failed to create handover socket with error:" << qt_error_string(errno);
+		return;
+	}
+	for (const auto fd : handoverFds)
+		::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	StandardProcessLauncher launcher{_executable, _arguments};
+	for (const auto &socket : qAsConst(_sockets))
+		launcher.addSocket(socket.first, socket.second);
+	const auto handoverFd = launcher.addDescriptor(handoverFds[1]);
+	auto environment = QProcessEnvironment::systemEnvironment();
+	environment.insert(QStringLiteral("QTSERVICE_HANDOVER_FD"), QString::number(handoverFd));
+	launcher.setEnvironment(environment);
+	const auto ok = launcher.start();
+	::close(handoverFds[1]);
+	if (!ok) {
+		qCWarning(logBackend) << "Failed to start new instance with error:" << launcher.errorString();
+		::close(handoverFds[0]);
+		return;
+	}
+
+	_upgradePid = launcher.processId();
+	_upgradeSocket = new QLocalSocket{this};
+	connect(_upgradeSocket, &QLocalSocket::readyRead,
+			this, &StandardServiceBackend::onUpgradeReply);
+	connect(_upgradeSocket, &QLocalSocket::disconnected,
+			this, &StandardServiceBackend::onUpgradeReply);
+	_upgradeSocket->setSocketDescriptor(handoverFds[0]);
+	qCDebug(logBackend) << "Started new instance with PID" << _upgradePid << "- waiting for it to start";
+#endif
+}
+
+void StandardServiceBackend::finishUpgrade()
+{
+	if (!_upgradeSocket)
+		return;
+
+	_upgradeSocket->disconnect(this);
+	_upgradeSocket->abort();
+	_upgradeSocket->deleteLater();
+	_upgradeSocket = nullptr;
+#ifdef Q_OS_UNIX
+	// reaps the new instance in case it failed, the running one is reparented once this one exits
+	::waitpid(static_cast<pid_t>(_upgradePid), nullptr, WNOHANG);
+#endif
+	_upgradePid = 0;
+}
+
+void StandardServiceBackend::finishHandover()
+{
+	if (_lockTimer) {
+		_lockTimer->stop();
+		_lockTimer->deleteLater();
+		_lockTimer = nullptr;
+	}
+	if (_handoverSocket) {
+		_handoverSocket->disconnect(this);
+		_handoverSocket->abort();
+		_handoverSocket->deleteLater();
+		_handoverSocket = nullptr;
+	}
+}
+
+void StandardServiceBackend::removeOwnedFile(const QString &path)
+{
+	// after a hot upgrade, the file already belongs to the new instance
+	QFile file{path};
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+		return;
+	const auto pid = file.readLine(32).trimmed().toLongLong();
+	file.close();
+	if (pid == QCoreApplication::applicationPid())
+		file.remove();
+}
@@ -2,20 +2,33 @@
 #define STANDARDSERVICEBACKEND_H
 
 #include <QtCore/QPointer>
+#include <QtCore/QLockFile>
+#include <QtCore/QTimer>
 #include <QtCore/QLoggingCategory>
 
+#include <QtNetwork/QLocalSocket>
+
 #include <QtService/ServiceBackend>
 
+#include "standardflightrecorder.h"
+
 class StandardServiceBackend : public QtService::ServiceBackend
 {
 	Q_OBJECT
 
 public:
+	static constexpr int HandoverTimeout = 30000;
+	static constexpr int LockRetryInterval = 50;
+
 	explicit StandardServiceBackend(bool debugMode, QtService::Service *service);
 
 	int runService(int &argc, char **argv, int flags) override;
 	void quitService() override;
 	void reloadService() override;
+	QList<int> getActivatedSockets(const QByteArray &name) override;
+	bool storeActivatedSocket(const QByteArray &name, int socket) override;
+	bool removeStoredSockets(const QByteArray &name) override;
+	void reportProgress(const QString &status, int extendTimeoutMsecs) override;
 
 protected Q_SLOTS:
 	void signalTriggered(int signal) override;
@@ -23,9 +36,39 @@ protected Q_SLOTS:
 private Q_SLOTS:
 	void onStarted(bool success);
 	void onPaused(bool success);
+	void onUpgradeReply();
+	void takeOverLock();
+	void onHandoverTimeout();
 
 private:
 	const bool _debugMode;
+	int _flightRecorderSize = 0;
+	StandardFlightRecorder _flightRecorder;
+	QLockFile *_lock = nullptr;
+	QTimer *_lockTimer = nullptr;
+	QString _readyPath;
+	QString _progressPath;
+	quint64 _progressCount = 0;
+	QString _executable;
+	QByteArrayList _arguments;
+
+	// inherited and stored sockets, which are passed on to the new instance on a hot upgrade
+	QList<QPair<QByteArray, int>> _sockets;
+	int _handoverFd = -1;
+	QLocalSocket *_handoverSocket = nullptr;
+	qint64 _upgradePid = 0;
+	QLocalSocket *_upgradeSocket = nullptr;
+
+	static QtMessageHandler _previousHandler;
+	static StandardFlightRecorder *_activeRecorder;
+
+	void readInheritedSockets();
+	void startUpgrade();
+	void finishUpgrade();
+	void finishHandover();
+	void removeOwnedFile(const QString &path);
+	void startFlightRecorder();
+	static void recordMessage(QtMsgType type, const QMessageLogContext &context, const QString &message);
 };
 
 Q_DECLARE_LOGGING_CATEGORY(logBackend)
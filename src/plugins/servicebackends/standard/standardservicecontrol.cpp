@@ -1,7 +1,12 @@
 #include "standardservicecontrol.h"
 #include "standardserviceplugin.h"
+#include "standardflightrecorder.h"
+#ifdef Q_OS_UNIX
+#include "standardprocesslauncher.h"
+#endif
 #include <QtCore/QStandardPaths>
 #include <QtCore/QScopeGuard>
+#include <QtCore/QDeadlineTimer>
 #if QT_CONFIG(process)
 #include <QtCore/QProcess>
 #endif
@@ -10,17 +15,78 @@
 #include <qt_windows.h>
 #else
 #include <csignal>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <QtCore/QThread>
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#endif
 #endif
 using namespace QtService;
 
 Q_LOGGING_CATEGORY(logControl, "qt.service.plugin.standard.control")
 
+#ifdef Q_OS_UNIX
+namespace {
+
+int pollTimeout(const QDeadlineTimer &deadline, int maxMsecs = -1)
+{
+	auto remaining = deadline.remainingTime();
+	if (remaining < 0 || remaining > std::numeric_limits<int>::max())
+		remaining = std::numeric_limits<int>::max();
+	if (maxMsecs >= 0 && remaining > maxMsecs)
+		remaining = maxMsecs;
+	return static_cast<int>(remaining);
+}
+
+// returns a descriptor that becomes readable once the process exited, or -1 if not supported
+int openProcessFd(pid_t pid)
+{
+#if defined(Q_OS_LINUX) && defined(SYS_pidfd_open)
+	return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+	Q_UNUSED(pid)
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+bool isProcessAlive(pid_t pid)
+{
+	return ::kill(pid, 0) == 0 || errno == EPERM;
+}
+
+// waits until the process exited or the deadline expired - returns whether the process is gone
+bool waitForExit(pid_t pid, int pidFd, const QDeadlineTimer &deadline)
+{
+	if (pidFd != -1) {
+		pollfd pfd {pidFd, POLLIN, 0};
+		int res;
+		do {
+			res = ::poll(&pfd, 1, pollTimeout(deadline));
+		} while (res == -1 && errno == EINTR);
+		return res > 0;
+	}
+
+	// without pidfd support, fall back to polling the process
+	while (isProcessAlive(pid)) {
+		if (deadline.hasExpired())
+			return false;
+		QThread::msleep(static_cast<unsigned long>(pollTimeout(deadline, 10)));
+	}
+	return true;
+}
+
+}
+#endif
+
 StandardServiceControl::StandardServiceControl(bool debugMode, QString &&serviceId, QObject *parent) :
 	ServiceControl{std::move(serviceId), parent},
 	_debugMode{debugMode}
-{
-	qCDebug(logControl) << "Using lock file path:" << runtimeDir().absoluteFilePath(QStringLiteral("qstandard.lock"));
-}
+{}
 
 QString StandardServiceControl::backend() const
 {
@@ -32,6 +98,9 @@ ServiceControl::SupportFlags StandardServiceControl::supportFlags() const
 	auto flags = SupportFlag::Status | SupportFlag::Stop;
 #if QT_CONFIG(process)
 	flags |= SupportFlag::Start;
+#endif
+#ifdef Q_OS_UNIX
+	flags |= SupportFlag::SetBlocking;
 #endif
 	return flags;
 }
@@ -43,16 +112,7 @@ bool StandardServiceControl::serviceExists() const
 
 ServiceControl::Status StandardServiceControl::status() const
 {
-	const auto lock = statusLock();
-	if (lock->tryLock()) {
-		lock->unlock();
-		return Status::Stopped;
-	} else if(lock->error() == QLockFile::LockFailedError)
-		return Status::Running;
-	else {
-		setError(tr("Failed to access lockfile with error: %1").arg(lock->error()));
-		return Status::Unknown;
-	}
+	return probeLock();
 }
 
 ServiceControl::BlockMode StandardServiceControl::blocking() const
@@ -60,19 +120,44 @@ ServiceControl::BlockMode StandardServiceControl::blocking() const
 #ifdef Q_OS_WIN
 	return BlockMode::Undetermined;
 #else
-	return BlockMode::NonBlocking;
+	return _blocking ? BlockMode::Blocking : BlockMode::NonBlocking;
 #endif
 }
 
+int StandardServiceControl::blockingTimeout() const
+{
+	return _blockingTimeout;
+}
+
+bool StandardServiceControl::killOnTimeout() const
+{
+	return _killOnTimeout;
+}
+
+QVariantMap StandardServiceControl::listenSockets() const
+{
+	return _listenSockets;
+}
+
 QVariant StandardServiceControl::callGenericCommand(const QByteArray &kind, const QVariantList &args)
 {
-	Q_UNUSED(args)
 	if (kind == "getPid")
 		return getPid();
+	else if (kind == "readFlightRecorder")
+		return readFlightRecorder();
+	else if (kind == "upgrade")
+		return upgrade();
+	else if (kind == "setLoggingRules" || kind == "invokeCallback")
+		return ServiceControl::callGenericCommand(kind, args);
 	else
 		return {};
 }
 
+int StandardServiceControl::flightRecorderSize() const
+{
+	return _flightRecorderSize;
+}
+
 bool StandardServiceControl::start()
 {
 #if QT_CONFIG(process)
@@ -87,16 +172,23 @@ bool StandardServiceControl::start()
 		return false;
 	}
 
+	QStringList arguments {QStringLiteral("--backend"), backend()};
+	if (_flightRecorderSize > 0)
+		arguments << QStringLiteral("--flight-recorder") << QString::number(_flightRecorderSize);
 	const auto prepareProc = [&](QProcess *svcProc){
 		svcProc->setProgram(bin);
-		svcProc->setArguments({QStringLiteral("--backend"), backend()});
+		svcProc->setArguments(arguments);
 		svcProc->setWorkingDirectory(QDir::rootPath());
 	};
 
 	auto ok = false;
 	qint64 pid = 0;
 	QString errorString;
-	if (_debugMode) {
+	if (!_listenSockets.isEmpty()) {
+		if (!startWithSockets(bin, arguments, pid))
+			return false;
+		ok = true;
+	} else if (_debugMode) {
 		auto svcProc = new QProcess{nullptr};  // detached instance
 		connect(svcProc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
 				svcProc, &QProcess::deleteLater);
@@ -129,6 +221,10 @@ bool StandardServiceControl::start()
 	if(ok) {
 		qCDebug(logControl) << "Started service process with PID" << pid
 							<< (_debugMode ? "in debug mode" : "");
+#ifdef Q_OS_UNIX
+		if (_blocking)
+			ok = waitForStarted(pid);
+#endif
 	} else
 		setError(tr("Failed to start service process with error: %1").arg(errorString));
 	return ok;
@@ -183,32 +279,411 @@ bool StandardServiceControl::stop()
 		setError(tr("Failed to attach to service console with error: %1").arg(qt_error_string(GetLastError())));
 	return ok;
 #else
-	return kill(static_cast<pid_t>(pid), SIGTERM) == 0;
+	const auto svcPid = static_cast<pid_t>(pid);
+	// open the descriptor before signaling, so the exit cannot be missed
+	const auto pidFd = _blocking ? openProcessFd(svcPid) : -1;
+	const auto _sg0 = qScopeGuard([pidFd]() {
+		if (pidFd != -1)
+			::close(pidFd);
+	});
+	// progress reported before stopping, for example while reloading, must not move the deadline
+	quint64 progressCount = 0;
+	if (_blocking)
+		readProgress(pid, progressCount, nullptr);
+	if (::kill(svcPid, SIGTERM) != 0)
+		return false;
+	if (!_blocking)
+		return true;
+
+	// the service can ask for more time while stopping, which is checked between short waits
+	QDeadlineTimer deadline{_blockingTimeout};
+	for (;;) {
+		if (waitForExit(svcPid, pidFd, std::min(deadline, QDeadlineTimer{100})))
+			return true;
+		readProgress(pid, progressCount, &deadline);
+		if (deadline.hasExpired())
+			break;
+	}
+	if (!_killOnTimeout) {
+		setError(tr("Service did not stop within %1 ms").arg(_blockingTimeout));
+		return false;
+	}
+
+	qCWarning(logControl) << "Service with PID" << pid << "did not stop within"
+						  << _blockingTimeout << "ms - killing it";
+	if (::kill(svcPid, SIGKILL) == 0 &&
+		waitForExit(svcPid, pidFd, QDeadlineTimer{_blockingTimeout}))
+		return true;
+	setError(tr("Failed to kill service with PID %1").arg(pid));
+	return false;
+#endif
+}
+
+bool StandardServiceControl::setBlocking(bool blocking)
+{
+#ifdef Q_OS_UNIX
+	if (_blocking == blocking)
+		return true;
+
+	_blocking = blocking;
+	emit blockingChanged(this->blocking());
+	return true;
+#else
+	return ServiceControl::setBlocking(blocking);
 #endif
 }
 
+void StandardServiceControl::setFlightRecorderSize(int flightRecorderSize)
+{
+	if (_flightRecorderSize == flightRecorderSize)
+		return;
+
+	_flightRecorderSize = flightRecorderSize;
+	emit flightRecorderSizeChanged(_flightRecorderSize);
+}
+
+void StandardServiceControl::setBlockingTimeout(int blockingTimeout)
+{
+	if (_blockingTimeout == blockingTimeout)
+		return;
+
+	_blockingTimeout = blockingTimeout;
+	emit blockingTimeoutChanged(_blockingTimeout);
+}
+
+void StandardServiceControl::setKillOnTimeout(bool killOnTimeout)
+{
+	if (_killOnTimeout == killOnTimeout)
+		return;
+
+	_killOnTimeout = killOnTimeout;
+	emit killOnTimeoutChanged(_killOnTimeout);
+}
+
+void StandardServiceControl::setListenSockets(const QVariantMap &listenSockets)
+{
+	if (_listenSockets == listenSockets)
+		return;
+
+	_listenSockets = listenSockets;
+	emit listenSocketsChanged(_listenSockets);
+}
+
 QString StandardServiceControl::serviceName() const
 {
-	QFileInfo info{serviceId()};
+	return nameOf(serviceId());
+}
+
+QHash<QString, ServiceControl::Status> StandardServiceControl::batchStatus(const QStringList &serviceIds) const
+{
+	// all services share the same runtime root, so a single sweep over their lock files is enough.
+	// Creating a control for each one would also create the runtime dirs of services that never ran
+	auto runRoot = runtimeDir();
+	runRoot.cdUp();
+	QHash<QString, Status> result;
+	result.reserve(serviceIds.size());
+	for (const auto &serviceId : serviceIds) {
+		const auto serviceLock = runRoot.absoluteFilePath(nameOf(serviceId) + QStringLiteral("/qstandard.lock"));
+		result.insert(serviceId, probeLockFile(serviceLock));
+	}
+	return result;
+}
+
+bool StandardServiceControl::startStatusWatcher()
+{
+	if (!_lockWatcher) {
+		_lockWatcher = new QFileSystemWatcher{this};
+		connect(_lockWatcher, &QFileSystemWatcher::directoryChanged,
+				this, &StandardServiceControl::checkWatchedStatus);
+	}
+
+	// the service creates and removes its lock file in the runtime dir on start and stop
+	const auto dirPath = runtimeDir().absolutePath();
+	if (!_lockWatcher->addPath(dirPath)) {
+		qCWarning(logControl) << "Unable to watch runtime directory" << dirPath
+							  << "- falling back to polling";
+		return ServiceControl::startStatusWatcher();
+	}
+	return true;
+}
+
+void StandardServiceControl::stopStatusWatcher()
+{
+	if (_lockWatcher && !_lockWatcher->directories().isEmpty())
+		_lockWatcher->removePaths(_lockWatcher->directories());
+	else
+		ServiceControl::stopStatusWatcher();
+}
+
+QString StandardServiceControl::nameOf(const QString &serviceId)
+{
+	QFileInfo info{serviceId};
 	if (info.isExecutable())
-		return QFileInfo{serviceId()}.completeBaseName();
+		return info.completeBaseName();
 	else
-        return serviceId().split(QLatin1Char('/'), Qt::SkipEmptyParts).last();
+        return serviceId.split(QLatin1Char('/'), Qt::SkipEmptyParts).last();
+}
+
+QString StandardServiceControl::lockPath() const
+{
+	return runtimeDir().absoluteFilePath(QStringLiteral("qstandard.lock"));
+}
+
+QString StandardServiceControl::readyPath() const
+{
+	return runtimeDir().absoluteFilePath(QStringLiteral("qstandard.ready"));
 }
 
-QSharedPointer<QLockFile> StandardServiceControl::statusLock() const
+QString StandardServiceControl::progressPath() const
 {
-	const auto lock = QSharedPointer<QLockFile>::create(runtimeDir().absoluteFilePath(QStringLiteral("qstandard.lock")));
-	lock->setStaleLockTime(std::numeric_limits<int>::max());  // disable stale locks
-	return lock;
+	return runtimeDir().absoluteFilePath(QStringLiteral("qstandard.progress"));
+}
+
+ServiceControl::Status StandardServiceControl::probeLock(qint64 *pid) const
+{
+	return probeLockFile(lockPath(), pid);
+}
+
+ServiceControl::Status StandardServiceControl::probeLockFile(const QString &lockPath, qint64 *pid) const
+{
+	// only reads the lock file written by QLockFile in the service, whose first line is the PID.
+	// Taking the lock instead would create and remove the file whenever the service is stopped
+	qint64 lockPid = 0;
+#ifdef Q_OS_WIN
+	QFile lockFile{lockPath};
+	if (!lockFile.open(QIODevice::ReadOnly)) {
+		if (!lockFile.exists())
+			return Status::Stopped;
+		setError(tr("Failed to access lockfile with error: %1").arg(lockFile.errorString()));
+		return Status::Unknown;
+	}
+	lockPid = lockFile.readLine(32).trimmed().toLongLong();
+#else
+	const auto fd = ::open(QFile::encodeName(lockPath).constData(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		if (errno != ENOENT) {
+			setError(tr("Failed to access lockfile with error: %1").arg(qt_error_string(errno)));
+			return Status::Unknown;
+		}
+
+		// during a hot upgrade, the previous instance releases the lock before the new one takes it over.
+		// The new instance has written its ready file by then, while a stopping one removes it beforehand
+		QFile readyFile{QFileInfo{lockPath}.dir().absoluteFilePath(QStringLiteral("qstandard.ready"))};
+		if (!readyFile.open(QIODevice::ReadOnly))
+			return Status::Stopped;
+		const auto readyPid = readyFile.readLine(32).trimmed().toLongLong();
+		if (readyPid <= 0 || !isProcessAlive(static_cast<pid_t>(readyPid)))
+			return Status::Stopped;
+		if (pid)
+			*pid = readyPid;
+		return Status::Running;
+	}
+	char buffer[32];
+	const auto size = ::read(fd, buffer, sizeof(buffer) - 1);
+	::close(fd);
+	if (size > 0) {
+		buffer[size] = '\0';
+		lockPid = std::strtoll(buffer, nullptr, 10);
+	}
+#endif
+
+	// the service has created the file, but not written it yet
+	if (lockPid <= 0)
+		return Status::Running;
+
+	auto alive = false;
+#ifdef Q_OS_WIN
+	const auto process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(lockPid));
+	if (process) {
+		alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+		CloseHandle(process);
+	} else
+		alive = GetLastError() == ERROR_ACCESS_DENIED;
+#else
+	alive = ::kill(static_cast<pid_t>(lockPid), 0) == 0 || errno == EPERM;
+#endif
+	// a lock of a process that died is stale, which QLockFile in the service will take over
+	if (!alive)
+		return Status::Stopped;
+
+	if (pid)
+		*pid = lockPid;
+	return Status::Running;
 }
 
 qint64 StandardServiceControl::getPid()
 {
-	qint64 pid = 0;
-	QString _h, _a;
-	if (statusLock()->getLockInfo(&pid, &_h, &_a))
-		return pid;
-	else
-		return -1;
+	qint64 pid = -1;
+	probeLock(&pid);
+	return pid;
+}
+
+bool StandardServiceControl::startWithSockets(const QString &bin, const QStringList &arguments, qint64 &pid)
+{
+#ifdef Q_OS_UNIX
+	// the sockets are bound before the service runs, so clients can connect while it is still starting
+	QVector<int> sockets;
+	const auto _sg0 = qScopeGuard([&]() {
+		for (const auto fd : qAsConst(sockets))
+			::close(fd);
+	});
+	QByteArrayList rawArguments;
+	for (const auto &arg : arguments)
+		rawArguments.append(arg.toLocal8Bit());
+	StandardProcessLauncher launcher{bin, rawArguments};
+	for (auto it = _listenSockets.constBegin(); it != _listenSockets.constEnd(); ++it) {
+		if (it.key().contains(QLatin1Char(':'))) {
+			setError(tr("Invalid socket name \"%1\"").arg(it.key()));
+			return false;
+		}
+
+		// like multiple ListenStream= entries, a list binds several sockets with the same name
+		for (const auto &address : it.value().toStringList()) {
+			QString error;
+			const auto fd = StandardProcessLauncher::openListenSocket(address, &error);
+			if (fd == -1) {
+				setError(tr("Failed to listen on %1 for socket \"%2\" with error: %3").arg(address, it.key(), error));
+				return false;
+			}
+			sockets.append(fd);
+			launcher.addSocket(it.key().toUtf8(), fd);
+		}
+	}
+
+	launcher.setWorkingDirectory(QDir::rootPath());
+	launcher.setDetached(true, _debugMode);
+	qCDebug(logControl) << "Launching service detached as" << bin << arguments
+						<< "with sockets" << _listenSockets;
+	if (!launcher.start()) {
+		setError(tr("Failed to start service process with error: %1").arg(launcher.errorString()));
+		return false;
+	}
+	pid = launcher.processId();
+	return true;
+#else
+	Q_UNUSED(bin)
+	Q_UNUSED(arguments)
+	Q_UNUSED(pid)
+	setError(tr("Passing sockets to the service is only supported on unix systems"));
+	return false;
+#endif
+}
+
+bool StandardServiceControl::waitForStarted(qint64 pid)
+{
+#ifdef Q_OS_UNIX
+	const auto svcPid = static_cast<pid_t>(pid);
+	const auto pidFd = openProcessFd(svcPid);
+	const auto _sg0 = qScopeGuard([pidFd]() {
+		if (pidFd != -1)
+			::close(pidFd);
+	});
+
+	// the backend writes its PID to the ready file once the service has completed its start
+	QDeadlineTimer deadline{_blockingTimeout};
+	quint64 progressCount = 0;
+	QFile readyFile{readyPath()};
+	for (;;) {
+		if (readyFile.open(QIODevice::ReadOnly)) {
+			const auto readyPid = readyFile.readLine(32).trimmed().toLongLong();
+			readyFile.close();
+			if (readyPid == pid)
+				return true;
+		}
+
+		if (waitForExit(svcPid, pidFd, std::min(deadline, QDeadlineTimer{10}))) {
+			setError(tr("Service process exited before it completed its start"));
+			return false;
+		}
+		readProgress(pid, progressCount, &deadline);
+		if (deadline.hasExpired()) {
+			setError(tr("Service did not start within %1 ms").arg(_blockingTimeout));
+			return false;
+		}
+	}
+#else
+	Q_UNUSED(pid)
+	return true;
+#endif
+}
+
+bool StandardServiceControl::upgrade()
+{
+#ifdef Q_OS_UNIX
+	const auto pid = getPid();
+	if (pid == -1) {
+		setError(tr("Failed to get pid of running service"));
+		return false;
+	}
+
+	if (::kill(static_cast<pid_t>(pid), SIGWINCH) != 0) {
+		setError(tr("Failed to send upgrade signal with error: %1").arg(qt_error_string(errno)));
+		return false;
+	}
+	if (!_blocking)
+		return true;
+
+	// the new instance takes over the lock once the old one has stopped
+	const QDeadlineTimer deadline{_blockingTimeout};
+	for (;;) {
+		qint64 newPid = -1;
+		if (probeLock(&newPid) == Status::Running && newPid != -1 && newPid != pid)
+			return true;
+		if (deadline.hasExpired()) {
+			setError(tr("Service was not upgraded within %1 ms").arg(_blockingTimeout));
+			return false;
+		}
+		QThread::msleep(static_cast<unsigned long>(pollTimeout(deadline, 10)));
+	}
+#else
+	setError(tr("Hot upgrades are only supported on unix systems"));
+	return false;
+#endif
+}
+
+void StandardServiceControl::readProgress(qint64 pid, quint64 &progressCount, QDeadlineTimer *deadline)
+{
+	// the file is replaced atomically, so it is either complete or missing
+	QFile progressFile{progressPath()};
+	if (!progressFile.open(QIODevice::ReadOnly | QIODevice::Text))
+		return;
+	if (progressFile.readLine(32).trimmed().toLongLong() != pid)
+		return;
+	const auto count = progressFile.readLine(32).trimmed().toULongLong();
+	if (count <= progressCount)
+		return;
+
+	progressCount = count;
+	if (!deadline)
+		return;
+	const auto extendMsecs = progressFile.readLine(32).trimmed().toLongLong();
+	const auto status = QString::fromUtf8(progressFile.readLine().trimmed());
+	qCInfo(logControl).noquote() << "Service reported progress:" << status;
+	// same as systemd, the new deadline only counts if it ends later than the current one
+	if (extendMsecs > 0) {
+		const QDeadlineTimer extended{extendMsecs};
+		if (*deadline < extended)
+			*deadline = extended;
+	}
+}
+
+QStringList StandardServiceControl::readFlightRecorder()
+{
+	QString error;
+	const auto entries = StandardFlightRecorder::read(runtimeDir().absoluteFilePath(StandardFlightRecorder::FileName), &error);
+	if (!error.isEmpty()) {
+		setError(tr("Failed to read flight recorder with error: %1").arg(error));
+		return {};
+	}
+
+	QStringList lines;
+	lines.reserve(entries.size());
+	for (const auto &entry : entries)
+		lines.append(entry.toString());
+	return lines;
+}
+
+void StandardServiceControl::checkWatchedStatus()
+{
+	reportStatus(status());
 }
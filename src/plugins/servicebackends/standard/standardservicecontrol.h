@@ -1,8 +1,9 @@
 #ifndef STANDARDSERVICECONTROL_H
 #define STANDARDSERVICECONTROL_H
 
-#include <QtCore/QLockFile>
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QDeadlineTimer>
 
 #include <QtService/ServiceControl>
 
@@ -10,6 +11,11 @@ class StandardServiceControl : public QtService::ServiceControl
 {
 	Q_OBJECT
 
+	Q_PROPERTY(int flightRecorderSize READ flightRecorderSize WRITE setFlightRecorderSize NOTIFY flightRecorderSizeChanged)
+	Q_PROPERTY(int blockingTimeout READ blockingTimeout WRITE setBlockingTimeout NOTIFY blockingTimeoutChanged)
+	Q_PROPERTY(bool killOnTimeout READ killOnTimeout WRITE setKillOnTimeout NOTIFY killOnTimeoutChanged)
+	Q_PROPERTY(QVariantMap listenSockets READ listenSockets WRITE setListenSockets NOTIFY listenSocketsChanged)
+
 public:
 	explicit StandardServiceControl(bool debugMode, QString &&serviceId, QObject *parent = nullptr);
 
@@ -18,21 +24,59 @@ public:
 	bool serviceExists() const override;
 	Status status() const override;
 	BlockMode blocking() const override;
+	int flightRecorderSize() const;
+	int blockingTimeout() const;
+	bool killOnTimeout() const;
+	QVariantMap listenSockets() const;
 
 	QVariant callGenericCommand(const QByteArray &kind, const QVariantList &args) override;
 
 public Q_SLOTS:
 	bool start() override;
 	bool stop() override;
+	bool setBlocking(bool blocking) override;
+	void setFlightRecorderSize(int flightRecorderSize);
+	void setBlockingTimeout(int blockingTimeout);
+	void setKillOnTimeout(bool killOnTimeout);
+	void setListenSockets(const QVariantMap &listenSockets);
+
+Q_SIGNALS:
+	void flightRecorderSizeChanged(int flightRecorderSize);
+	void blockingTimeoutChanged(int blockingTimeout);
+	void killOnTimeoutChanged(bool killOnTimeout);
+	void listenSocketsChanged(const QVariantMap &listenSockets);
 
 protected:
 	QString serviceName() const override;
+	QHash<QString, Status> batchStatus(const QStringList &serviceIds) const override;
+	bool startStatusWatcher() override;
+	void stopStatusWatcher() override;
 
 private:
 	const bool _debugMode;
+	QFileSystemWatcher *_lockWatcher = nullptr;
+	int _flightRecorderSize = 0;
+	bool _blocking = false;
+	int _blockingTimeout = 30000;
+	bool _killOnTimeout = false;
+	QVariantMap _listenSockets;
+
+	static QString nameOf(const QString &serviceId);
+
+	// resolved on each use, as the service name can still be changed after construction
+	QString lockPath() const;
+	QString readyPath() const;
+	QString progressPath() const;
 
-	QSharedPointer<QLockFile> statusLock() const;
+	Status probeLock(qint64 *pid = nullptr) const;
+	Status probeLockFile(const QString &lockPath, qint64 *pid = nullptr) const;
 	qint64 getPid();
+	bool startWithSockets(const QString &bin, const QStringList &arguments, qint64 &pid);
+	bool waitForStarted(qint64 pid);
+	void readProgress(qint64 pid, quint64 &progressCount, QDeadlineTimer *deadline);
+	bool upgrade();
+	QStringList readFlightRecorder();
+	void checkWatchedStatus();
 };
 
 Q_DECLARE_LOGGING_CATEGORY(logControl)
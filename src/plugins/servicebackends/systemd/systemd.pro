@@ -9,12 +9,14 @@ PKGCONFIG += libsystemd
 HEADERS += \
 	systemdserviceplugin.h \
 	systemdservicebackend.h \
-	systemdservicecontrol.h
+	systemdservicecontrol.h \
+	systemdjournalsink.h
 
 SOURCES += \
 	systemdserviceplugin.cpp \
 	systemdservicebackend.cpp \
-	systemdservicecontrol.cpp
+	systemdservicecontrol.cpp \
+	systemdjournalsink.cpp
 
 DBUS_INTERFACES += de.skycoder42.QtService.ServicePlugin.systemd.xml
 DBUS_ADAPTORS += $$DBUS_INTERFACES
@@ -0,0 +1,249 @@
+#include "systemdjournalsink.h"
+
+#include <QtCore/QDeadlineTimer>
+
+#include <sys/uio.h>
+
+#define SD_JOURNAL_SUPPRESS_LOCATION
+#include <systemd/sd-journal.h>
+
+namespace {
+
+// the priority fields never change, so they are not formatted per message
+const char * const PriorityFields[] = {
+	"PRIORITY=0",
+	"PRIORITY=1",
+	"PRIORITY=2",
+	"PRIORITY=3",
+	"PRIORITY=4",
+	"PRIORITY=5",
+	"PRIORITY=6",
+	"PRIORITY=7"
+};
+
+inline void setField(QByteArray &field, const char *name, int nameSize, const char *value)
+{
+	field.resize(0);  // keeps the reserved capacity
+	field.append(name, nameSize);
+	field.append(value ? value : "unknown");
+}
+
+inline iovec toIovec(const QByteArray &field)
+{
+	return {const_cast<char*>(field.constData()), static_cast<size_t>(field.size())};
+}
+
+}
+
+std::atomic<SystemdJournalSink*> SystemdJournalSink::_instance{nullptr};
+
+SystemdJournalSink::SystemdJournalSink(QObject *parent) :
+	QThread{parent},
+	_cells{new Cell[QueueSize]}
+{
+	static_assert((QueueSize & (QueueSize - 1)) == 0, "QueueSize must be a power of 2");
+	setObjectName(QStringLiteral("QtService journal"));
+	for (quint64 i = 0; i < QueueSize; ++i)
+		_cells[i].sequence.store(i, std::memory_order_relaxed);
+	_instance.store(this, std::memory_order_release);
+}
+
+SystemdJournalSink::~SystemdJournalSink()
+{
+	// messages logged from now on are written synchronously, the remaining ones are drained
+	_instance.store(nullptr, std::memory_order_release);
+	_stopping.store(true);
+	{
+		QMutexLocker lock{&_mutex};
+		_wakeCondition.wakeAll();
+	}
+	wait();
+}
+
+SystemdJournalSink *SystemdJournalSink::instance()
+{
+	return _instance.load(std::memory_order_acquire);
+}
+
+bool SystemdJournalSink::post(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+	auto pos = _enqueuePos.load(std::memory_order_relaxed);
+	Cell *cell;
+	for (;;) {
+		cell = &_cells[pos & (QueueSize - 1)];
+		const auto seq = cell->sequence.load(std::memory_order_acquire);
+		const auto diff = static_cast<qint64>(seq) - static_cast<qint64>(pos);
+		if (diff == 0) {
+			if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		} else
+			pos = _enqueuePos.load(std::memory_order_relaxed);
+	}
+
+	// formatting must happen here, as the pattern may contain thread or time information
+	cell->entry.priority = priorityOf(type);
+	cell->entry.message = qFormatLogMessage(type, context, message);
+	cell->entry.file = context.file;
+	cell->entry.function = context.function;
+	cell->entry.category = context.category;
+	cell->entry.line = context.line;
+	cell->sequence.store(pos + 1, std::memory_order_release);
+
+	wake();
+	return true;
+}
+
+bool SystemdJournalSink::flush(int msecs)
+{
+	const auto target = _enqueuePos.load();
+	QDeadlineTimer deadline{msecs};
+	QMutexLocker lock{&_mutex};
+	_wakeCondition.wakeAll();
+	while (_written.load() < target) {
+		if (!_flushCondition.wait(&_mutex, deadline))
+			break;
+	}
+	return _written.load() >= target;
+}
+
+quint64 SystemdJournalSink::droppedMessages() const
+{
+	return _dropped.load(std::memory_order_relaxed);
+}
+
+void SystemdJournalSink::send(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+	Fields fields;
+	write({
+			  priorityOf(type),
+			  qFormatLogMessage(type, context, message),
+			  context.file,
+			  context.function,
+			  context.category,
+			  context.line
+		  }, fields);
+}
+
+void SystemdJournalSink::run()
+{
+	Fields fields;
+	Entry entry;
+	quint64 reportedDrops = 0;
+	for (;;) {
+		auto wroteAny = false;
+		while (dequeue(entry)) {
+			write(entry, fields);
+			_written.fetch_add(1);
+			wroteAny = true;
+		}
+		if (wroteAny) {
+			QMutexLocker lock{&_mutex};
+			_flushCondition.wakeAll();
+		}
+
+		const auto dropped = _dropped.load(std::memory_order_relaxed);
+		if (dropped != reportedDrops) {
+			writeDropped(dropped - reportedDrops);
+			reportedDrops = dropped;
+		}
+
+		QMutexLocker lock{&_mutex};
+		if (_dequeuePos.load() == _enqueuePos.load()) {
+			if (_stopping.load())
+				break;
+			// the timeout guards against wakeups lost between checking and setting the flag
+			_sleeping.store(true);
+			_wakeCondition.wait(&_mutex, 100);
+			_sleeping.store(false);
+		}
+	}
+}
+
+bool SystemdJournalSink::dequeue(Entry &entry)
+{
+	auto pos = _dequeuePos.load(std::memory_order_relaxed);
+	Cell *cell;
+	for (;;) {
+		cell = &_cells[pos & (QueueSize - 1)];
+		const auto seq = cell->sequence.load(std::memory_order_acquire);
+		const auto diff = static_cast<qint64>(seq) - static_cast<qint64>(pos + 1);
+		if (diff == 0) {
+			if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0)
+			return false;
+		else
+			pos = _dequeuePos.load(std::memory_order_relaxed);
+	}
+
+	entry = std::move(cell->entry);
+	cell->sequence.store(pos + QueueSize, std::memory_order_release);
+	return true;
+}
+
+void SystemdJournalSink::wake()
+{
+	if (_sleeping.load()) {
+		QMutexLocker lock{&_mutex};
+		_wakeCondition.wakeOne();
+	}
+}
+
+int SystemdJournalSink::priorityOf(QtMsgType type)
+{
+	switch (type) {
+	case QtDebugMsg:
+		return LOG_DEBUG;
+	case QtInfoMsg:
+		return LOG_INFO;
+	case QtWarningMsg:
+		return LOG_WARNING;
+	case QtCriticalMsg:
+		return LOG_CRIT;
+	case QtFatalMsg:
+		return LOG_ALERT;
+	default:
+		Q_UNREACHABLE();
+		return LOG_NOTICE;
+	}
+}
+
+void SystemdJournalSink::write(const Entry &entry, Fields &fields)
+{
+	fields.message.resize(0);
+	fields.message.append("MESSAGE=", 8);
+	fields.message.append(entry.message.toUtf8());
+	setField(fields.codeFunc, "CODE_FUNC=", 10, entry.function.isNull() ? nullptr : entry.function.constData());
+	setField(fields.codeFile, "CODE_FILE=", 10, entry.file.isNull() ? nullptr : entry.file.constData());
+	setField(fields.category, "QT_CATEGORY=", 12, entry.category.isNull() ? nullptr : entry.category.constData());
+	char codeLine[32];
+	const auto codeLineSize = qsnprintf(codeLine, sizeof(codeLine), "CODE_LINE=%d", entry.line);
+
+	const iovec fieldVec[] = {
+		toIovec(fields.message),
+		{const_cast<char*>(PriorityFields[entry.priority]), 10},
+		toIovec(fields.codeFunc),
+		{codeLine, static_cast<size_t>(codeLineSize)},
+		toIovec(fields.codeFile),
+		toIovec(fields.category)
+	};
+	sd_journal_sendv(fieldVec, static_cast<int>(sizeof(fieldVec) / sizeof(iovec)));
+}
+
+void SystemdJournalSink::writeDropped(quint64 count)
+{
+	sd_journal_send("MESSAGE=Journal queue overflowed - dropped %llu log messages", static_cast<unsigned long long>(count),
+					"PRIORITY=%i", LOG_WARNING,
+					nullptr);
+}
+
+SystemdJournalSink::Fields::Fields()
+{
+	message.reserve(256);
+	codeFunc.reserve(128);
+	codeFile.reserve(128);
+	category.reserve(64);
+}
@@ -0,0 +1,85 @@
+#ifndef SYSTEMDJOURNALSINK_H
+#define SYSTEMDJOURNALSINK_H
+
+#include <atomic>
+#include <memory>
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+
+// Writes log messages to the journal from a background thread
+class SystemdJournalSink : public QThread
+{
+	Q_OBJECT
+
+public:
+	static constexpr int QueueSize = 4096;  // must be a power of 2
+
+	explicit SystemdJournalSink(QObject *parent = nullptr);
+	~SystemdJournalSink() override;
+
+	static SystemdJournalSink *instance();
+
+	// thread safe, never blocks - returns false if the queue is full and the message was dropped
+	bool post(QtMsgType type, const QMessageLogContext &context, const QString &message);
+	// blocks until all messages posted so far have been written, or the timeout expired
+	bool flush(int msecs = 1000);
+	quint64 droppedMessages() const;
+
+	// writes a message synchronously on the calling thread
+	static void send(QtMsgType type, const QMessageLogContext &context, const QString &message);
+
+protected:
+	void run() override;
+
+private:
+	struct Entry {
+		int priority = 0;
+		QString message;
+		// copied, as the context only lives as long as the logging call, e.g. for QML console messages
+		QByteArray file;
+		QByteArray function;
+		QByteArray category;
+		int line = 0;
+	};
+
+	// one reusable buffer per variable field, so writing does not allocate once they grew large enough
+	struct Fields {
+		Fields();
+
+		QByteArray message;
+		QByteArray codeFunc;
+		QByteArray codeFile;
+		QByteArray category;
+	};
+
+	// bounded lock free multi producer queue, as described by Dmitry Vyukov
+	struct Cell {
+		std::atomic<quint64> sequence;
+		Entry entry;
+	};
+
+	static std::atomic<SystemdJournalSink*> _instance;
+
+	std::unique_ptr<Cell[]> _cells;
+	alignas(64) std::atomic<quint64> _enqueuePos{0};
+	alignas(64) std::atomic<quint64> _dequeuePos{0};
+	std::atomic<quint64> _dropped{0};
+	std::atomic<quint64> _written{0};
+	std::atomic<bool> _sleeping{false};
+	std::atomic<bool> _stopping{false};
+
+	QMutex _mutex;
+	QWaitCondition _wakeCondition;
+	QWaitCondition _flushCondition;
+
+	bool dequeue(Entry &entry);
+	void wake();
+
+	static int priorityOf(QtMsgType type);
+	static void write(const Entry &entry, Fields &fields);
+	static void writeDropped(quint64 count);
+};
+
+#endif // SYSTEMDJOURNALSINK_H
@@ -1,10 +1,14 @@
 #include "systemdservicebackend.h"
 #include "systemdserviceplugin.h"
+#include "systemdjournalsink.h"
 
 #include <QtCore/QCommandLineParser>
+#include <QtService/ServiceMetrics>
 
+#include <algorithm>
 #include <chrono>
 #include <csignal>
+#include <ctime>
 #include <unistd.h>
 
 #define SD_JOURNAL_SUPPRESS_LOCATION
@@ -16,6 +20,20 @@ using namespace QtService;
 
 Q_LOGGING_CATEGORY(logBackend, "qt.service.plugin.systemd.backend")
 
+namespace {
+
+// systemd only accepts names that could be used in LISTEN_FDNAMES
+bool isValidFdName(const QByteArray &name)
+{
+	if (name.isEmpty() || name.size() > 255)
+		return false;
+	return std::all_of(name.begin(), name.end(), [](char c) {
+		return c >= ' ' && c < 127 && c != ':';
+	});
+}
+
+}
+
 const QString SystemdServiceBackend::DBusObjectPath = QStringLiteral("/de/skycoder42/QtService/SystemdServiceBackend");
 
 SystemdServiceBackend::SystemdServiceBackend(Service *service) :
@@ -31,6 +49,9 @@ SystemdServiceBackend::SystemdServiceBackend(Service *service) :
 
 int SystemdServiceBackend::runService(int &argc, char **argv, int flags)
 {
+	// created before the app, so it is destroyed after it and gets to write all remaining messages
+	SystemdJournalSink journalSink;
+	journalSink.start(QThread::LowPriority);
 	qInstallMessageHandler(SystemdServiceBackend::systemdMessageHandler);
 	QCoreApplication app{argc, argv, flags};
 
@@ -85,7 +106,12 @@ void SystemdServiceBackend::quitService()
 
 void SystemdServiceBackend::reloadService()
 {
-	sd_notify(false, "RELOADING=1");
+	// Type=notify-reload requires the timestamp, so systemd can tell this reload from an earlier one
+	timespec now {};
+	::clock_gettime(CLOCK_MONOTONIC, &now);
+	const auto usecs = static_cast<quint64>(now.tv_sec) * 1000000ull + static_cast<quint64>(now.tv_nsec) / 1000ull;
+	const auto state = QByteArrayLiteral("RELOADING=1\nMONOTONIC_USEC=") + QByteArray::number(usecs);
+	sd_notify(false, state.constData());
 	processServiceCommand(ServiceCommand::Reload);
 }
 
@@ -112,6 +138,55 @@ QList<int> SystemdServiceBackend::getActivatedSockets(const QByteArray &name)
 		return _sockets.values(name);
 }
 
+bool SystemdServiceBackend::storeActivatedSocket(const QByteArray &name, int socket)
+{
+	if (!isValidFdName(name)) {
+		qCWarning(logBackend) << "Cannot store socket with invalid name" << name;
+		return false;
+	}
+
+	const auto state = QByteArrayLiteral("FDSTORE=1\nFDNAME=") + name;
+	const auto res = sd_pid_notify_with_fds(0, false, state.constData(), &socket, 1);
+	if (res > 0) {
+		qCDebug(logBackend) << "Stored socket" << socket << "as" << name;
+		return true;
+	} else if (res == 0) {
+		qCWarning(logBackend) << "Cannot store socket" << name << "- the service was not started by systemd";
+		return false;
+	} else {
+		qCWarning(logBackend) << "Failed to store socket" << name << "with error:" << qt_error_string(-res);
+		return false;
+	}
+}
+
+bool SystemdServiceBackend::removeStoredSockets(const QByteArray &name)
+{
+	if (!isValidFdName(name))
+		return false;
+
+	const auto state = QByteArrayLiteral("FDSTOREREMOVE=1\nFDNAME=") + name;
+	const auto res = sd_notify(false, state.constData());
+	if (res < 0)
+		qCWarning(logBackend) << "Failed to remove stored sockets" << name << "with error:" << qt_error_string(-res);
+	return res > 0;
+}
+
+void SystemdServiceBackend::reportProgress(const QString &status, int extendTimeoutMsecs)
+{
+	qCDebug(logBackend).noquote() << "Reporting progress:" << status;
+	QByteArray state {"STATUS="};
+	state += status.toUtf8().replace('\n', ' ');
+	// systemd only extends the timeout if the new one ends after the current one
+	if (extendTimeoutMsecs > 0)
+		state += QByteArrayLiteral("\nEXTEND_TIMEOUT_USEC=") + QByteArray::number(extendTimeoutMsecs * 1000ll);
+	const auto res = sd_notify(false, state.constData());
+	if (res < 0)
+		qCWarning(logBackend) << "Failed to report progress with error:" << qt_error_string(-res);
+	else if (res == 0)  // not started by systemd, so the log is all there is
+		ServiceBackend::reportProgress(status, extendTimeoutMsecs);
+	_hasProgress = true;
+}
+
 void SystemdServiceBackend::signalTriggered(int signal)
 {
 	qCDebug(logBackend) << "Processing signal" << signal;
@@ -144,20 +219,34 @@ void SystemdServiceBackend::signalTriggered(int signal)
 
 void SystemdServiceBackend::sendWatchdog()
 {
-	sd_notify(false, "WATCHDOG=1");
+	// a stalled service misses its pings, so systemd can restart it just like a hanging one
+	const auto healthy = service()->metrics()->isHealthy();
+	if (healthy != _watchdogHealthy) {
+		_watchdogHealthy = healthy;
+		if (healthy)
+			qCInfo(logBackend) << "Service is within its latency budget again, resuming watchdog";
+		else
+			qCWarning(logBackend) << "Service exceeded its latency budget, suspending watchdog";
+	}
+	if (healthy)
+		sd_notify(false, "WATCHDOG=1");
 }
 
 void SystemdServiceBackend::onStarted(bool success)
 {
-	if (success)
-		sd_notify(false, "READY=1");
-	else
+	if (success) {
+		// the progress of the start would otherwise be shown for as long as the service runs
+		sd_notify(false, _hasProgress ? "READY=1\nSTATUS=" : "READY=1");
+		_hasProgress = false;
+	} else
 		onStopped(EXIT_FAILURE);
 }
 
 void SystemdServiceBackend::onReloaded(bool success)
 {
-	Q_UNUSED(success)
+	// systemd has no way to report a failed reload, so the service must still be marked as ready
+	if (!success)
+		qCWarning(logBackend) << "Failed to reload service";
 	sd_notify(false, "READY=1");
 }
 
@@ -330,35 +419,13 @@ void SystemdServiceBackend::printDbusError(const QDBusError &error) const
 
 void SystemdServiceBackend::systemdMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
 {
-	auto formattedMessage = qFormatLogMessage(type, context, message);
-
-	int priority;
-	switch (type) {
-	case QtDebugMsg:
-		priority = LOG_DEBUG;
-		break;
-	case QtInfoMsg:
-		priority = LOG_INFO;
-		break;
-	case QtWarningMsg:
-		priority = LOG_WARNING;
-		break;
-	case QtCriticalMsg:
-		priority = LOG_CRIT;
-		break;
-	case QtFatalMsg:
-		priority = LOG_ALERT;
-		break;
-	default:
-		Q_UNREACHABLE();
-		break;
-	}
-
-	sd_journal_send("MESSAGE=%s", formattedMessage.toUtf8().constData(),
-					"PRIORITY=%i", priority,
-					"CODE_FUNC=%s", context.function ? context.function : "unknown",
-					"CODE_LINE=%d", context.line,
-					"CODE_FILE=%s", context.file ? context.file : "unknown",
-					"QT_CATEGORY=%s", context.category ? context.category : "unknown",
-					nullptr);
+	auto sink = SystemdJournalSink::instance();
+	if (!sink)
+		SystemdJournalSink::send(type, context, message);
+	else if (type == QtFatalMsg) {
+		// the application aborts right after this message, so everything must be written now
+		sink->flush();
+		SystemdJournalSink::send(type, context, message);
+	} else
+		sink->post(type, context, message);
 }
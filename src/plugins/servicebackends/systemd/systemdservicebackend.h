@@ -23,6 +23,9 @@ public:
 	Q_INVOKABLE void quitService() override;
 	Q_INVOKABLE void reloadService() override;
 	QList<int> getActivatedSockets(const QByteArray &name) override;
+	bool storeActivatedSocket(const QByteArray &name, int socket) override;
+	bool removeStoredSockets(const QByteArray &name) override;
+	void reportProgress(const QString &status, int extendTimeoutMsecs) override;
 
 protected Q_SLOTS:
 	void signalTriggered(int signal) override;
@@ -38,6 +41,8 @@ private Q_SLOTS:
 private:
 	bool _userService = true;
 	QTimer *_watchdogTimer = nullptr;
+	bool _watchdogHealthy = true;
+	bool _hasProgress = false;
 	QMultiHash<QByteArray, int> _sockets;
 
 	SystemdAdaptor *_dbusAdapter;
@@ -1,19 +1,65 @@
 #include "systemdservicecontrol.h"
 #include "systemdserviceplugin.h"
 #include <unistd.h>
+#include <algorithm>
 #include <QtCore/QBuffer>
 #include <QtCore/QProcess>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QRegularExpression>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtCore/QDeadlineTimer>
+#include <QtDBus/QDBusConnectionInterface>
+#include <QtDBus/QDBusVariant>
+#include <QtDBus/QDBusArgument>
+#include <QtDBus/QDBusPendingCallWatcher>
 using namespace QtService;
 
 Q_LOGGING_CATEGORY(logControl, "qt.service.plugin.systemd.control")
 
+namespace {
+
+const QString SystemdDBusService = QStringLiteral("org.freedesktop.systemd1");
+const QString SystemdDBusPath = QStringLiteral("/org/freedesktop/systemd1");
+const QString SystemdManagerInterface = QStringLiteral("org.freedesktop.systemd1.Manager");
+const QString SystemdUnitInterface = QStringLiteral("org.freedesktop.systemd1.Unit");
+const QString DBusPropertiesInterface = QStringLiteral("org.freedesktop.DBus.Properties");
+
+const QRegularExpression &unitRegex()
+{
+	static const QRegularExpression regex(QStringLiteral(R"__((.+)\.(?:service|socket|device|mount|automount|swap|target|path|timer|slice|scope))__"));
+	return regex;
+}
+
+}
+
 SystemdServiceControl::SystemdServiceControl(QString &&serviceId, QObject *parent) :
 	ServiceControl{std::move(serviceId), parent},
 	_runAsUser{::geteuid() != 0}
 {}
 
+SystemdServiceControl::~SystemdServiceControl()
+{
+	// never leave callers waiting on operations that can no longer complete
+	for (auto &futureIface : _inFlight) {
+		if (!futureIface.isFinished()) {
+			futureIface.reportCanceled();
+			futureIface.reportFinished();
+		}
+	}
+}
+
+template <typename T>
+QFutureInterface<T> SystemdServiceControl::createFuture()
+{
+	_inFlight.erase(std::remove_if(_inFlight.begin(), _inFlight.end(), [](const QFutureInterfaceBase &futureIface) {
+						return futureIface.isFinished();
+					}), _inFlight.end());
+	QFutureInterface<T> futureIface{QFutureInterfaceBase::Started};
+	_inFlight.append(futureIface);
+	return futureIface;
+}
+
 QString SystemdServiceControl::backend() const
 {
 	return QStringLiteral("systemd");
@@ -32,12 +78,19 @@ ServiceControl::SupportFlags SystemdServiceControl::supportFlags() const
 bool SystemdServiceControl::serviceExists() const
 {
 	_svcInfo = SvcExists::No;
-	auto svcName = serviceId().toUtf8();
-	auto svcType = serviceId().mid(realServiceName().size() + 1);
-	if (svcType.isEmpty()) {
-		svcType = QStringLiteral("service");
-		svcName += '.' + svcType.toUtf8();
+	const auto svcName = unitName();
+	if (hasManager()) {
+		const auto unitPath = loadUnit();
+		if (unitPath.isEmpty())
+			return false;
+		const auto loadState = unitProperty(unitPath, QStringLiteral("LoadState")).toString();
+		if (loadState.isEmpty() || loadState == QStringLiteral("not-found"))
+			return false;
+		_svcInfo = SvcExists::Yes;
+		return true;
 	}
+
+	const auto svcType = QString::fromUtf8(svcName.mid(svcName.lastIndexOf('.') + 1));
 	qCDebug(logControl) << "Detected service type as:" << svcType;
 
 	QByteArray data;
@@ -71,12 +124,28 @@ bool SystemdServiceControl::serviceExists() const
 
 ServiceControl::Status SystemdServiceControl::status() const
 {
-	auto svcName = serviceId().toUtf8();
-	auto svcType = serviceId().mid(realServiceName().size() + 1);
-	if (svcType.isEmpty()) {
-		svcType = QStringLiteral("service");
-		svcName += '.' + svcType.toUtf8();
+	const auto svcName = unitName();
+	if (hasManager()) {
+		const auto unitPath = loadUnit();
+		if (unitPath.isEmpty())
+			return Status::Unknown;
+		const auto loadState = unitProperty(unitPath, QStringLiteral("LoadState")).toString();
+		if (loadState == QStringLiteral("not-found")) {
+			_svcInfo = SvcExists::No;
+			setError(tr("Service %1 was not found as systemd service")
+					 .arg(QString::fromUtf8(svcName)));
+			return Status::Unknown;
+		}
+		const auto activeState = unitProperty(unitPath, QStringLiteral("ActiveState")).toString().toUtf8();
+		const auto status = statusFromActiveState(activeState);
+		if (status == Status::Unknown) {
+			setError(tr("Unknown service state %1 for service %2")
+					 .arg(QString::fromUtf8(activeState), QString::fromUtf8(svcName)));
+		}
+		return status;
 	}
+
+	const auto svcType = QString::fromUtf8(svcName.mid(svcName.lastIndexOf('.') + 1));
 	qCDebug(logControl) << "Detected service type as:" << svcType;
 
 	QByteArray data;
@@ -104,23 +173,12 @@ ServiceControl::Status SystemdServiceControl::status() const
 
 		// found correct service! now read the status
 		const auto &svcState = lineData[2];
-		if (svcState == "active")
-			return Status::Running;
-		else if (svcState == "reloading")
-			return Status::Reloading;
-		else if (svcState == "inactive")
-			return Status::Stopped;
-		else if (svcState == "failed")
-			return Status::Errored;
-		else if (svcState == "activating")
-			return Status::Starting;
-		else if (svcState == "deactivating")
-			return Status::Stopping;
-		else {
+		const auto status = statusFromActiveState(svcState);
+		if (status == Status::Unknown) {
 			setError(tr("Unknown service state %1 for service %2")
 					 .arg(QString::fromUtf8(svcState), QString::fromUtf8(svcName)));
-			return Status::Unknown;
 		}
+		return status;
 	}
 
 	if (_svcInfo == SvcExists::Unknown)
@@ -136,7 +194,25 @@ ServiceControl::Status SystemdServiceControl::status() const
 
 bool SystemdServiceControl::isAutostartEnabled() const
 {
-	return runSystemctl("is-enabled") == EXIT_SUCCESS;
+	if (hasManager()) {
+		const auto reply = callManager(QStringLiteral("GetUnitFileState"), {QString::fromUtf8(unitName())});
+		if (reply.type() == QDBusMessage::ErrorMessage) {
+			setDBusError(reply);
+			return false;
+		}
+		// same states that make "systemctl is-enabled" succeed
+		static const QStringList enabledStates {
+			QStringLiteral("enabled"),
+			QStringLiteral("enabled-runtime"),
+			QStringLiteral("static"),
+			QStringLiteral("alias"),
+			QStringLiteral("indirect"),
+			QStringLiteral("generated"),
+			QStringLiteral("transient")
+		};
+		return enabledStates.contains(reply.arguments().value(0).toString());
+	} else
+		return runSystemctl("is-enabled") == EXIT_SUCCESS;
 }
 
 ServiceControl::BlockMode SystemdServiceControl::blocking() const
@@ -149,8 +225,16 @@ bool SystemdServiceControl::isRunAsUser() const
 	return _runAsUser;
 }
 
+bool SystemdServiceControl::useDBus() const
+{
+	return _useDBus;
+}
+
 QVariant SystemdServiceControl::callGenericCommand(const QByteArray &kind, const QVariantList &args)
 {
+	if (kind == "setLoggingRules" || kind == "invokeCallback")
+		return ServiceControl::callGenericCommand(kind, args);
+
 	QStringList sArgs;
 	sArgs.reserve(args.size());
 	for (const auto &arg : args)
@@ -160,32 +244,165 @@ QVariant SystemdServiceControl::callGenericCommand(const QByteArray &kind, const
 
 bool SystemdServiceControl::start()
 {
-	return runSystemctl("start") == EXIT_SUCCESS;
+	if (hasManager())
+		return runJob(QStringLiteral("StartUnit"));
+	else
+		return runSystemctl("start") == EXIT_SUCCESS;
 }
 
 bool SystemdServiceControl::stop()
 {
-	return runSystemctl("stop") == EXIT_SUCCESS;
+	if (hasManager())
+		return runJob(QStringLiteral("StopUnit"));
+	else
+		return runSystemctl("stop") == EXIT_SUCCESS;
 }
 
 bool SystemdServiceControl::restart()
 {
-	return runSystemctl("restart") == EXIT_SUCCESS;
+	if (hasManager())
+		return runJob(QStringLiteral("RestartUnit"));
+	else
+		return runSystemctl("restart") == EXIT_SUCCESS;
 }
 
 bool SystemdServiceControl::reload()
 {
-	return runSystemctl("reload") == EXIT_SUCCESS;
+	if (hasManager())
+		return runJob(QStringLiteral("ReloadUnit"));
+	else
+		return runSystemctl("reload") == EXIT_SUCCESS;
 }
 
 bool SystemdServiceControl::enableAutostart()
 {
-	return runSystemctl("enable") == EXIT_SUCCESS;
+	if (hasManager()) {
+		return runUnitFileChange(QStringLiteral("EnableUnitFiles"), {
+									 QStringList{QString::fromUtf8(unitName())},
+									 false,  // runtime
+									 false  // force
+								 });
+	} else
+		return runSystemctl("enable") == EXIT_SUCCESS;
 }
 
 bool SystemdServiceControl::disableAutostart()
 {
-	return runSystemctl("disable") == EXIT_SUCCESS;
+	if (hasManager()) {
+		return runUnitFileChange(QStringLiteral("DisableUnitFiles"), {
+									 QStringList{QString::fromUtf8(unitName())},
+									 false  // runtime
+								 });
+	} else
+		return runSystemctl("disable") == EXIT_SUCCESS;
+}
+
+QFuture<ServiceControl::Status> SystemdServiceControl::statusAsync()
+{
+	auto futureIface = createFuture<Status>();
+	const auto svcName = QString::fromUtf8(unitName());
+	const auto finish = [this, futureIface, svcName](const QString &loadState, const QString &activeState) mutable {
+		auto status = Status::Unknown;
+		if (loadState.isEmpty() || loadState == QStringLiteral("not-found")) {
+			setError(tr("Service %1 was not found as systemd service").arg(svcName));
+		} else {
+			status = statusFromActiveState(activeState.toUtf8());
+			if (status == Status::Unknown) {
+				setError(tr("Unknown service state %1 for service %2")
+						 .arg(activeState, svcName));
+			}
+		}
+		futureIface.reportFinished(&status);
+	};
+
+	if (hasManager()) {
+		// a single call returns load and active state, without loading the unit first
+		callManagerAsync(QStringLiteral("ListUnitsByNames"), {QVariant{QStringList{svcName}}},
+						 [this, finish, svcName](const QDBusMessage &reply) mutable {
+			if (reply.type() == QDBusMessage::ErrorMessage) {
+				setDBusError(reply);
+				finish({}, {});
+			} else {
+				const auto states = activeStatesOf(reply);
+				if (states.contains(svcName))
+					finish(QStringLiteral("loaded"), states.value(svcName));
+				else
+					finish({}, {});
+			}
+		});
+	} else {
+		runSystemctlAsync("show", {
+							  QStringLiteral("--property=LoadState,ActiveState"),
+							  svcName
+						  }, true, [finish](int exitCode, const QByteArray &data) mutable {
+			QString loadState, activeState;
+			if (exitCode == EXIT_SUCCESS) {
+				for (const auto &line : data.split('\n')) {
+					if (line.startsWith("LoadState="))
+						loadState = QString::fromUtf8(line.mid(10).trimmed());
+					else if (line.startsWith("ActiveState="))
+						activeState = QString::fromUtf8(line.mid(12).trimmed());
+				}
+			}
+			finish(loadState, activeState);
+		});
+	}
+	return futureIface.future();
+}
+
+QFuture<bool> SystemdServiceControl::startAsync()
+{
+	if (hasManager())
+		return runJobAsync(QStringLiteral("StartUnit"));
+	else
+		return runSystemctlAsync("start");
+}
+
+QFuture<bool> SystemdServiceControl::stopAsync()
+{
+	if (hasManager())
+		return runJobAsync(QStringLiteral("StopUnit"));
+	else
+		return runSystemctlAsync("stop");
+}
+
+QFuture<bool> SystemdServiceControl::restartAsync()
+{
+	if (hasManager())
+		return runJobAsync(QStringLiteral("RestartUnit"));
+	else
+		return runSystemctlAsync("restart");
+}
+
+QFuture<bool> SystemdServiceControl::reloadAsync()
+{
+	if (hasManager())
+		return runJobAsync(QStringLiteral("ReloadUnit"));
+	else
+		return runSystemctlAsync("reload");
+}
+
+QFuture<bool> SystemdServiceControl::enableAutostartAsync()
+{
+	if (hasManager()) {
+		return runUnitFileChangeAsync(QStringLiteral("EnableUnitFiles"), {
+										  QStringList{QString::fromUtf8(unitName())},
+										  false,  // runtime
+										  false  // force
+									  });
+	} else
+		return runSystemctlAsync("enable");
+}
+
+QFuture<bool> SystemdServiceControl::disableAutostartAsync()
+{
+	if (hasManager()) {
+		return runUnitFileChangeAsync(QStringLiteral("DisableUnitFiles"), {
+										  QStringList{QString::fromUtf8(unitName())},
+										  false  // runtime
+									  });
+	} else
+		return runSystemctlAsync("disable");
 }
 
 bool SystemdServiceControl::setBlocking(bool blocking)
@@ -204,6 +421,8 @@ void SystemdServiceControl::setRunAsUser(bool runAsUser)
 		return;
 
 	_runAsUser = runAsUser;
+	_managerInfo = SvcExists::Unknown;
+	_subscribed = false;
 	emit runAsUserChanged(_runAsUser);
 }
 
@@ -212,26 +431,253 @@ void SystemdServiceControl::resetRunAsUser()
 	setRunAsUser(::geteuid() != 0);
 }
 
+void SystemdServiceControl::setUseDBus(bool useDBus)
+{
+	if (_useDBus == useDBus)
+		return;
+
+	_useDBus = useDBus;
+	emit useDBusChanged(_useDBus);
+}
+
 QString SystemdServiceControl::serviceName() const
 {
-	const static QRegularExpression regex(QStringLiteral(R"__((.+)\.(?:service|socket|device|mount|automount|swap|target|path|timer|slice|scope))__"));
 	const auto svcId = serviceId();
-	auto match = regex.match(svcId);
+	auto match = unitRegex().match(svcId);
 	if (match.hasMatch())
 		return match.captured(1);
 	else
 		return svcId;
 }
 
+QHash<QString, ServiceControl::Status> SystemdServiceControl::batchStatus(const QStringList &serviceIds) const
+{
+	QHash<QString, QString> unitIds;
+	unitIds.reserve(serviceIds.size());
+	for (const auto &serviceId : serviceIds)
+		unitIds.insert(unitNameOf(serviceId), serviceId);
+	const auto unitNames = unitIds.keys();
+
+	QHash<QString, Status> result;
+	result.reserve(serviceIds.size());
+	for (const auto &serviceId : serviceIds)
+		result.insert(serviceId, Status::Unknown);
+
+	if (hasManager()) {
+		// one call for all units - unknown units are reported with the "not-found" load state
+		const auto reply = callManager(QStringLiteral("ListUnitsByNames"), {QVariant{unitNames}});
+		if (reply.type() == QDBusMessage::ErrorMessage) {
+			setDBusError(reply);
+			return result;
+		}
+
+		const auto states = activeStatesOf(reply);
+		for (auto it = states.constBegin(); it != states.constEnd(); ++it) {
+			const auto serviceId = unitIds.value(it.key());
+			if (!serviceId.isNull())
+				result.insert(serviceId, statusFromActiveState(it->toUtf8()));
+		}
+		return result;
+	}
+
+	// fallback: a single list-units call, filtered to the requested units
+	QByteArray data;
+	if (runSystemctl("list-units", QStringList {
+						QStringLiteral("--all"),
+						QStringLiteral("--full"),
+						QStringLiteral("--no-pager"),
+						QStringLiteral("--plain"),
+						QStringLiteral("--no-legend")
+					} + unitNames, &data, true) != EXIT_SUCCESS)
+		return result;
+
+	QSet<QString> foundUnits;
+	QBuffer buffer{&data};
+	buffer.open(QIODevice::ReadOnly);
+	while (!buffer.atEnd()) {
+		const auto lineData = buffer.readLine().simplified().split(' ');
+		if (lineData.size() < 3)
+			continue;
+		const auto name = QString::fromUtf8(lineData[0]);
+		const auto serviceId = unitIds.value(name);
+		if (serviceId.isNull())
+			continue;
+		foundUnits.insert(name);
+		result.insert(serviceId, statusFromActiveState(lineData[2]));
+	}
+
+	// units that are not loaded are not listed, but might still exist as unit files
+	QStringList missingUnits;
+	for (const auto &unit : unitNames) {
+		if (!foundUnits.contains(unit))
+			missingUnits.append(unit);
+	}
+	if (missingUnits.isEmpty())
+		return result;
+	QByteArray fileData;
+	if (runSystemctl("list-unit-files", QStringList {
+						QStringLiteral("--full"),
+						QStringLiteral("--no-pager"),
+						QStringLiteral("--plain"),
+						QStringLiteral("--no-legend")
+					} + missingUnits, &fileData, true) != EXIT_SUCCESS)
+		return result;
+	QBuffer fileBuffer{&fileData};
+	fileBuffer.open(QIODevice::ReadOnly);
+	while (!fileBuffer.atEnd()) {
+		const auto lineData = fileBuffer.readLine().simplified().split(' ');
+		const auto serviceId = unitIds.value(QString::fromUtf8(lineData[0]));
+		if (!serviceId.isNull())
+			result.insert(serviceId, Status::Stopped);
+	}
+	return result;
+}
+
+bool SystemdServiceControl::startStatusWatcher()
+{
+	if (!hasManager())
+		return ServiceControl::startStatusWatcher();
+
+	const auto unitPath = loadUnit();
+	if (unitPath.isEmpty() || !subscribe())
+		return false;
+
+	// systemd emits PropertiesChanged on the unit object for every ActiveState transition
+	auto bus = systemdBus();
+	if (!bus.connect(SystemdDBusService,
+					 unitPath,
+					 DBusPropertiesInterface,
+					 QStringLiteral("PropertiesChanged"),
+					 this,
+					 SLOT(unitPropertiesChanged(QString,QVariantMap,QStringList)))) {
+		setError(tr("Failed to connect to the systemd unit signals with error: %1")
+				 .arg(bus.lastError().message()));
+		return false;
+	}
+
+	_watchedUnitPath = unitPath;
+	return true;
+}
+
+void SystemdServiceControl::stopStatusWatcher()
+{
+	if (_watchedUnitPath.isEmpty()) {
+		ServiceControl::stopStatusWatcher();
+		return;
+	}
+
+	systemdBus().disconnect(SystemdDBusService,
+							_watchedUnitPath,
+							DBusPropertiesInterface,
+							QStringLiteral("PropertiesChanged"),
+							this,
+							SLOT(unitPropertiesChanged(QString,QVariantMap,QStringList)));
+	_watchedUnitPath.clear();
+}
+
+void SystemdServiceControl::jobRemoved(uint id, const QDBusObjectPath &job, const QString &unit, const QString &result)
+{
+	Q_UNUSED(id)
+	if (unit != QString::fromUtf8(unitName()))
+		return;
+
+	const auto jobPath = job.path();
+	if (_pendingJobs.contains(jobPath)) {
+		qCDebug(logControl) << "Async job" << jobPath << "finished with result" << result;
+		completeJob(_pendingJobs.take(jobPath), result);
+		return;
+	}
+
+	// only remember jobs someone might be waiting for
+	if (!_jobLoop && _pendingJobCalls == 0)
+		return;
+	qCDebug(logControl) << "Job" << jobPath << "finished with result" << result;
+	_finishedJobs.insert(jobPath, result);
+	if (_jobLoop)
+		_jobLoop->quit();
+}
+
+void SystemdServiceControl::unitPropertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated)
+{
+	if (interface != SystemdUnitInterface)
+		return;
+
+	const auto stateKey = QStringLiteral("ActiveState");
+	if (changed.contains(stateKey))
+		reportStatus(statusFromActiveState(changed.value(stateKey).toString().toUtf8()));
+	else if (invalidated.contains(stateKey))
+		reportStatus(status());
+}
+
+QByteArray SystemdServiceControl::unitName() const
+{
+	auto svcName = serviceId().toUtf8();
+	if (serviceId().mid(realServiceName().size() + 1).isEmpty())
+		svcName += ".service";
+	return svcName;
+}
+
+QString SystemdServiceControl::unitNameOf(const QString &serviceId)
+{
+	if (unitRegex().match(serviceId).hasMatch())
+		return serviceId;
+	else
+		return serviceId + QStringLiteral(".service");
+}
+
+ServiceControl::Status SystemdServiceControl::statusFromActiveState(const QByteArray &state)
+{
+	if (state == "active")
+		return Status::Running;
+	else if (state == "reloading")
+		return Status::Reloading;
+	else if (state == "inactive")
+		return Status::Stopped;
+	else if (state == "failed")
+		return Status::Errored;
+	else if (state == "activating")
+		return Status::Starting;
+	else if (state == "deactivating")
+		return Status::Stopping;
+	else
+		return Status::Unknown;
+}
+
 int SystemdServiceControl::runSystemctl(const QByteArray &command, const QStringList &extraArgs, QByteArray *outData, bool noPrepare) const
+{
+	QProcess process;
+	if (!prepareSystemctl(process, command, extraArgs, noPrepare))
+		return -1;
+	if (!outData)
+		process.setStandardOutputFile(QProcess::nullDevice());
+
+	qCDebug(logControl) << "Executing" << process.program()
+						<< process.arguments();
+	process.start(QProcess::ReadOnly);
+	if (process.waitForFinished(_blocking ? -1 : 2500)) {//non-blocking calls should finish within two seconds
+		if (outData)
+			*outData = process.readAllStandardOutput();
+
+		if (process.exitStatus() == QProcess::NormalExit)
+			return process.exitCode();
+		else {
+			setError(tr("systemctl crashed with error: %1").arg(process.errorString()));
+			return 128 + process.error();
+		}
+	} else {
+		setError(tr("systemctl did not exit in time"));
+		return -1;
+	}
+}
+
+bool SystemdServiceControl::prepareSystemctl(QProcess &process, const QByteArray &command, const QStringList &extraArgs, bool noPrepare) const
 {
 	const auto systemctl = QStandardPaths::findExecutable(QStringLiteral("systemctl"));
 	if (systemctl.isEmpty()) {
 		setError(tr("Failed to find systemctl executable"));
-		return -1;
+		return false;
 	}
 
-	QProcess process;
 	process.setProgram(systemctl);
 
 	QStringList args;
@@ -250,25 +696,329 @@ int SystemdServiceControl::runSystemctl(const QByteArray &command, const QString
 	process.setArguments(args);
 
 	process.setStandardInputFile(QProcess::nullDevice());
-	if (!outData)
-		process.setStandardOutputFile(QProcess::nullDevice());
 	process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+	return true;
+}
 
-	qCDebug(logControl) << "Executing" << process.program()
-						<< process.arguments();
-	process.start(QProcess::ReadOnly);
-	if (process.waitForFinished(_blocking ? -1 : 2500)) {//non-blocking calls should finish within two seconds
-		if (outData)
-			*outData = process.readAllStandardOutput();
+void SystemdServiceControl::runSystemctlAsync(const QByteArray &command, const QStringList &extraArgs, bool noPrepare, const std::function<void(int, QByteArray)> &handler)
+{
+	auto process = new QProcess{this};
+	if (!prepareSystemctl(*process, command, extraArgs, noPrepare)) {
+		process->deleteLater();
+		handler(-1, {});
+		return;
+	}
 
-		if (process.exitStatus() == QProcess::NormalExit)
-			return process.exitCode();
+	connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+			this, [this, process, handler](int exitCode, QProcess::ExitStatus exitStatus) {
+		process->deleteLater();
+		if (exitStatus == QProcess::NormalExit)
+			handler(exitCode, process->readAllStandardOutput());
 		else {
-			setError(tr("systemctl crashed with error: %1").arg(process.errorString()));
-			return 128 + process.error();
+			setError(tr("systemctl crashed with error: %1").arg(process->errorString()));
+			handler(128 + process->error(), {});
+		}
+	});
+	connect(process, &QProcess::errorOccurred,
+			this, [this, process, handler](QProcess::ProcessError error) {
+		if (error != QProcess::FailedToStart)
+			return;
+		process->deleteLater();
+		setError(tr("Failed to start systemctl with error: %1").arg(process->errorString()));
+		handler(-1, {});
+	});
+
+	qCDebug(logControl) << "Executing asynchronously" << process->program()
+						<< process->arguments();
+	process->start(QProcess::ReadOnly);
+}
+
+QFuture<bool> SystemdServiceControl::runSystemctlAsync(const QByteArray &command)
+{
+	auto futureIface = createFuture<bool>();
+	runSystemctlAsync(command, {}, false, [futureIface](int exitCode, const QByteArray &) mutable {
+		const auto ok = exitCode == EXIT_SUCCESS;
+		futureIface.reportFinished(&ok);
+	});
+	return futureIface.future();
+}
+
+QDBusConnection SystemdServiceControl::systemdBus() const
+{
+	if (_runAsUser)
+		return QDBusConnection::sessionBus();
+	else
+		return QDBusConnection::systemBus();
+}
+
+bool SystemdServiceControl::hasManager() const
+{
+	if (!_useDBus)
+		return false;
+
+	if (_managerInfo == SvcExists::Unknown) {
+		const auto bus = systemdBus();
+		if (bus.isConnected() && bus.interface()->isServiceRegistered(SystemdDBusService))
+			_managerInfo = SvcExists::Yes;
+		else {
+			qCDebug(logControl) << "systemd manager not reachable via D-Bus - falling back to systemctl";
+			_managerInfo = SvcExists::No;
 		}
-	} else {
-		setError(tr("systemctl did not exit in time"));
-		return -1;
 	}
+	return _managerInfo == SvcExists::Yes;
+}
+
+QDBusMessage SystemdServiceControl::managerCall(const QString &method, const QVariantList &args) const
+{
+	auto message = QDBusMessage::createMethodCall(SystemdDBusService,
+												  SystemdDBusPath,
+												  SystemdManagerInterface,
+												  method);
+	message.setArguments(args);
+	message.setInteractiveAuthorizationAllowed(true);
+	qCDebug(logControl) << "Calling" << method << "on systemd manager with" << args;
+	return message;
+}
+
+QDBusMessage SystemdServiceControl::callManager(const QString &method, const QVariantList &args) const
+{
+	return systemdBus().call(managerCall(method, args), QDBus::Block, _blocking ? -1 : 2500);
+}
+
+void SystemdServiceControl::callManagerAsync(const QString &method, const QVariantList &args, const std::function<void(QDBusMessage)> &handler)
+{
+	const auto pendingCall = systemdBus().asyncCall(managerCall(method, args), _blocking ? -1 : 2500);
+	auto watcher = new QDBusPendingCallWatcher{pendingCall, this};
+	connect(watcher, &QDBusPendingCallWatcher::finished,
+			this, [handler](QDBusPendingCallWatcher *watcher) {
+		watcher->deleteLater();
+		handler(watcher->reply());
+	});
+}
+
+QHash<QString, QString> SystemdServiceControl::activeStatesOf(const QDBusMessage &unitList)
+{
+	QHash<QString, QString> states;
+	const auto arg = unitList.arguments().value(0).value<QDBusArgument>();
+	arg.beginArray();
+	while (!arg.atEnd()) {
+		QString name, description, loadState, activeState, subState, following, jobType;
+		QDBusObjectPath unitPath, jobPath;
+		uint jobId = 0;
+		arg.beginStructure();
+		arg >> name >> description >> loadState >> activeState >> subState
+			>> following >> unitPath >> jobId >> jobType >> jobPath;
+		arg.endStructure();
+		// unknown units are reported with the "not-found" load state
+		if (loadState != QStringLiteral("not-found"))
+			states.insert(name, activeState);
+	}
+	arg.endArray();
+	return states;
+}
+
+QString SystemdServiceControl::loadUnit() const
+{
+	const auto reply = callManager(QStringLiteral("LoadUnit"), {QString::fromUtf8(unitName())});
+	if (reply.type() == QDBusMessage::ErrorMessage) {
+		setDBusError(reply);
+		return {};
+	} else
+		return reply.arguments().value(0).value<QDBusObjectPath>().path();
+}
+
+QVariant SystemdServiceControl::unitProperty(const QString &unitPath, const QString &property) const
+{
+	auto message = QDBusMessage::createMethodCall(SystemdDBusService,
+												  unitPath,
+												  DBusPropertiesInterface,
+												  QStringLiteral("Get"));
+	message.setArguments({SystemdUnitInterface, property});
+	const auto reply = systemdBus().call(message, QDBus::Block, _blocking ? -1 : 2500);
+	if (reply.type() == QDBusMessage::ErrorMessage) {
+		setDBusError(reply);
+		return {};
+	} else
+		return reply.arguments().value(0).value<QDBusVariant>().variant();
+}
+
+bool SystemdServiceControl::subscribe()
+{
+	if (_subscribed)
+		return true;
+
+	auto bus = systemdBus();
+	if (!bus.connect(SystemdDBusService,
+					 SystemdDBusPath,
+					 SystemdManagerInterface,
+					 QStringLiteral("JobRemoved"),
+					 this,
+					 SLOT(jobRemoved(uint,QDBusObjectPath,QString,QString)))) {
+		setError(tr("Failed to connect to the systemd job signals with error: %1")
+				 .arg(bus.lastError().message()));
+		return false;
+	}
+
+	// systemd only emits job signals if at least one client has subscribed
+	const auto reply = callManager(QStringLiteral("Subscribe"));
+	if (reply.type() == QDBusMessage::ErrorMessage) {
+		setDBusError(reply);
+		return false;
+	}
+
+	_subscribed = true;
+	return true;
+}
+
+bool SystemdServiceControl::runJob(const QString &method, QVariantList args)
+{
+	if (_blocking && !subscribe())
+		return false;
+
+	args.prepend(QString::fromUtf8(unitName()));
+	args.append(QStringLiteral("replace"));
+	const auto reply = callManager(method, args);
+	if (reply.type() == QDBusMessage::ErrorMessage) {
+		setDBusError(reply);
+		return false;
+	}
+	if (!_blocking)
+		return true;
+
+	// wait for the job to be removed, which is when the unit reached its target state
+	const auto jobPath = reply.arguments().value(0).value<QDBusObjectPath>().path();
+	qCDebug(logControl) << "Waiting for job" << jobPath << "to complete";
+	// a lost signal or a dropped bus connection must not block the caller forever
+	QDeadlineTimer deadline{JobTimeout};
+	QEventLoop loop;
+	QTimer timer;
+	timer.setSingleShot(true);
+	connect(&timer, &QTimer::timeout,
+			&loop, &QEventLoop::quit);
+	_jobLoop = &loop;
+	while (!_finishedJobs.contains(jobPath) && !deadline.hasExpired()) {
+		timer.start(static_cast<int>(deadline.remainingTime()));
+		loop.exec();
+	}
+	_jobLoop.clear();
+
+	if (!_finishedJobs.contains(jobPath)) {
+		if (_pendingJobCalls == 0)
+			_finishedJobs.clear();
+		setError(tr("Timed out waiting for the job of unit %1 to finish")
+				 .arg(QString::fromUtf8(unitName())));
+		return false;
+	}
+	const auto result = _finishedJobs.take(jobPath);
+	if (_pendingJobCalls == 0)
+		_finishedJobs.clear();
+	if (result == QStringLiteral("done"))
+		return true;
+	else {
+		setError(tr("Job for unit %1 finished with result: %2")
+				 .arg(QString::fromUtf8(unitName()), result));
+		return false;
+	}
+}
+
+bool SystemdServiceControl::runUnitFileChange(const QString &method, const QVariantList &args)
+{
+	const auto reply = callManager(method, args);
+	if (reply.type() == QDBusMessage::ErrorMessage) {
+		setDBusError(reply);
+		return false;
+	}
+
+	// same as systemctl: reload the daemon so the changes are picked up
+	const auto reloadReply = callManager(QStringLiteral("Reload"));
+	if (reloadReply.type() == QDBusMessage::ErrorMessage) {
+		setDBusError(reloadReply);
+		return false;
+	}
+	return true;
+}
+
+QFuture<bool> SystemdServiceControl::runJobAsync(const QString &method)
+{
+	auto futureIface = createFuture<bool>();
+	if (_blocking && !subscribe()) {
+		const auto ok = false;
+		futureIface.reportFinished(&ok);
+		return futureIface.future();
+	}
+
+	++_pendingJobCalls;
+	callManagerAsync(method, {
+						 QString::fromUtf8(unitName()),
+						 QStringLiteral("replace")
+					 }, [this, futureIface](const QDBusMessage &reply) mutable {
+		--_pendingJobCalls;
+		if (reply.type() == QDBusMessage::ErrorMessage) {
+			setDBusError(reply);
+			const auto ok = false;
+			futureIface.reportFinished(&ok);
+		} else if (!_blocking) {
+			const auto ok = true;
+			futureIface.reportFinished(&ok);
+		} else {
+			// the job might already be gone if another call was waiting for the same unit
+			const auto jobPath = reply.arguments().value(0).value<QDBusObjectPath>().path();
+			if (_finishedJobs.contains(jobPath))
+				completeJob(futureIface, _finishedJobs.take(jobPath));
+			else {
+				_pendingJobs.insert(jobPath, futureIface);
+				QTimer::singleShot(JobTimeout, this, [this, jobPath]() {
+					if (!_pendingJobs.contains(jobPath))
+						return;
+					setError(tr("Timed out waiting for the job of unit %1 to finish")
+							 .arg(QString::fromUtf8(unitName())));
+					auto futureIface = _pendingJobs.take(jobPath);
+					const auto ok = false;
+					futureIface.reportFinished(&ok);
+				});
+			}
+		}
+		if (_pendingJobCalls == 0 && !_jobLoop)
+			_finishedJobs.clear();
+	});
+	return futureIface.future();
+}
+
+QFuture<bool> SystemdServiceControl::runUnitFileChangeAsync(const QString &method, const QVariantList &args)
+{
+	auto futureIface = createFuture<bool>();
+	callManagerAsync(method, args, [this, futureIface](const QDBusMessage &reply) mutable {
+		if (reply.type() == QDBusMessage::ErrorMessage) {
+			setDBusError(reply);
+			const auto ok = false;
+			futureIface.reportFinished(&ok);
+			return;
+		}
+
+		// same as systemctl: reload the daemon so the changes are picked up
+		callManagerAsync(QStringLiteral("Reload"), {}, [this, futureIface](const QDBusMessage &reloadReply) mutable {
+			const auto ok = reloadReply.type() != QDBusMessage::ErrorMessage;
+			if (!ok)
+				setDBusError(reloadReply);
+			futureIface.reportFinished(&ok);
+		});
+	});
+	return futureIface.future();
+}
+
+void SystemdServiceControl::completeJob(QFutureInterface<bool> futureIface, const QString &result)
+{
+	const auto ok = result == QStringLiteral("done");
+	if (!ok) {
+		setError(tr("Job for unit %1 finished with result: %2")
+				 .arg(QString::fromUtf8(unitName()), result));
+	}
+	futureIface.reportFinished(&ok);
+}
+
+void SystemdServiceControl::setDBusError(const QDBusMessage &reply) const
+{
+	qCDebug(logControl).noquote().nospace() << reply.errorName() << ": "
+											<< reply.errorMessage();
+	setError(tr("systemd D-Bus call failed with error: %1").arg(reply.errorMessage()));
 }
@@ -2,6 +2,15 @@
 #define SYSTEMDSERVICECONTROL_H
 
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QPointer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFutureInterface>
+#include <QtCore/QProcess>
+#include <functional>
+
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusObjectPath>
 
 #include <QtService/ServiceControl>
 
@@ -10,9 +19,14 @@ class SystemdServiceControl : public QtService::ServiceControl
 	Q_OBJECT
 
 	Q_PROPERTY(bool runAsUser READ isRunAsUser WRITE setRunAsUser RESET resetRunAsUser NOTIFY runAsUserChanged)
+	Q_PROPERTY(bool useDBus READ useDBus WRITE setUseDBus NOTIFY useDBusChanged)
 
 public:
+	// generous, as jobs of units with long start timeouts legitimately take minutes
+	static constexpr int JobTimeout = 5 * 60 * 1000;
+
 	explicit SystemdServiceControl(QString &&serviceId, QObject *parent = nullptr);
+	~SystemdServiceControl() override;
 
 	QString backend() const override;
 	SupportFlags supportFlags() const override;
@@ -21,9 +35,18 @@ public:
 	bool isAutostartEnabled() const override;
 	BlockMode blocking() const override;
 	bool isRunAsUser() const;
+	bool useDBus() const;
 
 	QVariant callGenericCommand(const QByteArray &kind, const QVariantList &args) override;
 
+	QFuture<Status> statusAsync() override;
+	QFuture<bool> startAsync() override;
+	QFuture<bool> stopAsync() override;
+	QFuture<bool> restartAsync() override;
+	QFuture<bool> reloadAsync() override;
+	QFuture<bool> enableAutostartAsync() override;
+	QFuture<bool> disableAutostartAsync() override;
+
 public Q_SLOTS:
 	bool start() override;
 	bool stop() override;
@@ -34,12 +57,21 @@ public Q_SLOTS:
 	bool setBlocking(bool blocking) override;
 	void setRunAsUser(bool runAsUser);
 	void resetRunAsUser();
+	void setUseDBus(bool useDBus);
 
 Q_SIGNALS:
 	void runAsUserChanged(bool runAsUser);
+	void useDBusChanged(bool useDBus);
 
 protected:
 	QString serviceName() const override;
+	QHash<QString, Status> batchStatus(const QStringList &serviceIds) const override;
+	bool startStatusWatcher() override;
+	void stopStatusWatcher() override;
+
+private Q_SLOTS:
+	void jobRemoved(uint id, const QDBusObjectPath &job, const QString &unit, const QString &result);
+	void unitPropertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated);
 
 private:
 	enum class SvcExists {
@@ -51,10 +83,53 @@ private:
 	bool _blocking = true;
 	bool _runAsUser;
 
+	bool _useDBus = true;
+	mutable SvcExists _managerInfo = SvcExists::Unknown;
+	bool _subscribed = false;
+	QHash<QString, QString> _finishedJobs;
+	QPointer<QEventLoop> _jobLoop;
+	QHash<QString, QFutureInterface<bool>> _pendingJobs;
+	int _pendingJobCalls = 0;
+	QList<QFutureInterfaceBase> _inFlight;
+	QString _watchedUnitPath;
+
+	QByteArray unitName() const;
+	static QString unitNameOf(const QString &serviceId);
+	static Status statusFromActiveState(const QByteArray &state);
+
 	int runSystemctl(const QByteArray &command,
 					 const QStringList &extraArgs = {},
 					 QByteArray *outData = nullptr,
 					 bool noPrepare = false) const;
+	bool prepareSystemctl(QProcess &process,
+						  const QByteArray &command,
+						  const QStringList &extraArgs,
+						  bool noPrepare) const;
+	void runSystemctlAsync(const QByteArray &command,
+						   const QStringList &extraArgs,
+						   bool noPrepare,
+						   const std::function<void(int, QByteArray)> &handler);
+	QFuture<bool> runSystemctlAsync(const QByteArray &command);
+
+	QDBusConnection systemdBus() const;
+	bool hasManager() const;
+	QDBusMessage managerCall(const QString &method, const QVariantList &args) const;
+	QDBusMessage callManager(const QString &method, const QVariantList &args = {}) const;
+	void callManagerAsync(const QString &method,
+						  const QVariantList &args,
+						  const std::function<void(QDBusMessage)> &handler);
+	static QHash<QString, QString> activeStatesOf(const QDBusMessage &unitList);
+	QString loadUnit() const;
+	QVariant unitProperty(const QString &unitPath, const QString &property) const;
+	bool subscribe();
+	bool runJob(const QString &method, QVariantList args = {});
+	bool runUnitFileChange(const QString &method, const QVariantList &args);
+	QFuture<bool> runJobAsync(const QString &method);
+	QFuture<bool> runUnitFileChangeAsync(const QString &method, const QVariantList &args);
+	void completeJob(QFutureInterface<bool> futureIface, const QString &result);
+	template <typename T>
+	QFutureInterface<T> createFuture();
+	void setDBusError(const QDBusMessage &reply) const;
 };
 
 Q_DECLARE_LOGGING_CATEGORY(logControl)
@@ -0,0 +1,135 @@
+#include "controlclient_p.h"
+#include "controlserver_p.h"
+
+#include <utility>
+
+#include <QtCore/QDataStream>
+using namespace QtService;
+
+Q_LOGGING_CATEGORY(QtService::logCtrlClient, "qt.service.control.client")
+
+ControlClient::ControlClient(const QDir &runtimeDir, QObject *parent) :
+	QObject{parent},
+	_serverName{ControlServer::serverName(runtimeDir)},
+	_socket{new QLocalSocket{this}}
+{
+	connect(_socket, &QLocalSocket::readyRead,
+			this, &ControlClient::readReplies);
+	connect(_socket, &QLocalSocket::disconnected,
+			this, &ControlClient::disconnected);
+}
+
+ControlClient::~ControlClient()
+{
+	// never leave callers waiting on calls that can no longer complete
+	for (auto &iface : _pending) {
+		iface.reportCanceled();
+		iface.reportFinished();
+	}
+}
+
+QFuture<QVariant> ControlClient::call(const QByteArray &kind, const QVariantList &args)
+{
+	QFutureInterface<QVariant> iface{QFutureInterfaceBase::Started};
+	const auto future = iface.future();
+	if (!ensureConnected()) {
+		iface.reportCanceled();
+		iface.reportFinished();
+		return future;
+	}
+
+	const auto id = _nextId++;
+	_pending.insert(id, iface);
+	QDataStream stream{_socket};
+	stream.setVersion(ControlServer::StreamVersion);
+	stream << id << kind << args;
+	// local sockets take the data right away, so calls do not wait for the next event loop iteration
+	_socket->flush();
+	return future;
+}
+
+bool ControlClient::waitForFinished(const QFuture<QVariant> &future)
+{
+	while (!future.isFinished()) {
+		if (_socket->state() != QLocalSocket::ConnectedState ||
+			!_socket->waitForReadyRead(CallTimeout)) {
+			if (!future.isFinished()) {
+				// the replies are ordered, so a service that does not answer this call blocks all others
+				failPending(tr("The service did not reply within %1 ms").arg(CallTimeout));
+				_socket->abort();
+			}
+			break;
+		}
+	}
+	return !future.isCanceled();
+}
+
+void ControlClient::readReplies()
+{
+	QDataStream stream{_socket};
+	stream.setVersion(ControlServer::StreamVersion);
+	while (_socket->bytesAvailable() > 0) {
+		stream.startTransaction();
+		quint32 id = 0;
+		quint8 status = 0;
+		QVariant result;
+		stream >> id >> status >> result;
+		if (!stream.commitTransaction()) {
+			if (stream.status() == QDataStream::ReadCorruptData) {
+				failPending(tr("Received an invalid reply from the service"));
+				_socket->abort();
+			}
+			return;
+		}
+
+		auto it = _pending.find(id);
+		if (it == _pending.end()) {
+			qCWarning(logCtrlClient) << "Received reply for unknown control request" << id;
+			continue;
+		}
+		if (status == static_cast<quint8>(ControlServer::ReplyStatus::Ok))
+			it->reportResult(result);
+		else {
+			// only this call failed, the connection stays usable for all others
+			emit callFailed(result.toString());
+			it->reportCanceled();
+		}
+		it->reportFinished();
+		_pending.erase(it);
+	}
+}
+
+void ControlClient::disconnected()
+{
+	failPending(tr("The service closed the control connection"));
+}
+
+bool ControlClient::ensureConnected()
+{
+	if (_socket->state() == QLocalSocket::ConnectedState)
+		return true;
+
+	_socket->abort();
+	_socket->connectToServer(_serverName);
+	if (_socket->waitForConnected(CallTimeout)) {
+		qCDebug(logCtrlClient) << "Connected to control server" << _socket->fullServerName();
+		return true;
+	} else {
+		emit callFailed(tr("Failed to connect to the service with error: %1").arg(_socket->errorString()));
+		return false;
+	}
+}
+
+void ControlClient::failPending(const QString &error)
+{
+	if (_pending.isEmpty())
+		return;
+
+	qCWarning(logCtrlClient).noquote() << "Failed" << _pending.size() << "pending control requests:" << error;
+	const auto pending = std::exchange(_pending, {});
+	for (auto iface : pending) {
+		iface.reportCanceled();
+		iface.reportFinished();
+	}
+	emit callFailed(error);
+}
@@ -0,0 +1,53 @@
+#ifndef QTSERVICE_CONTROLCLIENT_P_H
+#define QTSERVICE_CONTROLCLIENT_P_H
+
+#include "qtservice_global.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QDir>
+#include <QtCore/QHash>
+#include <QtCore/QVariant>
+#include <QtCore/QFuture>
+#include <QtCore/QFutureInterface>
+#include <QtCore/QLoggingCategory>
+
+#include <QtNetwork/QLocalSocket>
+
+namespace QtService {
+
+// The control side of the channel served by ControlServer, which keeps one connection for all calls
+class ControlClient : public QObject
+{
+	Q_OBJECT
+
+public:
+	static constexpr int CallTimeout = 30000;
+
+	explicit ControlClient(const QDir &runtimeDir, QObject *parent = nullptr);
+	~ControlClient() override;
+
+	QFuture<QVariant> call(const QByteArray &kind, const QVariantList &args);
+	bool waitForFinished(const QFuture<QVariant> &future);
+
+Q_SIGNALS:
+	void callFailed(const QString &error);
+
+private Q_SLOTS:
+	void readReplies();
+	void disconnected();
+
+private:
+	const QString _serverName;
+	QLocalSocket *_socket;
+	quint32 _nextId = 0;
+	QHash<quint32, QFutureInterface<QVariant>> _pending;
+
+	bool ensureConnected();
+	void failPending(const QString &error);
+};
+
+Q_DECLARE_LOGGING_CATEGORY(logCtrlClient)
+
+}
+
+#endif // QTSERVICE_CONTROLCLIENT_P_H
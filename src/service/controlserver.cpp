@@ -0,0 +1,203 @@
+#include "controlserver_p.h"
+#include "service_p.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstdio>
+#endif
+using namespace QtService;
+
+Q_LOGGING_CATEGORY(QtService::logCtrlServer, "qt.service.control.server")
+
+ControlServer::ControlServer(ServiceBackend *backend, Service *service) :
+	QObject{service},
+	_backend{backend},
+	_server{new QLocalServer{this}},
+	_retryTimer{new QTimer{this}}
+{
+	// the channel can call any callback, so only the user running the service may connect
+	_server->setSocketOptions(QLocalServer::UserAccessOption);
+	connect(_server, &QLocalServer::newConnection,
+			this, &ControlServer::newConnection);
+
+	_retryTimer->setSingleShot(true);
+	_retryTimer->setInterval(RetryInterval);
+	connect(_retryTimer, &QTimer::timeout,
+			this, &ControlServer::start);
+}
+
+QString ControlServer::serverName(const QDir &runtimeDir)
+{
+#ifdef Q_OS_WIN
+	return QStringLiteral(R"__(\\.\pipe\de.skycoder42.QtService.%1.control)__")
+				.arg(runtimeDir.dirName());
+#else
+	return runtimeDir.absoluteFilePath(QStringLiteral("control.socket"));
+#endif
+}
+
+bool ControlServer::start()
+{
+	if (_server->isListening())
+		return true;
+
+	const auto name = serverName(ServicePrivate::runtimeDir());
+#ifdef Q_OS_UNIX
+	// the socket of a running instance, like the previous one during a hot upgrade, is never replaced
+	if (ServicePrivate::isSocketServed(name, ProbeTimeout)) {
+		qCDebug(logCtrlServer) << "Control socket is still served by another instance - retrying in"
+							   << RetryInterval << "ms";
+		_retryTimer->start();
+		return false;
+	}
+
+	// moving the socket into place replaces one left behind by a crashed instance. QLocalServer::close
+	// only removes the private path then, which never touches the socket of an instance that took over
+	const auto listenName = QStringLiteral("%1.%2").arg(name).arg(QCoreApplication::applicationPid());
+	QLocalServer::removeServer(listenName);
+	if (_server->listen(listenName) &&
+		::rename(QFile::encodeName(listenName).constData(), QFile::encodeName(name).constData()) != 0) {
+		qCWarning(logCtrlServer) << "Failed to create control server with error:" << qt_error_string(errno);
+		_server->close();
+		return false;
+	}
+	_socketPath = name;
+	_socketInode = ServicePrivate::socketInode(name);
+#else
+	_server->listen(name);
+#endif
+
+	if (_server->isListening()) {
+		qCDebug(logCtrlServer) << "Listening for control connections on" << name;
+		return true;
+	} else {
+		qCWarning(logCtrlServer) << "Failed to create control server with error:" << _server->errorString();
+		return false;
+	}
+}
+
+void ControlServer::stop()
+{
+	_retryTimer->stop();
+#ifdef Q_OS_UNIX
+	// removed while still listening, so a new instance cannot mistake it for a stale socket in between.
+	// After a hot upgrade, the path already belongs to the new instance and is left alone
+	if (_server->isListening() && _socketInode != 0 && ServicePrivate::socketInode(_socketPath) == _socketInode)
+		QFile::remove(_socketPath);
+	_socketPath.clear();
+	_socketInode = 0;
+#endif
+	_server->close();
+	for (auto socket : findChildren<QLocalSocket*>())
+		socket->disconnectFromServer();
+}
+
+bool ControlServer::isRunning() const
+{
+	return _server->isListening();
+}
+
+void ControlServer::newConnection()
+{
+	while (_server->hasPendingConnections()) {
+		auto socket = _server->nextPendingConnection();
+		qCDebug(logCtrlServer) << "Accepted control connection";
+		socket->setParent(this);
+		connect(socket, &QLocalSocket::readyRead,
+				this, [this, socket]() {
+			readRequests(socket);
+		});
+		connect(socket, &QLocalSocket::disconnected,
+				socket, &QLocalSocket::deleteLater);
+		// requests may already have arrived together with the connection
+		readRequests(socket);
+	}
+}
+
+bool ControlServer::isStreamable(const QVariant &value)
+{
+	// QVariant::save asserts on types without stream operators, so the result is checked before
+	switch (value.userType()) {
+	case QMetaType::UnknownType:
+		return true;
+	case QMetaType::QVariantList:
+		for (const auto &element : value.toList()) {
+			if (!isStreamable(element))
+				return false;
+		}
+		return true;
+	case QMetaType::QVariantMap:
+		for (const auto &element : value.toMap()) {
+			if (!isStreamable(element))
+				return false;
+		}
+		return true;
+	case QMetaType::QVariantHash:
+		for (const auto &element : value.toHash()) {
+			if (!isStreamable(element))
+				return false;
+		}
+		return true;
+	default:
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+	{
+		QByteArray buffer;
+		QDataStream stream{&buffer, QIODevice::WriteOnly};
+		stream.setVersion(StreamVersion);
+		return QMetaType::save(stream, value.userType(), value.constData());
+	}
+#else
+		return value.metaType().hasRegisteredDataStreamOperators();
+#endif
+	}
+}
+
+void ControlServer::readRequests(QLocalSocket *socket)
+{
+	QDataStream stream{socket};
+	stream.setVersion(StreamVersion);
+	while (socket->bytesAvailable() > 0) {
+		stream.startTransaction();
+		quint32 id = 0;
+		QByteArray kind;
+		QVariantList args;
+		stream >> id >> kind >> args;
+		if (!stream.commitTransaction()) {
+			if (stream.status() == QDataStream::ReadCorruptData) {
+				qCWarning(logCtrlServer) << "Received invalid control request - closing connection";
+				socket->abort();
+			}
+			return;
+		}
+
+		// callbacks run on the service thread, just like the ones triggered by the backend
+		qCDebug(logCtrlServer) << "Invoking callback" << kind << "for control request" << id;
+		ServicePrivate::takeCallbackStatus();
+		const auto result = _backend->processServiceCallbackImpl(kind, args);
+		auto status = ServicePrivate::takeCallbackStatus();
+		if (status == ReplyStatus::Ok && !isStreamable(result)) {
+			qCWarning(logCtrlServer) << "Cannot send result of type" << result.typeName()
+									 << "of callback" << kind;
+			status = ReplyStatus::InvalidResult;
+		}
+
+		stream << id << static_cast<quint8>(status);
+		switch (status) {
+		case ReplyStatus::Ok:
+			stream << result;
+			break;
+		case ReplyStatus::UnknownCallback:
+			stream << QVariant{tr("The service has no callback of kind \"%1\"").arg(QString::fromUtf8(kind))};
+			break;
+		case ReplyStatus::InvalidArguments:
+			stream << QVariant{tr("Invalid arguments for callback \"%1\"").arg(QString::fromUtf8(kind))};
+			break;
+		case ReplyStatus::InvalidResult:
+			stream << QVariant{tr("The result of callback \"%1\" cannot be transferred").arg(QString::fromUtf8(kind))};
+			break;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef QTSERVICE_CONTROLSERVER_P_H
+#define QTSERVICE_CONTROLSERVER_P_H
+
+#include "service.h"
+#include "servicebackend.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QDir>
+#include <QtCore/QDataStream>
+#include <QtCore/QTimer>
+#include <QtCore/QLoggingCategory>
+
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+namespace QtService {
+
+// Serves the private control channel of a running service. Each message is a QDataStream record:
+//   request: quint32 id, QByteArray kind, QVariantList args
+//   reply:   quint32 id, quint8 status, QVariant result - or the error message if the status is not Ok
+// Replies are sent in the order of the requests, so clients can send many requests without waiting
+class ControlServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum class ReplyStatus : quint8 {
+		Ok = 0,
+		UnknownCallback = 1,
+		InvalidArguments = 2,
+		InvalidResult = 3
+	};
+
+	// both ends use the same version, regardless of the Qt version they were built with
+	static constexpr int StreamVersion = QDataStream::Qt_5_12;
+	static constexpr int RetryInterval = 500;
+	static constexpr int ProbeTimeout = 1000;
+
+	explicit ControlServer(ServiceBackend *backend, Service *service);
+
+	static QString serverName(const QDir &runtimeDir);
+
+	void stop();
+
+	bool isRunning() const;
+
+public Q_SLOTS:
+	bool start();
+
+private Q_SLOTS:
+	void newConnection();
+
+private:
+	ServiceBackend *_backend;
+	QLocalServer *_server;
+	QTimer *_retryTimer;
+#ifdef Q_OS_UNIX
+	// identifies the socket file, as it is replaced once another instance took over
+	QString _socketPath;
+	quint64 _socketInode = 0;
+#endif
+
+	static bool isStreamable(const QVariant &value);
+
+	void readRequests(QLocalSocket *socket);
+};
+
+Q_DECLARE_LOGGING_CATEGORY(logCtrlServer)
+
+}
+
+#endif // QTSERVICE_CONTROLSERVER_P_H
@@ -2,16 +2,22 @@
 #define QTSERVICE_HELPERTYPES_H
 
 #include <functional>
+#include <memory>
 #include <utility>
 
 #include <QtCore/qvariant.h>
 
+#include "QtService/qtservice_global.h"
+
 namespace QtService {
 namespace __helpertypes {
 
 template <typename T>
 struct fn_info : public fn_info<decltype(&T::operator())> {};
 
+// marks the running callback as failed, as it was called with fewer arguments than it takes
+Q_SERVICE_EXPORT void report_invalid_arguments(int expected, int actual);
+
 template <typename TClass, typename TRet, typename... TArgs>
 struct fn_info<TRet(TClass::*)(TArgs...) const>
 {
@@ -23,7 +29,10 @@ struct fn_info<TRet(TClass::*)(TArgs...) const>
 	template <typename TFunctor, std::size_t... Is>
 	static inline std::function<QVariant(QVariantList)> pack(const std::index_sequence<Is...> &, const TFunctor &fn) {
 		return [fn](const QVariantList &args) {
-			Q_UNUSED(args)
+			if (args.size() < static_cast<int>(sizeof...(TArgs))) {
+				report_invalid_arguments(static_cast<int>(sizeof...(TArgs)), args.size());
+				return QVariant{};
+			}
 			return QVariant::fromValue<TRet>(fn(args[Is].template value<std::decay_t<TArgs>>()...));
 		};
 	}
@@ -40,7 +49,10 @@ struct fn_info<void(TClass::*)(TArgs...) const>
 	template <typename TFunctor, std::size_t... Is>
 	static inline std::function<QVariant(QVariantList)> pack(const std::index_sequence<Is...> &, const TFunctor &fn) {
 		return [fn](const QVariantList &args) {
-			Q_UNUSED(args)
+			if (args.size() < static_cast<int>(sizeof...(TArgs))) {
+				report_invalid_arguments(static_cast<int>(sizeof...(TArgs)), args.size());
+				return QVariant{};
+			}
 			fn(args[Is].template value<std::decay_t<TArgs>>()...);
 			return QVariant{};
 		};
@@ -52,6 +64,49 @@ inline std::function<QVariant(QVariantList)> pack_function(const TFunc &fn) {
 	return fn_info<TFunc>::pack(fn);
 }
 
+template <typename TSignature>
+struct callback_info;
+
+template <typename TRet, typename... TArgs>
+struct callback_info<TRet(TArgs...)>
+{
+	using return_type = TRet;
+	using function_type = std::function<TRet(TArgs...)>;
+
+	// shares the function with the typed registry, so both paths call the same functor
+	struct shared_fn
+	{
+		std::shared_ptr<function_type> fn;
+
+		inline TRet operator()(TArgs... args) const {
+			return (*fn)(std::forward<TArgs>(args)...);
+		}
+	};
+};
+
+template <typename TRet>
+struct variant_result
+{
+	static inline TRet convert(const QVariant &result) {
+		return result.value<TRet>();
+	}
+};
+
+template <>
+struct variant_result<void>
+{
+	static inline void convert(const QVariant &) {}
+};
+
+// interned in the library, so all modules agree on the id of a kind
+Q_SERVICE_EXPORT int intern_callback(const QByteArray &kind);
+
+template <typename TTag>
+inline int callback_id() {
+	static const int id = intern_callback(QByteArray{TTag::kind});
+	return id;
+}
+
 }
 }
 #endif // QTSERVICE_HELPERTYPES_H
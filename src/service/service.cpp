@@ -2,13 +2,27 @@
 #include "service_p.h"
 #include "serviceplugin.h"
 #include "terminalclient_p.h"
+#include <utility>
 #include <QtCore/QFileInfo>
 #include <QtCore/QStandardPaths>
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QtMath>
+#include <QtCore/QMutex>
 #ifdef Q_OS_UNIX
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <linux/memfd.h>
 #endif
 
 #include "servicecontrol.h"
+#include "servicemetrics.h"
 
 #include <QtCore/private/qfactoryloader_p.h>
 
@@ -53,6 +67,164 @@ public:
 	}
 };
 
+// one line of the rules passed to setLoggingRules, in the format of QLoggingCategory::setFilterRules
+struct LoggingRule
+{
+	QByteArray pattern;
+	bool leadingWildcard = false;
+	bool trailingWildcard = false;
+	int type = -1;
+	bool enabled = false;
+
+	bool matches(const QByteArray &category) const {
+		if (leadingWildcard && trailingWildcard)
+			return category.contains(pattern);
+		else if (leadingWildcard)
+			return category.endsWith(pattern);
+		else if (trailingWildcard)
+			return category.startsWith(pattern);
+		else
+			return category == pattern;
+	}
+};
+
+QVector<LoggingRule> parseLoggingRules(const QByteArray &rules)
+{
+	static const QVector<std::pair<QByteArray, QtMsgType>> typeSuffixes {
+		{".debug", QtDebugMsg},
+		{".info", QtInfoMsg},
+		{".warning", QtWarningMsg},
+		{".critical", QtCriticalMsg}
+	};
+
+	QVector<LoggingRule> result;
+	for (auto line : rules.split('\n')) {
+		line = line.trimmed();
+		const auto eqIndex = line.indexOf('=');
+		if (eqIndex == -1)
+			continue;
+		const auto value = line.mid(eqIndex + 1).trimmed();
+		if (value != "true" && value != "false")
+			continue;
+
+		LoggingRule rule;
+		rule.enabled = value == "true";
+		rule.pattern = line.left(eqIndex).trimmed();
+		for (const auto &suffix : typeSuffixes) {
+			if (rule.pattern.endsWith(suffix.first)) {
+				rule.type = suffix.second;
+				rule.pattern.chop(suffix.first.size());
+				break;
+			}
+		}
+		rule.leadingWildcard = rule.pattern.startsWith('*');
+		if (rule.leadingWildcard)
+			rule.pattern.remove(0, 1);
+		rule.trailingWildcard = rule.pattern.endsWith('*');
+		if (rule.trailingWildcard)
+			rule.pattern.chop(1);
+		if (!rule.pattern.contains('*'))
+			result.append(rule);
+	}
+	return result;
+}
+
+// rules set via QLoggingCategory::setFilterRules rank below the ones from the environment. The rules
+// changed at runtime are therefore applied by a filter, on top of whatever the previous filter chose
+QMutex runtimeRulesMutex;
+QVector<LoggingRule> runtimeRules;
+QLoggingCategory::CategoryFilter previousLoggingFilter = nullptr;
+
+void runtimeLoggingFilter(QLoggingCategory *category)
+{
+	QVector<LoggingRule> rules;
+	QLoggingCategory::CategoryFilter previous;
+	{
+		QMutexLocker lock{&runtimeRulesMutex};
+		rules = runtimeRules;
+		previous = previousLoggingFilter;
+	}
+	if (previous)
+		previous(category);
+
+	// later rules take precedence, just like with setFilterRules
+	const QByteArray name {category->categoryName()};
+	for (const auto &rule : qAsConst(rules)) {
+		if (!rule.matches(name))
+			continue;
+		for (const auto type : {QtDebugMsg, QtInfoMsg, QtWarningMsg, QtCriticalMsg}) {
+			if (rule.type == -1 || rule.type == type)
+				category->setEnabled(type, rule.enabled);
+		}
+	}
+}
+
+#ifdef Q_OS_LINUX
+QByteArray readSysFile(const QString &path, bool *ok = nullptr)
+{
+	QFile file{path};
+	const auto opened = file.open(QIODevice::ReadOnly | QIODevice::Text);
+	if (ok)
+		*ok = opened;
+	return opened ? file.readAll().simplified() : QByteArray{};
+}
+
+// returns the smallest quota of the given cgroup and all of its parents, as a limit of a parent applies as well
+template <typename TReader>
+qreal minCgroupQuota(QString path, const QString &root, const TReader &readQuota)
+{
+	qreal quota = 0;
+	for (;;) {
+		const auto value = readQuota(path);
+		if (value > 0 && (quota == 0 || value < quota))
+			quota = value;
+		if (path.size() <= root.size())
+			return quota;
+		path.truncate(std::max<int>(path.lastIndexOf(QLatin1Char('/')), root.size()));
+	}
+}
+
+// returns the number of CPUs the cgroup of the process may use, or 0 if it is not limited
+qreal cgroupCpuQuota()
+{
+	// lines of the form "<id>:<controllers>:<path>", where cgroup v2 has the id 0 and no controllers
+	QString v2Path;
+	QString v1Path;
+	for (const auto &line : readSysFile(QStringLiteral("/proc/self/cgroup")).split(' ')) {
+		const auto fields = line.split(':');
+		if (fields.size() < 3)
+			continue;
+		const auto path = QString::fromUtf8(line.mid(fields[0].size() + fields[1].size() + 2));
+		if (fields[0] == "0" && fields[1].isEmpty())
+			v2Path = path;
+		else if (fields[1].split(',').contains("cpu"))
+			v1Path = path;
+	}
+
+	// cgroup v2: "<quota> <period>" or "max <period>" in the cgroup of the process
+	auto hasV2 = false;
+	const auto v2Root = QStringLiteral("/sys/fs/cgroup");
+	const auto v2Quota = minCgroupQuota(v2Root + v2Path, v2Root, [&](const QString &path) -> qreal {
+		auto ok = false;
+		const auto values = readSysFile(path + QStringLiteral("/cpu.max"), &ok).split(' ');
+		hasV2 = hasV2 || ok;
+		if (ok && values.size() == 2 && values[0] != "max" && values[1].toLongLong() > 0)
+			return values[0].toLongLong() / static_cast<qreal>(values[1].toLongLong());
+		return 0;
+	});
+	if (hasV2)
+		return v2Quota;
+
+	// cgroup v1: the quota is -1 if it is not limited
+	const auto v1Root = QStringLiteral("/sys/fs/cgroup/cpu");
+	return minCgroupQuota(v1Root + v1Path, v1Root, [](const QString &path) -> qreal {
+		const auto quota = readSysFile(path + QStringLiteral("/cpu.cfs_quota_us")).toLongLong();
+		const auto period = readSysFile(path + QStringLiteral("/cpu.cfs_period_us")).toLongLong();
+		return quota > 0 && period > 0 ? quota / static_cast<qreal>(period) : 0;
+	});
+}
+#endif
+
 }
 
 Q_GLOBAL_STATIC_WITH_ARGS(ServiceFactory, loader,
@@ -68,6 +240,7 @@ Service::Service(int &argc, char **argv, int flags) :
 {
 	Q_ASSERT_X(!ServicePrivate::instance, Q_FUNC_INFO, "There can always be only 1 QtService::Service instance at a time");
 	ServicePrivate::instance = this;
+	d->metrics = new ServiceMetrics{this};
 }
 
 int Service::exec()
@@ -129,6 +302,99 @@ int Service::getSocket()
 	return sockets.first();
 }
 
+bool Service::storeSocket(const QByteArray &socketName, int socket)
+{
+	if (socketName.isEmpty() || socket < 0) {
+		qCWarning(logSvc) << "Cannot store the invalid socket" << socket << "with name" << socketName;
+		return false;
+	}
+	return d->backend->storeActivatedSocket(socketName, socket);
+}
+
+bool Service::removeStoredSockets(const QByteArray &socketName)
+{
+	return d->backend->removeStoredSockets(socketName);
+}
+
+bool Service::storeState(const QByteArray &stateName, const QByteArray &data)
+{
+#if defined(Q_OS_LINUX) && defined(SYS_memfd_create)
+	// the state lives in an anonymous file, which is stored like any other socket
+	const auto fd = static_cast<int>(::syscall(SYS_memfd_create, stateName.constData(), MFD_CLOEXEC));
+	if (fd == -1) {
+		qCWarning(logSvc) << "Failed to create state file for" << stateName
+						  << "with error:" << qt_error_string(errno);
+		return false;
+	}
+
+	auto ok = true;
+	for (auto written = 0; ok && written < data.size();) {
+		const auto res = ::write(fd, data.constData() + written, static_cast<size_t>(data.size() - written));
+		if (res > 0)
+			written += static_cast<int>(res);
+		else if (res == -1 && errno == EINTR)
+			continue;
+		else {
+			qCWarning(logSvc) << "Failed to write state file for" << stateName
+							  << "with error:" << qt_error_string(errno);
+			ok = false;
+		}
+	}
+
+	// replace, not accumulate, the states of previous instances
+	if (ok) {
+		removeStoredSockets(stateName);
+		ok = storeSocket(stateName, fd);
+	}
+	::close(fd);  // the service manager holds its own copy
+	return ok;
+#else
+	Q_UNUSED(stateName)
+	Q_UNUSED(data)
+	return false;
+#endif
+}
+
+QByteArray Service::restoreState(const QByteArray &stateName)
+{
+#ifdef Q_OS_UNIX
+	const auto sockets = getSockets(stateName);
+	if (sockets.isEmpty())
+		return {};
+
+	// the file is shared with the service manager, so read it without moving the file offset
+	const auto fd = sockets.last();
+	QByteArray data;
+	char buffer[4096];
+	for (;;) {
+		const auto res = ::pread(fd, buffer, sizeof(buffer), data.size());
+		if (res > 0)
+			data.append(buffer, static_cast<int>(res));
+		else if (res == -1 && errno == EINTR)
+			continue;
+		else if (res == 0)
+			return data;
+		else {
+			qCWarning(logSvc) << "Failed to read state file for" << stateName
+							  << "with error:" << qt_error_string(errno);
+			return {};
+		}
+	}
+#else
+	Q_UNUSED(stateName)
+	return {};
+#endif
+}
+
+void Service::reportProgress(const QString &status, int extendTimeoutMsecs)
+{
+	if (!d->backend) {
+		qCWarning(logSvc) << "Cannot report progress before the service has been started";
+		return;
+	}
+	d->backend->reportProgress(status, std::max(extendTimeoutMsecs, 0));
+}
+
 QString Service::backend() const
 {
 	return d->backendProvider;
@@ -159,6 +425,90 @@ bool Service::startWithTerminal() const
 	return d->startWithTerminal;
 }
 
+QList<int> Service::getWorkerSockets(int worker, const QByteArray &socketName)
+{
+	const auto count = d->workers.size();
+	if (worker < 0 || worker >= count) {
+		qCWarning(logSvc) << "Cannot get sockets for invalid worker" << worker;
+		return {};
+	}
+
+	QList<int> workerSockets;
+#ifdef Q_OS_UNIX
+	const auto sockets = getSockets(socketName);
+	if (sockets.size() >= count) {
+		// enough sockets to give each worker its own share
+		for (auto i = worker; i < sockets.size(); i += count)
+			workerSockets.append(::fcntl(sockets[i], F_DUPFD_CLOEXEC, 0));
+	} else {
+		// the first worker serves the original socket, all others get their own if port reuse is enabled
+		for (const auto socket : sockets) {
+			const auto fd = worker > 0 ? ServicePrivate::openReusePortSocket(socket) : -1;
+			workerSockets.append(fd != -1 ? fd : ::fcntl(socket, F_DUPFD_CLOEXEC, 0));
+		}
+	}
+	if (workerSockets.removeAll(-1) > 0)
+		qCWarning(logSvc) << "Failed to duplicate sockets for worker" << worker << "with error:" << qt_error_string(errno);
+#else
+	Q_UNUSED(socketName)
+#endif
+	return workerSockets;
+}
+
+int Service::workerCount() const
+{
+	return d->workers.size();
+}
+
+ServiceMetrics *Service::metrics() const
+{
+	return d->metrics;
+}
+
+bool Service::isThreadedTerminal() const
+{
+	return d->terminalThreaded;
+}
+
+int Service::maxTerminals() const
+{
+	return d->maxTerminals;
+}
+
+qint64 Service::terminalOutputLimit() const
+{
+	return d->terminalOutputLimit;
+}
+
+Service::OverflowPolicy Service::terminalOverflowPolicy() const
+{
+	return d->terminalOverflowPolicy;
+}
+
+qint64 Service::broadcastHistorySize() const
+{
+	return d->broadcastHistorySize;
+}
+
+int Service::workerThreads() const
+{
+	return d->workerThreads;
+}
+
+void Service::addBroadcastTerminal(Terminal *terminal, bool sendHistory)
+{
+	if (d->termServer)
+		d->termServer->addBroadcastTerminal(terminal, sendHistory);
+	else
+		qCWarning(logSvc) << "Cannot add a broadcast terminal without an active terminal server";
+}
+
+void Service::removeBroadcastTerminal(Terminal *terminal)
+{
+	if (d->termServer)
+		d->termServer->removeBroadcastTerminal(terminal);
+}
+
 void Service::quit()
 {
 	d->backend->quitService();
@@ -168,6 +518,12 @@ void Service::reload()
 	d->backend->reloadService();
 }
 
+void Service::broadcast(const QByteArray &data)
+{
+	if (d->termServer)
+		d->termServer->broadcast(data);
+}
+
 void Service::setTerminalActive(bool terminalActive)
 {
 	if (d->terminalActive == terminalActive)
@@ -210,6 +566,70 @@ void Service::setStartWithTerminal(bool startWithTerminal)
 	emit startWithTerminalChanged(d->startWithTerminal, {});
 }
 
+void Service::setThreadedTerminal(bool threadedTerminal)
+{
+	if (d->terminalThreaded == threadedTerminal)
+		return;
+
+	if(d->termServer && d->termServer->isRunning())
+		qCWarning(logSvc) << "Chaning the threadedTerminal property will not have any effect until you disable and reenable the terminal server";
+	d->terminalThreaded = threadedTerminal;
+	emit threadedTerminalChanged(d->terminalThreaded, {});
+}
+
+void Service::setMaxTerminals(int maxTerminals)
+{
+	maxTerminals = std::max(maxTerminals, 0);
+	if (d->maxTerminals == maxTerminals)
+		return;
+
+	d->maxTerminals = maxTerminals;
+	emit maxTerminalsChanged(d->maxTerminals, {});
+}
+
+void Service::setTerminalOutputLimit(qint64 terminalOutputLimit)
+{
+	terminalOutputLimit = std::max<qint64>(terminalOutputLimit, 0);
+	if (d->terminalOutputLimit == terminalOutputLimit)
+		return;
+
+	d->terminalOutputLimit = terminalOutputLimit;
+	emit terminalOutputLimitChanged(d->terminalOutputLimit, {});
+}
+
+void Service::setTerminalOverflowPolicy(Service::OverflowPolicy terminalOverflowPolicy)
+{
+	if (d->terminalOverflowPolicy == terminalOverflowPolicy)
+		return;
+
+	d->terminalOverflowPolicy = terminalOverflowPolicy;
+	emit terminalOverflowPolicyChanged(d->terminalOverflowPolicy, {});
+}
+
+void Service::setBroadcastHistorySize(qint64 broadcastHistorySize)
+{
+	broadcastHistorySize = std::max<qint64>(broadcastHistorySize, 0);
+	if (d->broadcastHistorySize == broadcastHistorySize)
+		return;
+
+	d->broadcastHistorySize = broadcastHistorySize;
+	if (d->termServer)
+		d->termServer->trimBroadcastHistory();
+	emit broadcastHistorySizeChanged(d->broadcastHistorySize, {});
+}
+
+void Service::setWorkerThreads(int workerThreads)
+{
+	workerThreads = std::max(workerThreads, -1);
+	if (d->workerThreads == workerThreads)
+		return;
+
+	if (!d->workers.isEmpty())
+		qCWarning(logSvc) << "Changing the workerThreads property will not have any effect until the service is restarted";
+	d->workerThreads = workerThreads;
+	emit workerThreadsChanged(d->workerThreads, {});
+}
+
 void Service::terminalConnected(Terminal *terminal)
 {
 	qCWarning(logSvc) << "Terminal connected but was not handled - disconnecting it again";
@@ -242,6 +662,16 @@ Service::CommandResult Service::onResume()
 	return CommandResult::Completed;
 }
 
+void Service::onWorkerStart(int worker)
+{
+	Q_UNUSED(worker)
+}
+
+void Service::onWorkerStop(int worker)
+{
+	Q_UNUSED(worker)
+}
+
 QVariant Service::onCallback(const QByteArray &kind, const QVariantList &args)
 {
 	if (d->callbacks.contains(kind)) {
@@ -249,6 +679,7 @@ QVariant Service::onCallback(const QByteArray &kind, const QVariantList &args)
 		return d->callbacks[kind](args);
 	} else {
 		qCWarning(logSvc) << "Unhandeled callback of kind" << kind;
+		d->callbackStatus = ControlServer::ReplyStatus::UnknownCallback;
 		return {};
 	}
 }
@@ -266,11 +697,54 @@ void Service::addCallback(const QByteArray &kind, const std::function<QVariant (
 	qCDebug(logSvc) << "Registered dynamic callback for name" << kind;
 }
 
-Service::~Service() = default;
+void Service::setTypedCallback(int id, const std::type_info &signature, std::shared_ptr<void> fn)
+{
+	if (d->typedCallbacks.size() <= id)
+		d->typedCallbacks.resize(id + 1);
+	d->typedCallbacks[id] = {&signature, std::move(fn)};
+}
+
+void *Service::typedCallback(int id, const std::type_info &signature) const
+{
+	if (id >= d->typedCallbacks.size() || !d->typedCallbacks.at(id).fn)
+		return nullptr;
+	const auto &callback = d->typedCallbacks.at(id);
+	if (*callback.signature != signature) {
+		qCWarning(logSvc) << "Typed callback with id" << id << "was added with the signature"
+						  << callback.signature->name() << "but is invoked with" << signature.name()
+						  << "- using the callback of its kind instead";
+		return nullptr;
+	}
+	return callback.fn.get();
+}
+
+int QtService::__helpertypes::intern_callback(const QByteArray &kind)
+{
+	static QMutex mutex;
+	static QHash<QByteArray, int> ids;
+	QMutexLocker lock{&mutex};
+	auto it = ids.find(kind);
+	if (it == ids.end())
+		it = ids.insert(kind, ids.size());
+	return *it;
+}
+
+void QtService::__helpertypes::report_invalid_arguments(int expected, int actual)
+{
+	qCWarning(logSvc) << "Callback expects" << expected << "arguments, but only got" << actual;
+	ServicePrivate::reportCallbackStatus(ControlServer::ReplyStatus::InvalidArguments);
+}
+
+Service::~Service()
+{
+	// the hooks cannot be called anymore, as the derived service is already gone
+	d->stopWorkers(false);
+}
 
 // ------------- Private Implementation -------------
 
 QPointer<Service> ServicePrivate::instance{nullptr};
+const QString ServicePrivate::LoggingRulesFile = QStringLiteral("logging.rules");
 
 ServicePrivate::ServicePrivate(Service *q_ptr, int &argc, char **argv, int flags) :
 	argc{argc},
@@ -330,6 +804,69 @@ QDir ServicePrivate::runtimeDir(const QString &serviceName)
 		return QDir::current();
 }
 
+void ServicePrivate::startControlServer()
+{
+	if (!controlServer)
+		controlServer = new ControlServer{backend, q};
+	controlServer->start();
+}
+
+void ServicePrivate::stopControlServer()
+{
+	if (controlServer)
+		controlServer->stop();
+}
+
+void ServicePrivate::startLoggingRules()
+{
+	const auto dir = runtimeDir();
+	// rules from a previous run must not be applied again
+	QFile::remove(dir.absoluteFilePath(LoggingRulesFile));
+	if (!loggingRulesWatcher) {
+		loggingRulesWatcher = new QFileSystemWatcher{q};
+		// controls replace the file, so changes show up as changes of the directory
+		QObject::connect(loggingRulesWatcher, &QFileSystemWatcher::directoryChanged,
+						 q, [this]() {
+			applyLoggingRules();
+		});
+	}
+	if (!loggingRulesWatcher->addPath(dir.absolutePath()))
+		qCWarning(logSvc) << "Failed to watch the runtime directory - logging rules cannot be changed at runtime";
+}
+
+void ServicePrivate::stopLoggingRules()
+{
+	if (loggingRulesWatcher && !loggingRulesWatcher->directories().isEmpty())
+		loggingRulesWatcher->removePaths(loggingRulesWatcher->directories());
+}
+
+void ServicePrivate::applyLoggingRules()
+{
+	QFile rulesFile{runtimeDir().absoluteFilePath(LoggingRulesFile)};
+	QByteArray rules;
+	if (rulesFile.open(QIODevice::ReadOnly | QIODevice::Text))
+		rules = rulesFile.readAll();
+	if (rules == loggingRules)
+		return;
+
+	loggingRules = rules;
+	qCInfo(logSvc).noquote() << "Applying logging rules:" << (rules.isEmpty() ? QByteArrayLiteral("<none>") : rules);
+	{
+		QMutexLocker lock{&runtimeRulesMutex};
+		runtimeRules = parseLoggingRules(rules);
+	}
+	// installing the filter evaluates all categories again
+	const auto previous = QLoggingCategory::installFilter(runtimeLoggingFilter);
+	if (previous != runtimeLoggingFilter) {
+		{
+			QMutexLocker lock{&runtimeRulesMutex};
+			previousLoggingFilter = previous;
+		}
+		// the first evaluation ran without the previous filter, which is known only now
+		QLoggingCategory::installFilter(runtimeLoggingFilter);
+	}
+}
+
 void ServicePrivate::startTerminals()
 {
 	if (!terminalActive || !isRunning)
@@ -340,7 +877,7 @@ void ServicePrivate::startTerminals()
 		QObject::connect(termServer, &TerminalServer::terminalConnected,
 						 q, &Service::terminalConnected);
 	}
-	terminalActive = termServer->start(terminalGlobal);
+	terminalActive = termServer->start(terminalGlobal, terminalThreaded);
 }
 
 void ServicePrivate::stopTerminals()
@@ -348,3 +885,140 @@ void ServicePrivate::stopTerminals()
 	if (termServer)
 		termServer->stop();
 }
+
+void ServicePrivate::reportCallbackStatus(ControlServer::ReplyStatus status)
+{
+	if (instance)
+		instance->d->callbackStatus = status;
+}
+
+ControlServer::ReplyStatus ServicePrivate::takeCallbackStatus()
+{
+	return instance ?
+				std::exchange(instance->d->callbackStatus, ControlServer::ReplyStatus::Ok) :
+				ControlServer::ReplyStatus::Ok;
+}
+
+int ServicePrivate::defaultWorkerThreads()
+{
+	auto count = QThread::idealThreadCount();
+#ifdef Q_OS_LINUX
+	// containers often limit the CPU time, not the number of CPUs the process can see
+	const auto quota = cgroupCpuQuota();
+	if (quota > 0)
+		count = std::min(count, qCeil(quota));
+#endif
+	return std::max(count, 1);
+}
+
+int ServicePrivate::openReusePortSocket(int socket)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+	int value = 0;
+	socklen_t valueSize = sizeof(value);
+	if (::getsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &value, &valueSize) != 0 || !value)
+		return -1;
+	int type = 0;
+	valueSize = sizeof(type);
+	if (::getsockopt(socket, SOL_SOCKET, SO_TYPE, &type, &valueSize) != 0)
+		return -1;
+	sockaddr_storage address {};
+	socklen_t addressSize = sizeof(address);
+	if (::getsockname(socket, reinterpret_cast<sockaddr*>(&address), &addressSize) != 0 ||
+		(address.ss_family != AF_INET && address.ss_family != AF_INET6))
+		return -1;
+
+	// a new socket bound to the same address, so the kernel balances the connections between them
+	const auto fd = ::socket(address.ss_family, type, 0);
+	if (fd == -1)
+		return -1;
+	::fcntl(fd, F_SETFD, FD_CLOEXEC);
+	const int on = 1;
+	::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+	if (address.ss_family == AF_INET6) {
+		valueSize = sizeof(value);
+		if (::getsockopt(socket, IPPROTO_IPV6, IPV6_V6ONLY, &value, &valueSize) == 0)
+			::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &value, sizeof(value));
+	}
+	if (::bind(fd, reinterpret_cast<sockaddr*>(&address), addressSize) != 0 ||
+		(type == SOCK_STREAM && ::listen(fd, SOMAXCONN) != 0)) {
+		::close(fd);
+		return -1;
+	}
+	return fd;
+#else
+	Q_UNUSED(socket)
+	return -1;
+#endif
+}
+
+#ifdef Q_OS_UNIX
+bool ServicePrivate::isSocketServed(const QString &name, int timeout)
+{
+	// only a socket nobody accepts connections on is stale
+	QLocalSocket probe;
+	probe.connectToServer(name);
+	return probe.waitForConnected(timeout);
+}
+
+quint64 ServicePrivate::socketInode(const QString &path)
+{
+	struct stat info;
+	if (::stat(QFile::encodeName(path).constData(), &info) != 0 || !S_ISSOCK(info.st_mode))
+		return 0;
+	return static_cast<quint64>(info.st_ino);
+}
+#endif
+
+void ServicePrivate::startWorkers()
+{
+	if (workerThreads == 0 || !workers.isEmpty())
+		return;
+
+	const auto count = workerThreads < 0 ? defaultWorkerThreads() : workerThreads;
+	qCDebug(logSvc) << "Starting" << count << "worker threads";
+	// all threads are created first, so the hooks can already rely on Service::workerCount
+	workers.reserve(count);
+	for (auto i = 0; i < count; ++i) {
+		const auto thread = new QThread{q};
+		thread->setObjectName(QStringLiteral("worker-%1").arg(i));
+		QObject::connect(thread, &QThread::started,
+						 thread, [this, i]() {
+			q->onWorkerStart(i);
+		}, Qt::DirectConnection);
+		workers.append(thread);
+	}
+	for (const auto thread : qAsConst(workers)) {
+		thread->start();
+		metrics->addMonitoredThread(thread);
+	}
+}
+
+void ServicePrivate::stopWorkers(bool notify)
+{
+	if (workers.isEmpty())
+		return;
+
+	qCDebug(logSvc) << "Stopping" << workers.size() << "worker threads";
+	for (auto i = 0; i < workers.size(); ++i) {
+		const auto thread = workers[i];
+		metrics->removeMonitoredThread(thread);
+		if (notify && thread->isRunning()) {
+			// runs the hook as the last event of the worker, so everything it created is still alive
+			const auto context = new QObject{};
+			context->moveToThread(thread);
+			QMetaObject::invokeMethod(context, [this, i, context]() {
+				q->onWorkerStop(i);
+				delete context;
+				QThread::currentThread()->quit();
+			}, Qt::QueuedConnection);
+		} else
+			thread->quit();
+	}
+	for (const auto thread : qAsConst(workers)) {
+		thread->wait();
+		delete thread;
+	}
+	workers.clear();
+}
@@ -2,6 +2,8 @@
 #define QTSERVICE_SERVICE_H
 
 #include <functional>
+#include <memory>
+#include <typeinfo>
 
 #include <QtCore/qobject.h>
 #include <QtCore/qcoreapplication.h>
@@ -18,9 +20,19 @@
 namespace QtService {
 
 class Terminal;
+class ServiceMetrics;
 class TerminalClient;
 class ServiceBackend;
 class ServicePrivate;
+
+//! The base class of tags that identify a typed callback, see Service::addTypedCallback
+template <typename TSignature>
+struct CallbackTag
+{
+	//! The signature of the callbacks identified by the tag
+	using Signature = TSignature;
+};
+
 //! The main interface to implement to create a service
 class Q_SERVICE_EXPORT Service : public QObject
 {
@@ -39,6 +51,18 @@ class Q_SERVICE_EXPORT Service : public QObject
 	Q_PROPERTY(bool globalTerminal READ isGlobalTerminal WRITE setGlobalTerminal NOTIFY globalTerminalChanged)
 	//! Specifies whether terminals should try to start the service if it is not running
 	Q_PROPERTY(bool startWithTerminal READ startWithTerminal WRITE setStartWithTerminal NOTIFY startWithTerminalChanged)
+	//! Specifies whether the terminal sockets should be served from a separate I/O thread
+	Q_PROPERTY(bool threadedTerminal READ isThreadedTerminal WRITE setThreadedTerminal NOTIFY threadedTerminalChanged)
+	//! The maximum number of terminals that can be connected at the same time. 0 means unlimited
+	Q_PROPERTY(int maxTerminals READ maxTerminals WRITE setMaxTerminals NOTIFY maxTerminalsChanged)
+	//! The default Terminal::outputLimit for newly connected terminals
+	Q_PROPERTY(qint64 terminalOutputLimit READ terminalOutputLimit WRITE setTerminalOutputLimit NOTIFY terminalOutputLimitChanged)
+	//! The default Terminal::overflowPolicy for newly connected terminals
+	Q_PROPERTY(OverflowPolicy terminalOverflowPolicy READ terminalOverflowPolicy WRITE setTerminalOverflowPolicy NOTIFY terminalOverflowPolicyChanged)
+	//! The amount of recently broadcasted data to replay to newly added broadcast terminals
+	Q_PROPERTY(qint64 broadcastHistorySize READ broadcastHistorySize WRITE setBroadcastHistorySize NOTIFY broadcastHistorySizeChanged)
+	//! The number of worker threads with their own event loop the service runs, -1 for automatic or 0 for none
+	Q_PROPERTY(int workerThreads READ workerThreads WRITE setWorkerThreads NOTIFY workerThreadsChanged)
 
 public:
 	//! Indicates whether a service command has finished or needs to run asynchronously
@@ -60,6 +84,14 @@ public:
 	};
 	Q_ENUM(TerminalMode)
 
+	//! What a terminal does if a client does not read its output fast enough
+	enum class OverflowPolicy {
+		Block, //!< Writing blocks until the client has read enough data
+		DropOldest, //!< Output that has not been sent yet is discarded, oldest first
+		Disconnect //!< The terminal is disconnected
+	};
+	Q_ENUM(OverflowPolicy)
+
 	//! Constructs a new service from the main arguments
 	explicit Service(int &argc, char **argv, int = QCoreApplication::ApplicationFlags);
 	~Service() override;
@@ -74,6 +106,27 @@ public:
 	Q_INVOKABLE QList<int> getSockets(const QByteArray &socketName);
 	//! Returns the default activated socket, if one exists
 	Q_INVOKABLE int getSocket();
+	//! Hands a socket over to the service manager, to be passed to the next instance of the service
+	Q_INVOKABLE bool storeSocket(const QByteArray &socketName, int socket);
+	//! Drops all sockets previously stored with the given name from the service manager
+	Q_INVOKABLE bool removeStoredSockets(const QByteArray &socketName);
+	//! Keeps the given data for the next instance of the service
+	Q_INVOKABLE bool storeState(const QByteArray &stateName, const QByteArray &data);
+	//! Returns the data stored by a previous instance of the service
+	Q_INVOKABLE QByteArray restoreState(const QByteArray &stateName);
+	//! Reports the progress of a pending command, optionally asking for more time to complete it
+	Q_INVOKABLE void reportProgress(const QString &status, int extendTimeoutMsecs = 0);
+	//! Returns the activated sockets of the given name that the given worker thread should serve
+	Q_INVOKABLE QList<int> getWorkerSockets(int worker, const QByteArray &socketName = {});
+	//! Returns the number of worker threads that are currently running
+	int workerCount() const;
+	//! Returns the timing statistics of the service commands and callbacks
+	ServiceMetrics *metrics() const;
+
+	//! Adds a terminal to the receivers of broadcast(), optionally replaying the broadcast history
+	Q_INVOKABLE void addBroadcastTerminal(QtService::Terminal *terminal, bool sendHistory = true);
+	//! Removes a terminal from the receivers of broadcast()
+	Q_INVOKABLE void removeBroadcastTerminal(QtService::Terminal *terminal);
 
 	//! @readAcFn{Service::backend}
 	QString backend() const;
@@ -87,6 +140,25 @@ public:
 	bool isGlobalTerminal() const;
 	//! @readAcFn{Service::startWithTerminal}
 	bool startWithTerminal() const;
+	//! @readAcFn{Service::threadedTerminal}
+	bool isThreadedTerminal() const;
+	//! @readAcFn{Service::maxTerminals}
+	int maxTerminals() const;
+	//! @readAcFn{Service::terminalOutputLimit}
+	qint64 terminalOutputLimit() const;
+	//! @readAcFn{Service::terminalOverflowPolicy}
+	OverflowPolicy terminalOverflowPolicy() const;
+	//! @readAcFn{Service::broadcastHistorySize}
+	qint64 broadcastHistorySize() const;
+	//! @readAcFn{Service::workerThreads}
+	int workerThreads() const;
+
+	//! Checks whether a typed callback was added for the given tag
+	template <typename TTag>
+	bool hasTypedCallback() const;
+	//! Invokes the typed callback of the given tag without converting its arguments to variants
+	template <typename TTag, typename... TArgs>
+	typename __helpertypes::callback_info<typename TTag::Signature>::return_type invokeTypedCallback(TArgs&&... args);
 
 public Q_SLOTS:
 	//! Perform a graceful service stop
@@ -94,6 +166,9 @@ public Q_SLOTS:
 	//! Perform a reload command
 	void reload();
 
+	//! Writes the given data to all broadcast terminals
+	void broadcast(const QByteArray &data);
+
 	//! @writeAcFn{Service::terminalActive}
 	void setTerminalActive(bool terminalActive);
 	//! @writeAcFn{Service::terminalMode}
@@ -102,6 +177,18 @@ public Q_SLOTS:
 	void setGlobalTerminal(bool globalTerminal);
 	//! @writeAcFn{Service::startWithTerminal}
 	void setStartWithTerminal(bool startWithTerminal);
+	//! @writeAcFn{Service::threadedTerminal}
+	void setThreadedTerminal(bool threadedTerminal);
+	//! @writeAcFn{Service::maxTerminals}
+	void setMaxTerminals(int maxTerminals);
+	//! @writeAcFn{Service::terminalOutputLimit}
+	void setTerminalOutputLimit(qint64 terminalOutputLimit);
+	//! @writeAcFn{Service::terminalOverflowPolicy}
+	void setTerminalOverflowPolicy(OverflowPolicy terminalOverflowPolicy);
+	//! @writeAcFn{Service::broadcastHistorySize}
+	void setBroadcastHistorySize(qint64 broadcastHistorySize);
+	//! @writeAcFn{Service::workerThreads}
+	void setWorkerThreads(int workerThreads);
 
 Q_SIGNALS:
 	//! Must be emitted when starting was completed if onStart returned OperationPending
@@ -123,6 +210,18 @@ Q_SIGNALS:
 	void globalTerminalChanged(bool globalTerminal, QPrivateSignal);
 	//! @notifyAcFn{Service::startWithTerminal}
 	void startWithTerminalChanged(bool startWithTerminal, QPrivateSignal);
+	//! @notifyAcFn{Service::threadedTerminal}
+	void threadedTerminalChanged(bool threadedTerminal, QPrivateSignal);
+	//! @notifyAcFn{Service::maxTerminals}
+	void maxTerminalsChanged(int maxTerminals, QPrivateSignal);
+	//! @notifyAcFn{Service::terminalOutputLimit}
+	void terminalOutputLimitChanged(qint64 terminalOutputLimit, QPrivateSignal);
+	//! @notifyAcFn{Service::terminalOverflowPolicy}
+	void terminalOverflowPolicyChanged(OverflowPolicy terminalOverflowPolicy, QPrivateSignal);
+	//! @notifyAcFn{Service::broadcastHistorySize}
+	void broadcastHistorySizeChanged(qint64 broadcastHistorySize, QPrivateSignal);
+	//! @notifyAcFn{Service::workerThreads}
+	void workerThreadsChanged(int workerThreads, QPrivateSignal);
 
 protected Q_SLOTS:
 	//! Is called by the backend for every newly connected terminal
@@ -143,6 +242,11 @@ protected:
 	//! Is called by the backend to resume the service
 	virtual CommandResult onResume();
 
+	//! Is called on each worker thread after the service has been started
+	virtual void onWorkerStart(int worker);
+	//! Is called on each worker thread before the service is stopped
+	virtual void onWorkerStop(int worker);
+
 	//! Is called by the backend if a platform specific callback was triggered
 	virtual QVariant onCallback(const QByteArray &kind, const QVariantList &args);
 
@@ -157,6 +261,9 @@ protected:
 	//! @copybrief Service::addCallback(const QByteArray &, const std::function<QVariant(QVariantList)> &)
 	template <typename TClass, typename TReturn, typename... TArgs>
 	void addCallback(const QByteArray &kind, TReturn(TClass::*fn)(TArgs...), std::enable_if_t<std::is_base_of<QtService::Service, TClass>::value, void*> = nullptr);
+	//! Adds a callback for the given tag that can be invoked via invokeTypedCallback
+	template <typename TTag, typename TFunction>
+	void addTypedCallback(TFunction &&fn);
 
 private:
 	friend class QtService::ServiceBackend;
@@ -164,6 +271,9 @@ private:
 	friend class QtService::TerminalClient;
 
 	QScopedPointer<ServicePrivate> d;
+
+	void setTypedCallback(int id, const std::type_info &signature, std::shared_ptr<void> fn);
+	void *typedCallback(int id, const std::type_info &signature) const;
 };
 
 //! Overload for qHash
@@ -174,6 +284,10 @@ Q_DECL_CONST_FUNCTION Q_DECL_CONSTEXPR inline uint qHash(QtService::Service::Com
 Q_DECL_CONST_FUNCTION Q_DECL_CONSTEXPR inline uint qHash(QtService::Service::TerminalMode key, uint seed = 0) Q_DECL_NOTHROW {
     return static_cast<uint>(::qHash(static_cast<int>(key), seed));
 }
+//! Overload for qHash
+Q_DECL_CONST_FUNCTION Q_DECL_CONSTEXPR inline uint qHash(QtService::Service::OverflowPolicy key, uint seed = 0) Q_DECL_NOTHROW {
+    return static_cast<uint>(::qHash(static_cast<int>(key), seed));
+}
 
 template<typename TFunction>
 void Service::addCallback(const QByteArray &kind, const TFunction &fn)
@@ -190,6 +304,37 @@ void Service::addCallback(const QByteArray &kind, TReturn (TClass::*fn)(TArgs...
 	});
 }
 
+template<typename TTag>
+bool Service::hasTypedCallback() const
+{
+	return typedCallback(__helpertypes::callback_id<TTag>(), typeid(typename TTag::Signature)) != nullptr;
+}
+
+template<typename TTag, typename... TArgs>
+typename __helpertypes::callback_info<typename TTag::Signature>::return_type Service::invokeTypedCallback(TArgs&&... args)
+{
+	using TInfo = __helpertypes::callback_info<typename TTag::Signature>;
+	using TReturn = typename TInfo::return_type;
+	// the id only depends on the kind, so the callback is only used if it was added with the same signature
+	const auto fn = static_cast<typename TInfo::function_type*>(typedCallback(__helpertypes::callback_id<TTag>(), typeid(typename TTag::Signature)));
+	if (fn)
+		return (*fn)(std::forward<TArgs>(args)...);
+
+	// without a typed callback, the kind may still be handled by onCallback
+	return __helpertypes::variant_result<TReturn>::convert(onCallback(QByteArray{TTag::kind}, {QVariant::fromValue(std::decay_t<TArgs>(args))...}));
+}
+
+template<typename TTag, typename TFunction>
+void Service::addTypedCallback(TFunction &&fn)
+{
+	using TInfo = __helpertypes::callback_info<typename TTag::Signature>;
+	auto typedFn = std::make_shared<typename TInfo::function_type>(std::forward<TFunction>(fn));
+	Q_ASSERT_X(*typedFn, Q_FUNC_INFO, "fn must be a valid function");
+	// backends and controls only know callbacks by their kind, so they keep using the variant path
+	addCallback(QByteArray{TTag::kind}, typename TInfo::shared_fn{typedFn});
+	setTypedCallback(__helpertypes::callback_id<TTag>(), typeid(typename TTag::Signature), std::move(typedFn));
+}
+
 }
 
 //! A define for the service instance for easy use, see QtService::Service::instance
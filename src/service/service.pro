@@ -13,18 +13,30 @@ HEADERS += \
 	servicebackend_p.h \
 	servicecontrol.h \
 	servicecontrol_p.h \
+	servicegroup.h \
+	servicegroup_p.h \
+	servicemetrics.h \
+	servicemetrics_p.h \
 	terminal.h \
 	terminal_p.h \
 	terminalserver_p.h \
-	terminalclient_p.h
+	terminalworker_p.h \
+	terminalclient_p.h \
+	controlserver_p.h \
+	controlclient_p.h
 
 SOURCES += \
 	service.cpp \
 	servicebackend.cpp \
 	servicecontrol.cpp \
+	servicegroup.cpp \
+	servicemetrics.cpp \
 	terminal.cpp \
 	terminalserver.cpp \
+	terminalworker.cpp \
 	terminalclient.cpp \
+	controlserver.cpp \
+	controlclient.cpp \
 	serviceplugin.cpp
 
 MODULE_PLUGIN_TYPES = servicebackends
@@ -4,8 +4,11 @@
 #include "service.h"
 #include "servicebackend.h"
 #include "terminalserver_p.h"
+#include "controlserver_p.h"
 
 #include <QtCore/QPointer>
+#include <QtCore/QThread>
+#include <QtCore/QFileSystemWatcher>
 #include <QtCore/QLoggingCategory>
 
 namespace QtService {
@@ -24,6 +27,7 @@ public:
 	static QDir runtimeDir(const QString &serviceName = QCoreApplication::applicationName());
 
 	static QPointer<Service> instance;
+	static const QString LoggingRulesFile;
 
 	int &argc;
 	char **argv;
@@ -32,6 +36,15 @@ public:
 	QString backendProvider;
 	ServiceBackend *backend = nullptr;
 	QHash<QByteArray, std::function<QVariant(QVariantList)>> callbacks;
+	// the outcome of the callback that ran last, so the control server can tell failures from null results
+	ControlServer::ReplyStatus callbackStatus = ControlServer::ReplyStatus::Ok;
+	// tags of different signatures can share a kind, so the signature is kept to check it on each call
+	struct TypedCallback {
+		const std::type_info *signature = nullptr;
+		std::shared_ptr<void> fn;
+	};
+	// indexed by the interned id of the tag, see __helpertypes::callback_id
+	QVector<TypedCallback> typedCallbacks;
 
 	bool isRunning = false;
 	bool wasPaused = false;
@@ -39,12 +52,43 @@ public:
 	Service::TerminalMode terminalMode = Service::TerminalMode::ReadWriteActive;
 	bool terminalGlobal = false;
 	bool startWithTerminal = false;
+	bool terminalThreaded = false;
+	int maxTerminals = 0;
+	qint64 terminalOutputLimit = 0;
+	Service::OverflowPolicy terminalOverflowPolicy = Service::OverflowPolicy::Block;
+	qint64 broadcastHistorySize = 0;
+	int workerThreads = 0;
 
 	TerminalServer *termServer = nullptr;
+	ControlServer *controlServer = nullptr;
+	ServiceMetrics *metrics = nullptr;
+	QFileSystemWatcher *loggingRulesWatcher = nullptr;
+	QByteArray loggingRules;
+	QVector<QThread*> workers;
 
 	void startTerminals();
 	void stopTerminals();
 
+	void startControlServer();
+	void stopControlServer();
+
+	void startLoggingRules();
+	void stopLoggingRules();
+	void applyLoggingRules();
+
+	static void reportCallbackStatus(ControlServer::ReplyStatus status);
+	static ControlServer::ReplyStatus takeCallbackStatus();
+
+	static int defaultWorkerThreads();
+	static int openReusePortSocket(int socket);
+#ifdef Q_OS_UNIX
+	// sockets in the runtime directory are replaced once another instance took over
+	static bool isSocketServed(const QString &name, int timeout);
+	static quint64 socketInode(const QString &path);
+#endif
+	void startWorkers();
+	void stopWorkers(bool notify = true);
+
 private:
 	Service *q;
 };
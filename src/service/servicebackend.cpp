@@ -1,6 +1,7 @@
 #include "servicebackend.h"
 #include "servicebackend_p.h"
 #include "service_p.h"
+#include "servicemetrics_p.h"
 #include <QCtrlSignals>
 using namespace QtService;
 
@@ -33,6 +34,28 @@ QList<int> ServiceBackend::getActivatedSockets(const QByteArray &name)
 	return {};
 }
 
+bool ServiceBackend::storeActivatedSocket(const QByteArray &name, int socket)
+{
+	Q_UNUSED(name)
+	Q_UNUSED(socket)
+	return false;
+}
+
+bool ServiceBackend::removeStoredSockets(const QByteArray &name)
+{
+	Q_UNUSED(name)
+	return false;
+}
+
+void ServiceBackend::reportProgress(const QString &status, int extendTimeoutMsecs)
+{
+	// without a service manager to pass it to, the log is the only place to show the progress
+	if (extendTimeoutMsecs > 0)
+		qCInfo(logBackend).noquote() << status << "- needs another" << extendTimeoutMsecs << "ms";
+	else
+		qCInfo(logBackend).noquote() << status;
+}
+
 ServiceBackend::~ServiceBackend() = default;
 
 void ServiceBackend::signalTriggered(int signal)
@@ -51,6 +74,7 @@ void ServiceBackend::processServiceCommand(ServiceCommand code)
 	d->operating = true;
 	switch(code) {
 	case ServiceCommand::Start:
+		d->startCommand(ServiceCommand::Start);
 		switch(d->service->onStart()) {
 		case Service::CommandResult::Completed:
 			emit d->service->started(true);
@@ -74,6 +98,9 @@ void ServiceBackend::processServiceCommand(ServiceCommand code)
 	case ServiceCommand::Stop:
 	{
 		auto exitCode = EXIT_SUCCESS;
+		d->startCommand(ServiceCommand::Stop);
+		// the workers are done before the service itself stops
+		d->service->d->stopWorkers();
 		switch(d->service->onStop(exitCode)) {
 		case Service::CommandResult::Completed:
 			emit d->service->stopped(exitCode);
@@ -92,6 +119,7 @@ void ServiceBackend::processServiceCommand(ServiceCommand code)
 		break;
 	}
 	case ServiceCommand::Reload:
+		d->startCommand(ServiceCommand::Reload);
 		switch(d->service->onReload()) {
 		case Service::CommandResult::Completed:
 			emit d->service->reloaded(true);
@@ -109,6 +137,7 @@ void ServiceBackend::processServiceCommand(ServiceCommand code)
 		break;
 	case ServiceCommand::Pause:
 		if(!d->service->d->wasPaused) {
+			d->startCommand(ServiceCommand::Pause);
 			switch(d->service->onPause()) {
 			case Service::CommandResult::Completed:
 				emit d->service->paused(true);
@@ -127,6 +156,7 @@ void ServiceBackend::processServiceCommand(ServiceCommand code)
 		break;
 	case ServiceCommand::Resume:
 		if(d->service->d->wasPaused) {
+			d->startCommand(ServiceCommand::Resume);
 			switch(d->service->onResume()) {
 			case Service::CommandResult::Completed:
 				emit d->service->resumed(true);
@@ -151,7 +181,21 @@ void ServiceBackend::processServiceCommand(ServiceCommand code)
 
 QVariant ServiceBackend::processServiceCallbackImpl(const QByteArray &kind, const QVariantList &args)
 {
-	return d->service->onCallback(kind, args);
+	if (kind == ServiceMetrics::MetricsCallback)
+		return d->service->metrics()->toVariantMap();
+
+	ServicePrivate::takeCallbackStatus();
+	QElapsedTimer timer;
+	timer.start();
+	auto result = d->service->onCallback(kind, args);
+	const auto nsecs = timer.nsecsElapsed();
+	// kept for the control server, which reads the status once this returns
+	const auto status = ServicePrivate::takeCallbackStatus();
+	ServicePrivate::reportCallbackStatus(status);
+	// each kind gets its own timing, so unknown ones, e.g. sent via the control socket, are not counted
+	if (status != ControlServer::ReplyStatus::UnknownCallback)
+		d->completeCallback(kind, nsecs);
+	return result;
 }
 
 Service *ServiceBackend::service() const
@@ -178,6 +222,7 @@ bool ServiceBackend::unregisterFromSignal(int signal)
 bool ServiceBackend::preStartService()
 {
 	qCDebug(logBackend) << "Running pre start service routine";
+	d->startLoopProbes();
 	return d->service->preStart();
 }
 
@@ -185,9 +230,13 @@ void ServiceBackend::onSvcStarted(bool success)
 {
 	qCDebug(logBackend) << "Completed service start with result" << success;
 	d->operating = false;
+	d->completeCommand(ServiceCommand::Start);
 	if(success) {
 		d->service->d->isRunning = true;
 		d->service->d->startTerminals();
+		d->service->d->startLoggingRules();
+		d->service->d->startControlServer();
+		d->service->d->startWorkers();
 	} // proper stopping is handled by the backends
 }
 
@@ -195,7 +244,11 @@ void ServiceBackend::onSvcStopped()
 {
 	qCDebug(logBackend) << "Completed service stop";
 	d->operating = false;
+	d->completeCommand(ServiceCommand::Stop);
 	d->service->d->stopTerminals();
+	d->service->d->stopLoggingRules();
+	d->service->d->stopControlServer();
+	d->service->d->stopWorkers();
 	d->service->d->isRunning = false;
 }
 
@@ -203,6 +256,7 @@ void ServiceBackend::onSvcReloaded(bool success)
 {
 	qCDebug(logBackend) << "Completed service reload with result" << success;
 	d->operating = false;
+	d->completeCommand(ServiceCommand::Reload);
 	Q_UNUSED(success)
 }
 
@@ -210,6 +264,7 @@ void ServiceBackend::onSvcResumed(bool success)
 {
 	qCDebug(logBackend) << "Completed service resume with result" << success;
 	d->operating = false;
+	d->completeCommand(ServiceCommand::Resume);
 	if(success)
 		d->service->d->wasPaused = false;
 }
@@ -218,6 +273,7 @@ void ServiceBackend::onSvcPaused(bool success)
 {
 	qCDebug(logBackend) << "Completed service pause with result" << success;
 	d->operating = false;
+	d->completeCommand(ServiceCommand::Pause);
 	if(success)
 		d->service->d->wasPaused = true;
 }
@@ -227,3 +283,35 @@ void ServiceBackend::onSvcPaused(bool success)
 ServiceBackendPrivate::ServiceBackendPrivate(Service *service) :
 	service{service}
 {}
+
+void ServiceBackendPrivate::startCommand(ServiceBackend::ServiceCommand command)
+{
+	commandTimers[command].start();
+}
+
+void ServiceBackendPrivate::completeCommand(ServiceBackend::ServiceCommand command)
+{
+	// commands the service reports on its own, without beeing dispatched, are not timed
+	auto timer = commandTimers.take(command);
+	if (!timer.isValid())
+		return;
+
+	const auto nsecs = timer.nsecsElapsed();
+	qCDebug(logBackend) << "Service command" << command << "took" << nsecs / 1000000.0 << "ms";
+	auto metrics = service->metrics();
+	ServiceMetricsPrivate::record(metrics->d->commands[command], nsecs);
+	emit metrics->commandTimed(command, nsecs);
+}
+
+void ServiceBackendPrivate::startLoopProbes()
+{
+	// a budget set before the application existed could not start the probes yet
+	service->metrics()->d->updateProbes();
+}
+
+void ServiceBackendPrivate::completeCallback(const QByteArray &kind, qint64 nsecs)
+{
+	auto metrics = service->metrics();
+	ServiceMetricsPrivate::record(metrics->d->callbacks[kind], nsecs);
+	emit metrics->callbackTimed(kind, nsecs);
+}
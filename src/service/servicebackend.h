@@ -12,6 +12,7 @@
 namespace QtService {
 
 class ServiceBackendPrivate;
+class ControlServer;
 //! The interface that needs to be implemented to provide the backend for the service engine
 class Q_SERVICE_EXPORT ServiceBackend : public QObject
 {
@@ -41,6 +42,12 @@ public:
 
 	//! Is called by Service::getSockets and Service::getSocket to get the activated sockets
 	virtual QList<int> getActivatedSockets(const QByteArray &name);
+	//! Is called by Service::storeSocket to keep a socket for the next instance of the service
+	virtual bool storeActivatedSocket(const QByteArray &name, int socket);
+	//! Is called by Service::removeStoredSockets to drop all sockets stored for the name
+	virtual bool removeStoredSockets(const QByteArray &name);
+	//! Is called by Service::reportProgress to pass the progress on to the service manager
+	virtual void reportProgress(const QString &status, int extendTimeoutMsecs);
 
 protected Q_SLOTS:
 	//! Is called by the library if a unix signal or windows console signal was triggered
@@ -85,6 +92,7 @@ private Q_SLOTS:
 	void onSvcPaused(bool success);
 
 private:
+	friend class QtService::ControlServer;
 	QScopedPointer<ServiceBackendPrivate> d;
 };
 
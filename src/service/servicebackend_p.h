@@ -2,7 +2,9 @@
 #define QTSERVICE_SERVICEBACKEND_P_H
 
 #include "servicebackend.h"
+#include "servicemetrics.h"
 
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QLoggingCategory>
 
 namespace QtService {
@@ -15,6 +17,12 @@ public:
 
 	Service *service;
 	bool operating = false;
+	QHash<ServiceBackend::ServiceCommand, QElapsedTimer> commandTimers;
+
+	void startCommand(ServiceBackend::ServiceCommand command);
+	void completeCommand(ServiceBackend::ServiceCommand command);
+	void completeCallback(const QByteArray &kind, qint64 nsecs);
+	void startLoopProbes();
 };
 
 Q_DECLARE_LOGGING_CATEGORY(logBackend)  // MAJOR make virtual in public part
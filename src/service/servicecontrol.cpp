@@ -5,11 +5,26 @@
 #include <chrono>
 
 #include <QtCore/QTimer>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QFutureInterface>
+#include <QtCore/QSaveFile>
 
 using namespace QtService;
 
 Q_LOGGING_CATEGORY(QtService::logSvcCtrl, "qt.service.control");
 
+namespace {
+
+template <typename T>
+QFuture<T> finishedFuture(const T &result)
+{
+	QFutureInterface<T> futureIface{QFutureInterfaceBase::Started};
+	futureIface.reportFinished(&result);
+	return futureIface.future();
+}
+
+}
+
 QStringList ServiceControl::listBackends()
 {
 	return ServicePrivate::listBackends();
@@ -67,6 +82,22 @@ ServiceControl *ServiceControl::createFromName(const QString &backend, const QSt
 	return ServicePrivate::createControl(backend, serviceIdFromName(backend, serviceName, domain), parent);
 }
 
+QHash<QString, ServiceControl::Status> ServiceControl::statusOf(const QString &backend, const QStringList &serviceIds)
+{
+	if (serviceIds.isEmpty())
+		return {};
+
+	QScopedPointer<ServiceControl> control{create(backend, serviceIds.first())};
+	if (!control) {
+		QHash<QString, Status> result;
+		result.reserve(serviceIds.size());
+		for (const auto &serviceId : serviceIds)
+			result.insert(serviceId, Status::Unknown);
+		return result;
+	}
+	return control->batchStatus(serviceIds);
+}
+
 ServiceControl::ServiceControl(QString &&serviceId, QObject *parent) :
 	QObject{parent},
 	d{new ServiceControlPrivate{std::move(serviceId)}}
@@ -94,9 +125,43 @@ bool ServiceControl::isEnabled() const
 	return true;
 }
 
+bool ServiceControl::watchStatus() const
+{
+	return d->watchStatus;
+}
+
 QVariant ServiceControl::callGenericCommand(const QByteArray &kind, const QVariantList &args)
 {
-	Q_UNUSED(args)
+	if (kind == "invokeCallback") {
+		if (args.isEmpty()) {
+			setError(tr("The invokeCallback command takes the kind of the callback as first argument"));
+			return {};
+		}
+
+		const auto future = invokeCallbackAsync(args.first().toByteArray(), args.mid(1));
+		if (!d->controlClient->waitForFinished(future))
+			return {};
+		return future.result();
+	} else if (kind == "setLoggingRules") {
+		if (args.size() > 1) {
+			setError(tr("The setLoggingRules command takes at most one argument"));
+			return false;
+		}
+
+		// the running service watches its runtime directory and applies the file on change
+		QSaveFile rulesFile{runtimeDir().absoluteFilePath(ServicePrivate::LoggingRulesFile)};
+		if (!rulesFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+			setError(rulesFile.errorString());
+			return false;
+		}
+		rulesFile.write(args.value(0).toString().toUtf8());
+		if (!rulesFile.commit()) {
+			setError(rulesFile.errorString());
+			return false;
+		}
+		return true;
+	}
+
 	setError(tr("Operation custom command for kind %1 is not implemented for backend %2")
 			 .arg(QString::fromUtf8(kind), backend()));
 	return {};
@@ -121,6 +186,64 @@ QDir ServiceControl::runtimeDir() const
 	return ServicePrivate::runtimeDir(realServiceName());
 }
 
+QFuture<ServiceControl::Status> ServiceControl::statusAsync()
+{
+	return finishedFuture(status());
+}
+
+QFuture<bool> ServiceControl::startAsync()
+{
+	return finishedFuture(start());
+}
+
+QFuture<bool> ServiceControl::stopAsync()
+{
+	return finishedFuture(stop());
+}
+
+QFuture<bool> ServiceControl::restartAsync()
+{
+	return finishedFuture(restart());
+}
+
+QFuture<bool> ServiceControl::pauseAsync()
+{
+	return finishedFuture(pause());
+}
+
+QFuture<bool> ServiceControl::resumeAsync()
+{
+	return finishedFuture(resume());
+}
+
+QFuture<bool> ServiceControl::reloadAsync()
+{
+	return finishedFuture(reload());
+}
+
+QFuture<bool> ServiceControl::enableAutostartAsync()
+{
+	return finishedFuture(enableAutostart());
+}
+
+QFuture<bool> ServiceControl::disableAutostartAsync()
+{
+	return finishedFuture(disableAutostart());
+}
+
+QFuture<QVariant> ServiceControl::invokeCallbackAsync(const QByteArray &kind, const QVariantList &args)
+{
+	// one connection is kept for all calls, so only the first one pays for connecting
+	if (!d->controlClient) {
+		d->controlClient = new ControlClient{runtimeDir(), this};
+		connect(d->controlClient, &ControlClient::callFailed,
+				this, [this](const QString &error) {
+			setError(error);
+		});
+	}
+	return d->controlClient->call(kind, args);
+}
+
 bool ServiceControl::start()
 {
 	setError(tr("Operation start is not implemented for backend %1")
@@ -137,7 +260,6 @@ bool ServiceControl::stop()
 
 bool ServiceControl::restart()
 {
-	using namespace std::chrono_literals;
 	qCDebug(logSvcCtrl) << "Using default stop-then-start method to restart the service";
 
 	// blocking services can simply call stop and start
@@ -148,27 +270,43 @@ bool ServiceControl::restart()
 		return ok;
 	// other types can still simulate a (non)-blocking start/stop, if the have status reports
 	} else if(supportFlags().testFlag(SupportFlag::Status)) {
-		if(!stop())
+		// watch the status before stopping, so no transition can be missed
+		const auto wasWatching = d->watchStatus;
+		if (!setWatchStatus(true))
 			return false;
+		const auto restoreWatch = [this, wasWatching]() {
+			if (!wasWatching)
+				setWatchStatus(false);
+		};
 
-		// check every second, until the service stopped or errored, then start again if successfully
-		auto timer = new QTimer{this};
-		connect(timer, &QTimer::timeout,
-				this, [this, timer]() {
-			switch(status()) {
+		if(!stop()) {
+			restoreWatch();
+			return false;
+		}
+		if (status() == Status::Stopped) {
+			restoreWatch();
+			return start();
+		}
+
+		// wait until the service stopped or errored, then start again if successfully
+		auto connection = QSharedPointer<QMetaObject::Connection>::create();
+		*connection = connect(this, &ServiceControl::statusChanged,
+							  this, [this, connection, restoreWatch](Status status) {
+			switch(status) {
 			case Status::Stopped:
-				timer->deleteLater();
+				disconnect(*connection);
+				restoreWatch();
 				start(); //ignore result as error messages are set by start itself
 				break;
 			case Status::Errored:
-				timer->deleteLater();
+				disconnect(*connection);
+				restoreWatch();
 				break;
 			// ignore all other cases
 			default:
 				break;
 			}
 		});
-		timer->start(1s);
 		return true;
 	} else {
 		setError(tr("Operation restart is not supported for non-blocking service controls without status information"));
@@ -228,6 +366,28 @@ bool ServiceControl::setEnabled(bool enabled)
 	return false;
 }
 
+bool ServiceControl::setWatchStatus(bool watchStatus)
+{
+	if (d->watchStatus == watchStatus)
+		return true;
+
+	if (watchStatus) {
+		if (!supportFlags().testFlag(SupportFlag::Status)) {
+			setError(tr("Watching the service status is not supported for backend %1")
+					 .arg(backend()));
+			return false;
+		}
+		d->lastStatus = status();
+		if (!startStatusWatcher())
+			return false;
+	} else
+		stopStatusWatcher();
+
+	d->watchStatus = watchStatus;
+	emit watchStatusChanged(d->watchStatus, {});
+	return true;
+}
+
 QString ServiceControl::serviceName() const
 {
 	return serviceId();
@@ -238,6 +398,54 @@ QString ServiceControl::realServiceName() const
 	return d->serviceName.isNull() ? serviceName() : d->serviceName;
 }
 
+QHash<QString, ServiceControl::Status> ServiceControl::batchStatus(const QStringList &serviceIds) const
+{
+	qCDebug(logSvcCtrl) << "Using default per-service status query for" << serviceIds.size() << "services";
+	QHash<QString, Status> result;
+	result.reserve(serviceIds.size());
+	for (const auto &serviceId : serviceIds) {
+		if (serviceId == this->serviceId())
+			result.insert(serviceId, status());
+		else {
+			QScopedPointer<ServiceControl> control{create(backend(), serviceId)};
+			result.insert(serviceId, control ? control->status() : Status::Unknown);
+		}
+	}
+	return result;
+}
+
+bool ServiceControl::startStatusWatcher()
+{
+	using namespace std::chrono_literals;
+	qCDebug(logSvcCtrl) << "Using default polling to watch the service status";
+	if (!d->statusTimer) {
+		d->statusTimer = new QTimer{this};
+		d->statusTimer->setInterval(1s);
+		connect(d->statusTimer, &QTimer::timeout,
+				this, [this]() {
+			reportStatus(status());
+		});
+	}
+	d->statusTimer->start();
+	return true;
+}
+
+void ServiceControl::stopStatusWatcher()
+{
+	if (d->statusTimer)
+		d->statusTimer->stop();
+}
+
+void ServiceControl::reportStatus(Status status)
+{
+	if (!d->watchStatus || d->lastStatus == status)
+		return;
+
+	qCDebug(logSvcCtrl) << "Service status changed from" << d->lastStatus << "to" << status;
+	d->lastStatus = status;
+	emit statusChanged(status, {});
+}
+
 void ServiceControl::setError(QString error) const
 {
 	if (d->error == error)
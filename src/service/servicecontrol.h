@@ -6,6 +6,7 @@
 #include <QtCore/qdir.h>
 #include <QtCore/qvariant.h>
 #include <QtCore/qhash.h>
+#include <QtCore/qfuture.h>
 
 #include "QtService/qtservice_global.h"
 
@@ -33,6 +34,9 @@ class Q_SERVICE_EXPORT ServiceControl : public QObject
 	//! Specifies whether the service is currently enabled
 	Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled) // clazy:exclude=qproperty-without-notify
 
+	//! Specifies whether the control watches the service status and reports changes
+	Q_PROPERTY(bool watchStatus READ watchStatus WRITE setWatchStatus NOTIFY watchStatusChanged)
+
 public:
 	//! Flags that indicate what kind of queries and commands the specific control implementation provides
 	enum class SupportFlag {
@@ -96,6 +100,8 @@ public:
 	static ServiceControl *createFromName(const QString &backend, const QString &serviceName, QObject *parent = nullptr);
 	//! Creates a new ServiceControl by guessing the service id from the given name and domain
 	static ServiceControl *createFromName(const QString &backend, const QString &serviceName, const QString &domain, QObject *parent = nullptr);
+	//! Returns the status of multiple services of the same backend with as few queries as possible
+	static QHash<QString, Status> statusOf(const QString &backend, const QStringList &serviceIds);
 
 	~ServiceControl() override;
 
@@ -111,6 +117,8 @@ public:
 	QString error() const;
 	//! @readAcFn{ServiceControl::enabled}
 	virtual bool isEnabled() const;
+	//! @readAcFn{ServiceControl::watchStatus}
+	bool watchStatus() const;
 
 	//! Calls the command of kind with the given arguments and returns it's result
 	Q_INVOKABLE virtual QVariant callGenericCommand(const QByteArray &kind, const QVariantList &args = {});
@@ -148,6 +156,28 @@ public:
 	//! Returns the runtime directory of this controls service
 	Q_INVOKABLE QDir runtimeDir() const;
 
+	//! Asynchronous variant of ServiceControl::status
+	virtual QFuture<QtService::ServiceControl::Status> statusAsync();
+	//! Asynchronous variant of ServiceControl::start
+	virtual QFuture<bool> startAsync();
+	//! Asynchronous variant of ServiceControl::stop
+	virtual QFuture<bool> stopAsync();
+	//! Asynchronous variant of ServiceControl::restart
+	virtual QFuture<bool> restartAsync();
+	//! Asynchronous variant of ServiceControl::pause
+	virtual QFuture<bool> pauseAsync();
+	//! Asynchronous variant of ServiceControl::resume
+	virtual QFuture<bool> resumeAsync();
+	//! Asynchronous variant of ServiceControl::reload
+	virtual QFuture<bool> reloadAsync();
+	//! Asynchronous variant of ServiceControl::enableAutostart
+	virtual QFuture<bool> enableAutostartAsync();
+	//! Asynchronous variant of ServiceControl::disableAutostart
+	virtual QFuture<bool> disableAutostartAsync();
+
+	//! Invokes a callback of the running service via its private control channel
+	QFuture<QVariant> invokeCallbackAsync(const QByteArray &kind, const QVariantList &args = {});
+
 public Q_SLOTS:
 	//! Send a start command for the controls service to the service manager
 	virtual bool start();
@@ -175,12 +205,18 @@ public Q_SLOTS:
 	void clearError();
 	//! @writeAcFn{ServiceControl::enabled}
 	virtual bool setEnabled(bool enabled);
+	//! @writeAcFn{ServiceControl::watchStatus}
+	bool setWatchStatus(bool watchStatus);
 
 Q_SIGNALS:
 	//! @notifyAcFn{ServiceControl::blocking}
 	void blockingChanged(BlockMode blocking);
 	//! @notifyAcFn{ServiceControl::error}
 	void errorChanged(QString error, QPrivateSignal);
+	//! @notifyAcFn{ServiceControl::watchStatus}
+	void watchStatusChanged(bool watchStatus, QPrivateSignal);
+	//! Is emitted when the status of a watched service changes
+	void statusChanged(QtService::ServiceControl::Status status, QPrivateSignal);
 
 protected:
 	//! @private
@@ -191,6 +227,16 @@ protected:
 	//! Returns the common name of the controls service, with a possible override on creation
 	QString realServiceName() const;
 
+	//! Is called by ServiceControl::statusOf to query the status of multiple services at once
+	virtual QHash<QString, Status> batchStatus(const QStringList &serviceIds) const;
+
+	//! Is called when ServiceControl::watchStatus is enabled to start watching the service status
+	virtual bool startStatusWatcher();
+	//! Is called when ServiceControl::watchStatus is disabled to stop watching the service status
+	virtual void stopStatusWatcher();
+	//! Reports the current service status, emitting ServiceControl::statusChanged if it changed
+	void reportStatus(Status status);
+
 	//! @writeAcFn{ServiceControl::error}
 	void setError(QString error) const;
 
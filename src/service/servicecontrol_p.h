@@ -5,6 +5,9 @@
 #include "servicecontrol.h"
 
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QTimer>
+
+#include "controlclient_p.h"
 
 namespace QtService {
 
@@ -19,6 +22,12 @@ public:
 	QString serviceName;
 	bool blocking = true;
 	QString error;
+
+	bool watchStatus = false;
+	ServiceControl::Status lastStatus = ServiceControl::Status::Unknown;
+	QTimer *statusTimer = nullptr;
+
+	ControlClient *controlClient = nullptr;
 };
 
 Q_DECLARE_LOGGING_CATEGORY(logSvcCtrl)
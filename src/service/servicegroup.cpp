@@ -0,0 +1,362 @@
+#include "servicegroup.h"
+#include "servicegroup_p.h"
+
+#include <algorithm>
+
+#include <QtCore/QEventLoop>
+using namespace QtService;
+
+Q_LOGGING_CATEGORY(QtService::logSvcGroup, "qt.service.group");
+
+ServiceGroup::ServiceGroup(QObject *parent) :
+	QObject{parent},
+	d{new ServiceGroupPrivate{this}}
+{}
+
+ServiceGroup::~ServiceGroup()
+{
+	// never leave callers waiting on operations that can no longer complete
+	if (d->busy) {
+		for (const auto &control : d->pending.keys())
+			d->release(control);
+		d->futureIface.reportCanceled();
+		d->futureIface.reportFinished();
+	}
+}
+
+bool ServiceGroup::addService(ServiceControl *control, const QList<ServiceControl*> &dependencies)
+{
+	if (!control) {
+		d->setError(tr("Cannot add an invalid service control to the group"));
+		return false;
+	}
+	if (d->busy) {
+		d->setError(tr("Cannot change the services of the group while it is starting or stopping them"));
+		return false;
+	}
+	if (d->dependencies.contains(control)) {
+		d->setError(tr("The service %1 is already part of the group").arg(control->serviceId()));
+		return false;
+	}
+	// requiring dependencies to be added first guarantees the graph to be free of cycles
+	for (const auto dep : dependencies) {
+		if (!d->dependencies.contains(dep)) {
+			d->setError(tr("The dependencies of service %1 must be added to the group before it")
+						.arg(control->serviceId()));
+			return false;
+		}
+	}
+
+	d->services.append(control);
+	d->dependencies.insert(control, dependencies);
+	connect(control, &QObject::destroyed,
+			this, [this, control]() {
+		auto it = d->pending.find(control);
+		if (it != d->pending.end()) {
+			// the control is already gone, so it must not be touched anymore
+			it->wasWatching = true;
+			d->fail(tr("A service control was destroyed while the group was waiting for it"));
+		}
+		removeService(control);
+	}, Qt::UniqueConnection);
+	return true;
+}
+
+bool ServiceGroup::removeService(ServiceControl *control)
+{
+	if (!d->dependencies.contains(control))
+		return false;
+	if (d->busy) {
+		d->setError(tr("Cannot change the services of the group while it is starting or stopping them"));
+		return false;
+	}
+
+	// services that depended on the removed one now depend on its dependencies
+	const auto removedDeps = d->dependencies.take(control);
+	for (auto &deps : d->dependencies) {
+		if (deps.removeAll(control) > 0) {
+			for (const auto dep : removedDeps) {
+				if (!deps.contains(dep))
+					deps.append(dep);
+			}
+		}
+	}
+	d->services.removeOne(control);
+	disconnect(control, &QObject::destroyed, this, nullptr);
+	return true;
+}
+
+QList<ServiceControl*> ServiceGroup::services() const
+{
+	return d->services;
+}
+
+QList<ServiceControl*> ServiceGroup::dependencies(ServiceControl *control) const
+{
+	return d->dependencies.value(control);
+}
+
+int ServiceGroup::timeout() const
+{
+	return d->timeout;
+}
+
+bool ServiceGroup::isBusy() const
+{
+	return d->busy;
+}
+
+QString ServiceGroup::error() const
+{
+	return d->error;
+}
+
+QFuture<bool> ServiceGroup::startAsync()
+{
+	return d->run(true);
+}
+
+QFuture<bool> ServiceGroup::stopAsync()
+{
+	return d->run(false);
+}
+
+bool ServiceGroup::start()
+{
+	return ServiceGroupPrivate::waitFor(startAsync());
+}
+
+bool ServiceGroup::stop()
+{
+	return ServiceGroupPrivate::waitFor(stopAsync());
+}
+
+void ServiceGroup::setTimeout(int timeout)
+{
+	if (d->timeout == timeout)
+		return;
+
+	d->timeout = timeout;
+	emit timeoutChanged(d->timeout);
+}
+
+// ------------- Private Implementation -------------
+
+ServiceGroupPrivate::ServiceGroupPrivate(ServiceGroup *q_ptr) :
+	q{q_ptr}
+{}
+
+QFuture<bool> ServiceGroupPrivate::run(bool start)
+{
+	if (busy) {
+		setError(ServiceGroup::tr("The group is already starting or stopping its services"));
+		QFutureInterface<bool> failedIface{QFutureInterfaceBase::Started};
+		const auto result = false;
+		failedIface.reportFinished(&result);
+		return failedIface.future();
+	}
+
+	qCDebug(logSvcGroup) << (start ? "Starting" : "Stopping") << services.size() << "services";
+	setError({});
+	starting = start;
+	completed.clear();
+	futureIface = QFutureInterface<bool>{QFutureInterfaceBase::Started};
+	busy = true;
+	emit q->busyChanged(busy, {});
+
+	const auto future = futureIface.future();
+	launchReady();
+	if (busy && pending.isEmpty() && completed.size() == services.size())
+		finish(true);
+	return future;
+}
+
+void ServiceGroupPrivate::launchReady()
+{
+	// stopping walks the graph backwards, so stop services in reverse order of adding them
+	const auto count = services.size();
+	for (auto i = 0; i < count && busy; ++i) {
+		const auto control = services[starting ? i : count - i - 1];
+		if (!completed.contains(control) &&
+			!pending.contains(control) &&
+			isPrepared(control))
+			launch(control);
+	}
+}
+
+void ServiceGroupPrivate::launch(ServiceControl *control)
+{
+	const auto hasStatus = control->supportFlags().testFlag(ServiceControl::SupportFlag::Status);
+	if (hasStatus && hasReachedTarget(control->status())) {
+		qCDebug(logSvcGroup) << "Service" << control->serviceId() << "already"
+							 << (starting ? "running" : "stopped");
+		completed.insert(control);
+		if (starting)
+			emit q->serviceStarted(control);
+		else
+			emit q->serviceStopped(control);
+		if (completed.size() == services.size())
+			finish(true);
+		else
+			launchReady();
+		return;
+	}
+
+	qCDebug(logSvcGroup) << (starting ? "Starting" : "Stopping") << "service" << control->serviceId();
+	auto &entry = pending[control];
+
+	// readiness is reported via status changes, so no polling for the target state is needed
+	if (hasStatus) {
+		entry.wasWatching = control->watchStatus();
+		if (control->setWatchStatus(true)) {
+			entry.statusConnection = QObject::connect(control, &ServiceControl::statusChanged,
+													  q, [this, control](ServiceControl::Status status) {
+				if (!pending.contains(control))
+					return;
+				if (hasReachedTarget(status))
+					complete(control);
+				else if (starting && status == ServiceControl::Status::Errored)
+					fail(ServiceGroup::tr("The service %1 failed to start").arg(control->serviceId()));
+			});
+		}
+	}
+
+	if (timeout >= 0) {
+		entry.timer = new QTimer{q};
+		entry.timer->setSingleShot(true);
+		entry.timer->setInterval(timeout);
+		QObject::connect(entry.timer, &QTimer::timeout,
+						 q, [this, control]() {
+			fail(ServiceGroup::tr("The service %1 did not %2 within %3 ms")
+				 .arg(control->serviceId(),
+					  starting ? QStringLiteral("start") : QStringLiteral("stop"))
+				 .arg(timeout));
+		});
+		entry.timer->start();
+	}
+
+	const auto watcher = new QFutureWatcher<bool>{q};
+	entry.watcher = watcher;
+	QObject::connect(watcher, &QFutureWatcher<bool>::finished,
+					 q, [this, control, watcher]() {
+		auto it = pending.find(control);
+		if (it == pending.end())
+			return;
+		if (watcher->isCanceled() || !watcher->result()) {
+			fail(control->error().isEmpty() ?
+					 ServiceGroup::tr("Failed to %1 the service %2")
+					 .arg(starting ? QStringLiteral("start") : QStringLiteral("stop"),
+						  control->serviceId()) :
+					 control->error());
+			return;
+		}
+
+		// blocking controls only finish once the operation is done, all others report it via the status
+		if (!it->statusConnection ||
+			control->blocking() == ServiceControl::BlockMode::Blocking ||
+			hasReachedTarget(control->status()))
+			complete(control);
+	});
+	// synchronous controls may already report the target state while sending the command
+	watcher->setFuture(starting ? control->startAsync() : control->stopAsync());
+}
+
+void ServiceGroupPrivate::complete(ServiceControl *control)
+{
+	release(control);
+	completed.insert(control);
+	qCDebug(logSvcGroup) << "Service" << control->serviceId() << (starting ? "started" : "stopped");
+	if (starting)
+		emit q->serviceStarted(control);
+	else
+		emit q->serviceStopped(control);
+
+	if (completed.size() == services.size())
+		finish(true);
+	else
+		launchReady();
+}
+
+void ServiceGroupPrivate::fail(const QString &reason)
+{
+	qCWarning(logSvcGroup).noquote() << "Failed to" << (starting ? "start" : "stop")
+									 << "the group:" << reason;
+	setError(reason);
+	// services that are already in progress continue, but the group stops waiting for them
+	for (const auto &other : pending.keys())
+		release(other);
+	finish(false);
+}
+
+void ServiceGroupPrivate::release(ServiceControl *control)
+{
+	const auto entry = pending.take(control);
+	if (entry.statusConnection)
+		QObject::disconnect(entry.statusConnection);
+	if (entry.statusConnection && !entry.wasWatching)
+		control->setWatchStatus(false);
+	if (entry.timer)
+		entry.timer->deleteLater();
+	if (entry.watcher)
+		entry.watcher->deleteLater();
+}
+
+void ServiceGroupPrivate::finish(bool success)
+{
+	if (!busy)
+		return;
+
+	busy = false;
+	futureIface.reportResult(success);
+	futureIface.reportFinished();
+	emit q->busyChanged(busy, {});
+}
+
+void ServiceGroupPrivate::setError(const QString &error)
+{
+	if (this->error == error)
+		return;
+
+	this->error = error;
+	emit q->errorChanged(this->error, {});
+}
+
+bool ServiceGroupPrivate::isPrepared(ServiceControl *control) const
+{
+	if (starting) {
+		const auto deps = dependencies.value(control);
+		return std::all_of(deps.begin(), deps.end(), [this](ServiceControl *dep) {
+			return completed.contains(dep);
+		});
+	} else {
+		// a service can only be stopped once everything that depends on it has been stopped
+		for (auto it = dependencies.constBegin(); it != dependencies.constEnd(); ++it) {
+			if (it->contains(control) && !completed.contains(it.key()))
+				return false;
+		}
+		return true;
+	}
+}
+
+bool ServiceGroupPrivate::hasReachedTarget(ServiceControl::Status status) const
+{
+	if (starting)
+		return status == ServiceControl::Status::Running;
+	else
+		return status == ServiceControl::Status::Stopped ||
+				status == ServiceControl::Status::Errored;
+}
+
+bool ServiceGroupPrivate::waitFor(QFuture<bool> future)
+{
+	if (!future.isFinished()) {
+		QEventLoop loop;
+		QFutureWatcher<bool> watcher;
+		QObject::connect(&watcher, &QFutureWatcher<bool>::finished,
+						 &loop, &QEventLoop::quit);
+		watcher.setFuture(future);
+		if (!future.isFinished())
+			loop.exec();
+	}
+	return !future.isCanceled() && future.result();
+}
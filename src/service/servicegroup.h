@@ -0,0 +1,83 @@
+#ifndef QTSERVICE_SERVICEGROUP_H
+#define QTSERVICE_SERVICEGROUP_H
+
+#include <QtCore/qobject.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qfuture.h>
+
+#include "QtService/qtservice_global.h"
+#include "QtService/servicecontrol.h"
+
+namespace QtService {
+
+class ServiceGroupPrivate;
+//! Starts and stops multiple services concurrently, respecting the dependencies between them
+class Q_SERVICE_EXPORT ServiceGroup : public QObject
+{
+	Q_OBJECT
+
+	//! The time in milliseconds a single service may take to start or stop
+	Q_PROPERTY(int timeout READ timeout WRITE setTimeout NOTIFY timeoutChanged)
+	//! Specifies whether the group is currently starting or stopping its services
+	Q_PROPERTY(bool busy READ isBusy NOTIFY busyChanged)
+	//! A string describing the last error that occured
+	Q_PROPERTY(QString error READ error NOTIFY errorChanged)
+
+public:
+	//! Constructor
+	explicit ServiceGroup(QObject *parent = nullptr);
+	~ServiceGroup() override;
+
+	//! Adds a service to the group, which must be started after all of its dependencies
+	bool addService(QtService::ServiceControl *control, const QList<QtService::ServiceControl*> &dependencies = {});
+	//! Removes a service from the group
+	bool removeService(QtService::ServiceControl *control);
+
+	//! Returns all services of the group, in the order they were added
+	QList<QtService::ServiceControl*> services() const;
+	//! Returns the services the given service depends on
+	QList<QtService::ServiceControl*> dependencies(QtService::ServiceControl *control) const;
+
+	//! @readAcFn{ServiceGroup::timeout}
+	int timeout() const;
+	//! @readAcFn{ServiceGroup::busy}
+	bool isBusy() const;
+	//! @readAcFn{ServiceGroup::error}
+	QString error() const;
+
+	//! Asynchronous variant of ServiceGroup::start
+	QFuture<bool> startAsync();
+	//! Asynchronous variant of ServiceGroup::stop
+	QFuture<bool> stopAsync();
+
+public Q_SLOTS:
+	//! Starts all services of the group and waits until they are running
+	bool start();
+	//! Stops all services of the group and waits until they are stopped
+	bool stop();
+
+	//! @writeAcFn{ServiceGroup::timeout}
+	void setTimeout(int timeout);
+
+Q_SIGNALS:
+	//! Is emitted during ServiceGroup::start whenever one of the services is running
+	void serviceStarted(QtService::ServiceControl *control);
+	//! Is emitted during ServiceGroup::stop whenever one of the services has stopped
+	void serviceStopped(QtService::ServiceControl *control);
+
+	//! @notifyAcFn{ServiceGroup::timeout}
+	void timeoutChanged(int timeout);
+	//! @notifyAcFn{ServiceGroup::busy}
+	void busyChanged(bool busy, QPrivateSignal);
+	//! @notifyAcFn{ServiceGroup::error}
+	void errorChanged(const QString &error, QPrivateSignal);
+
+private:
+	friend class QtService::ServiceGroupPrivate;
+	QScopedPointer<ServiceGroupPrivate> d;
+};
+
+}
+
+#endif // QTSERVICE_SERVICEGROUP_H
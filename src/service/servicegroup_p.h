@@ -0,0 +1,63 @@
+#ifndef QTSERVICE_SERVICEGROUP_P_H
+#define QTSERVICE_SERVICEGROUP_P_H
+
+#include "qtservice_global.h"
+#include "servicegroup.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtCore/QPointer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QFutureInterface>
+#include <QtCore/QLoggingCategory>
+
+namespace QtService {
+
+class ServiceGroupPrivate
+{
+	Q_DISABLE_COPY(ServiceGroupPrivate)
+
+public:
+	// a service that has been sent the command, but has not reached the target state yet
+	struct Pending {
+		QMetaObject::Connection statusConnection;
+		QFutureWatcher<bool> *watcher = nullptr;
+		QTimer *timer = nullptr;
+		bool wasWatching = false;
+	};
+
+	ServiceGroupPrivate(ServiceGroup *q_ptr);
+
+	ServiceGroup *q;
+
+	QList<ServiceControl*> services;
+	QHash<ServiceControl*, QList<ServiceControl*>> dependencies;
+	int timeout = 30000;
+	QString error;
+
+	bool busy = false;
+	bool starting = false;
+	QFutureInterface<bool> futureIface;
+	QSet<ServiceControl*> completed;
+	QHash<ServiceControl*, Pending> pending;
+
+	QFuture<bool> run(bool start);
+	void launchReady();
+	void launch(ServiceControl *control);
+	void complete(ServiceControl *control);
+	void fail(const QString &reason);
+	void release(ServiceControl *control);
+	void finish(bool success);
+	void setError(const QString &error);
+
+	bool isPrepared(ServiceControl *control) const;
+	bool hasReachedTarget(ServiceControl::Status status) const;
+	static bool waitFor(QFuture<bool> future);
+};
+
+Q_DECLARE_LOGGING_CATEGORY(logSvcGroup)
+
+}
+
+#endif // QTSERVICE_SERVICEGROUP_P_H
@@ -0,0 +1,298 @@
+#include "servicemetrics.h"
+#include "servicemetrics_p.h"
+
+#include <algorithm>
+
+#include <QtCore/QMetaEnum>
+#include <QtCore/QCoreApplication>
+using namespace QtService;
+
+const QByteArray ServiceMetrics::MetricsCallback = QByteArrayLiteral("__qtservice_metrics");
+
+QVector<int> ServiceMetrics::lagHistogramBounds()
+{
+	return {1, 2, 5, 10, 25, 50, 100, 250, 500, 1000};
+}
+
+qint64 ServiceMetrics::Timing::averageNsecs() const
+{
+	return count > 0 ? totalNsecs / count : 0;
+}
+
+ServiceMetrics::ServiceMetrics(QObject *parent) :
+	QObject{parent},
+	d{new ServiceMetricsPrivate{}}
+{
+	// the loop of the service itself is always monitored
+	d->monitor->loops.insert(thread(), ServiceMetricsPrivate::Loop{QStringLiteral("main"), nullptr, 0, {}});
+}
+
+ServiceMetrics::~ServiceMetrics()
+{
+	// probes that are still running keep the monitor alive until they are gone
+	QMutexLocker lock{&d->monitor->mutex};
+	for (auto &loop : d->monitor->loops)
+		ServiceMetricsPrivate::stopProbe(loop);
+}
+
+ServiceMetrics::Timing ServiceMetrics::commandTiming(ServiceBackend::ServiceCommand command) const
+{
+	return d->commands.value(command);
+}
+
+QHash<QByteArray, ServiceMetrics::Timing> ServiceMetrics::callbackTimings() const
+{
+	return d->callbacks;
+}
+
+QHash<QString, ServiceMetrics::LoopLag> ServiceMetrics::loopLags() const
+{
+	QMutexLocker lock{&d->monitor->mutex};
+	QHash<QString, LoopLag> lags;
+	for (const auto &loop : qAsConst(d->monitor->loops))
+		lags.insert(loop.name, loop.lag);
+	return lags;
+}
+
+bool ServiceMetrics::isHealthy() const
+{
+	const auto &monitor = d->monitor;
+	QMutexLocker lock{&monitor->mutex};
+	if (monitor->latencyBudget <= 0)
+		return true;
+
+	const auto now = monitor->clock.nsecsElapsed();
+	const auto budgetNsecs = monitor->latencyBudget * 1000000ll;
+	const auto intervalNsecs = monitor->probeInterval() * 1000000ll;
+	for (const auto &loop : qAsConst(monitor->loops)) {
+		// a blocked loop does not run its probe at all, so the time since the last one is checked as well
+		if (!loop.probe)
+			continue;
+		if (loop.lag.lag.lastNsecs > budgetNsecs ||
+			now - loop.lastProbeNsecs > intervalNsecs + budgetNsecs)
+			return false;
+	}
+	for (const auto &beat : qAsConst(monitor->heartbeats)) {
+		if (now - beat.lastBeatNsecs > beat.timeoutNsecs)
+			return false;
+	}
+	return true;
+}
+
+QVariantMap ServiceMetrics::toVariantMap() const
+{
+	const auto commandEnum = QMetaEnum::fromType<ServiceBackend::ServiceCommand>();
+	QVariantMap commands;
+	for (auto it = d->commands.constBegin(); it != d->commands.constEnd(); ++it)
+		commands.insert(QString::fromUtf8(commandEnum.valueToKey(static_cast<int>(it.key()))),
+						ServiceMetricsPrivate::timingToMap(*it));
+
+	QVariantMap callbacks;
+	for (auto it = d->callbacks.constBegin(); it != d->callbacks.constEnd(); ++it)
+		callbacks.insert(QString::fromUtf8(it.key()), ServiceMetricsPrivate::timingToMap(*it));
+
+	QVariantMap loops;
+	const auto lags = loopLags();
+	for (auto it = lags.constBegin(); it != lags.constEnd(); ++it) {
+		auto loop = ServiceMetricsPrivate::timingToMap(it->lag);
+		QVariantList histogram;
+		for (const auto count : it->histogram)
+			histogram.append(count);
+		loop.insert(QStringLiteral("histogram"), histogram);
+		loops.insert(it.key(), loop);
+	}
+
+	return {
+		{QStringLiteral("commands"), commands},
+		{QStringLiteral("callbacks"), callbacks},
+		{QStringLiteral("loops"), loops},
+		{QStringLiteral("healthy"), isHealthy()}
+	};
+}
+
+int ServiceMetrics::latencyBudget() const
+{
+	QMutexLocker lock{&d->monitor->mutex};
+	return d->monitor->latencyBudget;
+}
+
+void ServiceMetrics::addMonitoredThread(QThread *thread)
+{
+	const auto monitor = d->monitor;
+	{
+		QMutexLocker lock{&monitor->mutex};
+		if (!thread || monitor->loops.contains(thread))
+			return;
+		const auto name = thread->objectName().isEmpty() ?
+							  QStringLiteral("thread-%1").arg(monitor->loops.size()) :
+							  thread->objectName();
+		monitor->loops.insert(thread, ServiceMetricsPrivate::Loop{name, nullptr, 0, {}});
+	}
+	// runs on the finishing thread, before another thread can be created at the same address.
+	// It only uses the monitor, as the metrics might be destroyed at the same time
+	connect(thread, &QThread::finished,
+			thread, [monitor, thread]() {
+		QMutexLocker lock{&monitor->mutex};
+		auto loop = monitor->loops.take(thread);
+		ServiceMetricsPrivate::stopProbe(loop);
+	}, Qt::DirectConnection);
+	d->updateProbes();
+}
+
+void ServiceMetrics::removeMonitoredThread(QThread *thread)
+{
+	QMutexLocker lock{&d->monitor->mutex};
+	auto loop = d->monitor->loops.take(thread);
+	ServiceMetricsPrivate::stopProbe(loop);
+}
+
+void ServiceMetrics::addHeartbeat(const QByteArray &name, int timeoutMsecs)
+{
+	QMutexLocker lock{&d->monitor->mutex};
+	d->monitor->heartbeats.insert(name, {timeoutMsecs * 1000000ll, d->monitor->clock.nsecsElapsed()});
+}
+
+void ServiceMetrics::removeHeartbeat(const QByteArray &name)
+{
+	QMutexLocker lock{&d->monitor->mutex};
+	d->monitor->heartbeats.remove(name);
+}
+
+void ServiceMetrics::reset()
+{
+	d->commands.clear();
+	d->callbacks.clear();
+	QMutexLocker lock{&d->monitor->mutex};
+	for (auto &loop : d->monitor->loops)
+		loop.lag = {};
+}
+
+void ServiceMetrics::heartbeat(const QByteArray &name)
+{
+	QMutexLocker lock{&d->monitor->mutex};
+	const auto it = d->monitor->heartbeats.find(name);
+	if (it != d->monitor->heartbeats.end())
+		it->lastBeatNsecs = d->monitor->clock.nsecsElapsed();
+}
+
+void ServiceMetrics::setLatencyBudget(int latencyBudget)
+{
+	latencyBudget = std::max(latencyBudget, 0);
+	{
+		QMutexLocker lock{&d->monitor->mutex};
+		if (d->monitor->latencyBudget == latencyBudget)
+			return;
+		d->monitor->latencyBudget = latencyBudget;
+	}
+	d->updateProbes();
+	emit latencyBudgetChanged(latencyBudget);
+}
+
+// ------------- Private Implementation -------------
+
+ServiceMetricsPrivate::ServiceMetricsPrivate() :
+	monitor{std::make_shared<Monitor>()}
+{
+	monitor->clock.start();
+}
+
+void ServiceMetricsPrivate::record(ServiceMetrics::Timing &timing, qint64 nsecs)
+{
+	++timing.count;
+	timing.lastNsecs = nsecs;
+	timing.maxNsecs = std::max(timing.maxNsecs, nsecs);
+	timing.totalNsecs += nsecs;
+}
+
+QVariantMap ServiceMetricsPrivate::timingToMap(const ServiceMetrics::Timing &timing)
+{
+	return {
+		{QStringLiteral("count"), timing.count},
+		{QStringLiteral("lastNsecs"), timing.lastNsecs},
+		{QStringLiteral("maxNsecs"), timing.maxNsecs},
+		{QStringLiteral("totalNsecs"), timing.totalNsecs},
+		{QStringLiteral("averageNsecs"), timing.averageNsecs()}
+	};
+}
+
+void ServiceMetricsPrivate::startProbe(const std::shared_ptr<Monitor> &monitor, QThread *thread, Loop &loop)
+{
+	const auto probe = new QTimer{};
+	probe->setTimerType(Qt::PreciseTimer);
+	probe->moveToThread(thread);
+	QObject::connect(probe, &QTimer::timeout,
+					 probe, [monitor, thread, probe]() {
+		monitor->recordProbe(thread, probe);
+	});
+	// emitted on the thread of the probe, so nobody can use the pointer once the probe is gone
+	QObject::connect(probe, &QObject::destroyed, [monitor, thread, probe]() {
+		QMutexLocker lock{&monitor->mutex};
+		const auto it = monitor->loops.find(thread);
+		if (it != monitor->loops.end() && it->probe == probe)
+			it->probe = nullptr;
+	});
+	QObject::connect(thread, &QThread::finished,
+					 probe, &QObject::deleteLater);
+	loop.probe = probe;
+	loop.lastProbeNsecs = monitor->clock.nsecsElapsed();
+	loop.lag.histogram.fill(0, ServiceMetrics::lagHistogramBounds().size() + 1);
+	// timers can only be started from their own thread
+	QMetaObject::invokeMethod(probe, "start", Qt::QueuedConnection,
+							  Q_ARG(int, monitor->probeInterval()));
+}
+
+void ServiceMetricsPrivate::stopProbe(Loop &loop)
+{
+	// the probe is deleted on its own thread, which must not happen while the mutex is locked
+	if (loop.probe)
+		loop.probe->deleteLater();
+	loop.probe = nullptr;
+}
+
+void ServiceMetricsPrivate::updateProbes()
+{
+	// the probes need the event dispatchers, which exist once the application has been created
+	if (!QCoreApplication::instance())
+		return;
+
+	QMutexLocker lock{&monitor->mutex};
+	for (auto it = monitor->loops.begin(); it != monitor->loops.end(); ++it) {
+		if (monitor->latencyBudget <= 0)
+			stopProbe(*it);
+		else if (!it->probe)
+			startProbe(monitor, it.key(), *it);
+		else {
+			it->lastProbeNsecs = monitor->clock.nsecsElapsed();
+			QMetaObject::invokeMethod(it->probe, "start", Qt::QueuedConnection,
+									  Q_ARG(int, monitor->probeInterval()));
+		}
+	}
+}
+
+int ServiceMetricsPrivate::Monitor::probeInterval() const
+{
+	// probing twice per budget detects a stall before it exceeded the budget by more than half of it
+	return qBound(10, latencyBudget / 2, 1000);
+}
+
+void ServiceMetricsPrivate::Monitor::recordProbe(QThread *thread, QTimer *probe)
+{
+	QMutexLocker lock{&mutex};
+	const auto it = loops.find(thread);
+	if (it == loops.end() || it->probe != probe)
+		return;
+
+	// the time the timer fired later than it should have is the time the loop was busy with other events
+	const auto now = clock.nsecsElapsed();
+	const auto lag = std::max(now - it->lastProbeNsecs - probeInterval() * 1000000ll, 0ll);
+	it->lastProbeNsecs = now;
+	record(it->lag.lag, lag);
+
+	const auto bounds = ServiceMetrics::lagHistogramBounds();
+	if (it->lag.histogram.size() != bounds.size() + 1)
+		it->lag.histogram.fill(0, bounds.size() + 1);
+	auto bucket = 0;
+	while (bucket < bounds.size() && lag > bounds[bucket] * 1000000ll)
+		++bucket;
+	++it->lag.histogram[bucket];
+}
@@ -0,0 +1,115 @@
+#ifndef QTSERVICE_SERVICEMETRICS_H
+#define QTSERVICE_SERVICEMETRICS_H
+
+#include <QtCore/qobject.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qvariant.h>
+#include <QtCore/qvector.h>
+#include <QtCore/qthread.h>
+
+#include "QtService/qtservice_global.h"
+#include "QtService/servicebackend.h"
+
+namespace QtService {
+
+class ServiceMetricsPrivate;
+class ServiceBackendPrivate;
+//! Collects how long the lifecycle commands and callbacks of a service took
+class Q_SERVICE_EXPORT ServiceMetrics : public QObject
+{
+	Q_OBJECT
+
+	//! The maximum delay in milliseconds the monitored event loops may have while still being healthy
+	Q_PROPERTY(int latencyBudget READ latencyBudget WRITE setLatencyBudget NOTIFY latencyBudgetChanged)
+
+public:
+	//! The collected durations of one command or callback kind
+	struct Timing
+	{
+		//! How often the command completed
+		int count = 0;
+		//! The duration of the most recent run in nanoseconds
+		qint64 lastNsecs = 0;
+		//! The duration of the slowest run in nanoseconds
+		qint64 maxNsecs = 0;
+		//! The summed up duration of all runs in nanoseconds
+		qint64 totalNsecs = 0;
+
+		//! The average duration of a run in nanoseconds
+		qint64 averageNsecs() const;
+	};
+
+	//! The dispatch delays of one monitored event loop
+	struct LoopLag
+	{
+		//! The delays of all probes
+		Timing lag;
+		//! The number of probes per bucket, see lagHistogramBounds()
+		QVector<int> histogram;
+	};
+
+	//! The name of the callback that returns toVariantMap() to the caller
+	static const QByteArray MetricsCallback;
+	//! Returns the upper bounds in milliseconds of all but the last bucket of LoopLag::histogram
+	static QVector<int> lagHistogramBounds();
+
+	//! @private
+	explicit ServiceMetrics(QObject *parent = nullptr);
+	~ServiceMetrics() override;
+
+	//! Returns the timing of the given lifecycle command, from dispatch until it reported completion
+	Timing commandTiming(ServiceBackend::ServiceCommand command) const;
+	//! Returns the timing of all callbacks that have been called so far, by their kind
+	QHash<QByteArray, Timing> callbackTimings() const;
+
+	//! Returns the dispatch delays of all monitored event loops, by their name
+	QHash<QString, LoopLag> loopLags() const;
+	//! Checks whether all monitored event loops and heartbeats are within the latency budget
+	bool isHealthy() const;
+
+	//! Returns all timings as a map, suitable to be passed to other processes
+	QVariantMap toVariantMap() const;
+
+	//! @readAcFn{ServiceMetrics::latencyBudget}
+	int latencyBudget() const;
+
+	//! Adds the event loop of the given thread to the monitored loops
+	void addMonitoredThread(QThread *thread);
+	//! Removes the event loop of the given thread from the monitored loops
+	void removeMonitoredThread(QThread *thread);
+
+	//! Adds a heartbeat that must be triggered at least once per timeout for the service to be healthy
+	void addHeartbeat(const QByteArray &name, int timeoutMsecs);
+	//! Removes a heartbeat previously added
+	void removeHeartbeat(const QByteArray &name);
+
+public Q_SLOTS:
+	//! Clears all collected timings
+	void reset();
+	//! Reports that the given heartbeat is still alive. Can be called from any thread
+	void heartbeat(const QByteArray &name);
+
+	//! @writeAcFn{ServiceMetrics::latencyBudget}
+	void setLatencyBudget(int latencyBudget);
+
+Q_SIGNALS:
+	//! Is emitted whenever a lifecycle command completed
+	void commandTimed(QtService::ServiceBackend::ServiceCommand command, qint64 nsecs);
+	//! Is emitted whenever a callback returned
+	void callbackTimed(const QByteArray &kind, qint64 nsecs);
+
+	//! @notifyAcFn{ServiceMetrics::latencyBudget}
+	void latencyBudgetChanged(int latencyBudget);
+
+private:
+	friend class QtService::ServiceBackendPrivate;
+	QScopedPointer<ServiceMetricsPrivate> d;
+};
+
+}
+
+Q_DECLARE_METATYPE(QtService::ServiceMetrics::Timing)
+Q_DECLARE_METATYPE(QtService::ServiceMetrics::LoopLag)
+
+#endif // QTSERVICE_SERVICEMETRICS_H
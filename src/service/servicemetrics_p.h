@@ -0,0 +1,61 @@
+#ifndef QTSERVICE_SERVICEMETRICS_P_H
+#define QTSERVICE_SERVICEMETRICS_P_H
+
+#include "servicemetrics.h"
+
+#include <memory>
+
+#include <QtCore/QMutex>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+
+namespace QtService {
+
+class ServiceMetricsPrivate
+{
+	Q_DISABLE_COPY(ServiceMetricsPrivate)
+public:
+	// an event loop probed by a timer running on its thread
+	struct Loop {
+		QString name;
+		// only accessed with the mutex locked, and cleared by the probe itself before it is gone
+		QTimer *probe = nullptr;
+		qint64 lastProbeNsecs = 0;
+		ServiceMetrics::LoopLag lag;
+	};
+
+	struct Heartbeat {
+		qint64 timeoutNsecs = 0;
+		qint64 lastBeatNsecs = 0;
+	};
+
+	// shared with the probes, as they can still fire on their threads while the metrics are destroyed
+	struct Monitor {
+		// guards everything below, as the probes and heartbeats run on other threads
+		mutable QMutex mutex;
+		QElapsedTimer clock;
+		int latencyBudget = 0;
+		QHash<QThread*, Loop> loops;
+		QHash<QByteArray, Heartbeat> heartbeats;
+
+		int probeInterval() const;
+		void recordProbe(QThread *thread, QTimer *probe);
+	};
+
+	ServiceMetricsPrivate();
+
+	static void record(ServiceMetrics::Timing &timing, qint64 nsecs);
+	static QVariantMap timingToMap(const ServiceMetrics::Timing &timing);
+	static void startProbe(const std::shared_ptr<Monitor> &monitor, QThread *thread, Loop &loop);
+	static void stopProbe(Loop &loop);
+
+	QHash<ServiceBackend::ServiceCommand, ServiceMetrics::Timing> commands;
+	QHash<QByteArray, ServiceMetrics::Timing> callbacks;
+	std::shared_ptr<Monitor> monitor;
+
+	void updateProbes();
+};
+
+}
+
+#endif // QTSERVICE_SERVICEMETRICS_P_H
@@ -1,5 +1,6 @@
 #include "terminal.h"
 #include "terminal_p.h"
+#include <QtCore/QtEndian>
 using namespace QtService;
 
 Q_LOGGING_CATEGORY(QtService::logTerm, "qt.service.terminal.instance")
@@ -28,9 +29,9 @@ Terminal::Terminal(TerminalPrivate *d_ptr, QObject *parent) :
 	QIODevice::open((mode & d->socket->openMode()) | QIODevice::Unbuffered);
 	qCDebug(logTerm) << "Actual open mode" << openMode();
 
-	connect(d->socket, &QLocalSocket::disconnected,
+	connect(d, &TerminalPrivate::socketDisconnected,
 			this, &Terminal::terminalDisconnected);
-    connect(d->socket, &QLocalSocket::errorOccurred,
+	connect(d, &TerminalPrivate::socketError,
 			this, [this](QLocalSocket::LocalSocketError e) {
 		if(e != QLocalSocket::PeerClosedError) {
 			setErrorString(d->socket->errorString());
@@ -38,10 +39,12 @@ Terminal::Terminal(TerminalPrivate *d_ptr, QObject *parent) :
 		}
 	});
 
-	connect(d->socket, &QLocalSocket::channelReadyRead,
+	connect(d->socket, &QIODevice::channelReadyRead,
 			this, &Terminal::channelReadyRead);
-	connect(d->socket, &QLocalSocket::readyRead,
+	connect(d->socket, &QIODevice::readyRead,
 			this, &Terminal::readyRead);
+	connect(d, &TerminalPrivate::backpressureChanged,
+			this, &Terminal::backpressureChanged);
 }
 
 Terminal::~Terminal() = default;
@@ -53,6 +56,8 @@ bool Terminal::isSequential() const
 
 void Terminal::close()
 {
+	d->flushWriteBuffer();
+	d->flushSendQueue();
 	d->socket->close();
 	QIODevice::close();
 }
@@ -69,7 +74,7 @@ qint64 Terminal::bytesAvailable() const
 
 qint64 Terminal::bytesToWrite() const
 {
-	return QIODevice::bytesToWrite() + d->socket->bytesToWrite();
+	return QIODevice::bytesToWrite() + d->writeBuffer.size() + d->sendQueue.size() + d->socket->bytesToWrite();
 }
 
 bool Terminal::canReadLine() const
@@ -84,6 +89,8 @@ bool Terminal::waitForReadyRead(int msecs)
 
 bool Terminal::waitForBytesWritten(int msecs)
 {
+	d->flushWriteBuffer();
+	d->flushSendQueue();
 	return d->socket->waitForBytesWritten(msecs);
 }
 
@@ -102,6 +109,31 @@ bool Terminal::isAutoDelete() const
 	return d->autoDelete;
 }
 
+qint64 Terminal::writeBufferSize() const
+{
+	return d->writeBufferSize;
+}
+
+int Terminal::writeLatency() const
+{
+	return d->writeLatency;
+}
+
+qint64 Terminal::outputLimit() const
+{
+	return d->outputLimit;
+}
+
+Service::OverflowPolicy Terminal::overflowPolicy() const
+{
+	return d->overflowPolicy;
+}
+
+bool Terminal::hasBackpressure() const
+{
+	return d->backpressure;
+}
+
 Terminal::Awaitable Terminal::awaitChar()
 {
 	return Awaitable{this, Awaitable::ReadSingle};
@@ -119,7 +151,9 @@ Terminal::Awaitable Terminal::awaitLine()
 
 void Terminal::disconnectTerminal()
 {
-	d->socket->disconnectFromServer();
+	d->flushWriteBuffer();
+	d->flushSendQueue();
+	d->disconnectSocket();
 }
 
 void Terminal::requestChar()
@@ -128,9 +162,7 @@ void Terminal::requestChar()
 		qCWarning(logTerm) << "The request methods are only avialable for QtService::Service::ReadWriteActive terminal mode - doing nothing!";
 		return;
 	}
-	d->commandStream << true
-					 << TerminalPrivate::CharRequest;
-	d->socket->flush();
+	d->writeCommand(TerminalPrivate::CharRequest);
 }
 
 void Terminal::requestChars(qint64 num)
@@ -140,10 +172,7 @@ void Terminal::requestChars(qint64 num)
 		qCWarning(logTerm) << "The request methods are only avialable for QtService::Service::ReadWriteActive terminal mode - doing nothing!";
 		return;
 	}
-	d->commandStream << true
-					 << TerminalPrivate::MultiCharRequest
-					 << num;
-	d->socket->flush();
+	d->writeCommand(TerminalPrivate::MultiCharRequest, num);
 }
 
 void Terminal::requestLine()
@@ -152,21 +181,26 @@ void Terminal::requestLine()
 		qCWarning(logTerm) << "The request methods are only avialable for QtService::Service::ReadWriteActive terminal mode - doing nothing!";
 		return;
 	}
-	d->commandStream << true
-					 << TerminalPrivate::LineRequest;
-	d->socket->flush();
+	d->writeCommand(TerminalPrivate::LineRequest);
 }
 
 void Terminal::writeLine(const QByteArray &line, bool flush)
 {
-	write(line + '\n');
-	if (flush)
-		this->flush();
+	if (d->writeBufferSize > 0) {
+		// buffered terminals coalesce the line with other writes, no need to concatenate or flush
+		write(line);
+		write("\n", 1);
+	} else {
+		write(line + '\n');
+		if (flush)
+			this->flush();
+	}
 }
 
 void Terminal::flush()
 {
-	d->socket->flush();
+	d->flushWriteBuffer();
+	d->flushSocket();
 }
 
 void Terminal::setAutoDelete(bool autoDelete)
@@ -178,6 +212,60 @@ void Terminal::setAutoDelete(bool autoDelete)
 	emit autoDeleteChanged(d->autoDelete);
 }
 
+void Terminal::setWriteBufferSize(qint64 writeBufferSize)
+{
+	writeBufferSize = std::max<qint64>(writeBufferSize, 0);
+	if (d->writeBufferSize == writeBufferSize)
+		return;
+
+	if (d->writeBuffer.size() >= writeBufferSize)
+		flush();
+	d->writeBufferSize = writeBufferSize;
+	if (d->writeBufferSize > 0)
+		d->writeBuffer.reserve(static_cast<int>(std::min<qint64>(d->writeBufferSize, 64 * 1024)));
+	else
+		d->writeBuffer = QByteArray{};
+	emit writeBufferSizeChanged(d->writeBufferSize);
+}
+
+void Terminal::setWriteLatency(int writeLatency)
+{
+	writeLatency = std::max(writeLatency, 0);
+	if (d->writeLatency == writeLatency)
+		return;
+
+	d->writeLatency = writeLatency;
+	if (d->flushTimer)
+		d->flushTimer->setInterval(d->writeLatency);
+	emit writeLatencyChanged(d->writeLatency);
+}
+
+void Terminal::setOutputLimit(qint64 outputLimit)
+{
+	outputLimit = std::max<qint64>(outputLimit, 0);
+	if (d->outputLimit == outputLimit)
+		return;
+
+	d->outputLimit = outputLimit;
+	if (d->outputLimit == 0)
+		d->flushSendQueue();
+	else if (d->sendQueue.size() > d->outputLimit)
+		d->sendQueue.remove(0, static_cast<int>(d->sendQueue.size() - d->outputLimit));
+	emit outputLimitChanged(d->outputLimit);
+}
+
+void Terminal::setOverflowPolicy(Service::OverflowPolicy overflowPolicy)
+{
+	if (d->overflowPolicy == overflowPolicy)
+		return;
+
+	d->overflowPolicy = overflowPolicy;
+	// only the drop policy keeps a send queue
+	if (d->overflowPolicy != Service::OverflowPolicy::DropOldest)
+		d->flushSendQueue();
+	emit overflowPolicyChanged(d->overflowPolicy);
+}
+
 qint64 Terminal::readData(char *data, qint64 maxlen)
 {
 	return d->socket->read(data, maxlen);
@@ -190,20 +278,11 @@ qint64 Terminal::readLineData(char *data, qint64 maxlen)
 
 qint64 Terminal::writeData(const char *data, qint64 len)
 {
-	if (d->terminalMode == Service::TerminalMode::ReadWriteActive) {
-		if (len > std::numeric_limits<int>::max()) {
-			for (qint64 lIndex = 0; lIndex < len; lIndex += std::numeric_limits<int>::max()) {
-				auto writeData = data + lIndex;
-				auto writeLen = (len - lIndex) > std::numeric_limits<int>::max() ?
-									std::numeric_limits<int>::max() :
-									static_cast<int>(len - lIndex);
-				d->commandStream << false << QByteArray::fromRawData(writeData, writeLen);
-			}
-		} else
-			d->commandStream << false << QByteArray::fromRawData(data, static_cast<int>(len));
+	if (d->writeBufferSize > 0) {
+		d->bufferWrite(data, len);
 		return len;
 	} else
-		return d->socket->write(data, len);
+		return d->writeLimited(data, len);
 }
 
 bool Terminal::open(QIODevice::OpenMode mode)
@@ -275,18 +354,246 @@ Terminal::Awaitable::type Terminal::Awaitable::result()
 // ------------- Private Implementation -------------
 
 TerminalPrivate::TerminalPrivate(QLocalSocket *socket, QObject *parent) :
+	TerminalPrivate{static_cast<QIODevice*>(socket), parent}
+{
+	localSocket = socket;
+	connect(socket, &QLocalSocket::disconnected,
+			this, &TerminalPrivate::socketDisconnected);
+	connect(socket, &QLocalSocket::errorOccurred,
+			this, &TerminalPrivate::socketError);
+}
+
+TerminalPrivate::TerminalPrivate(TerminalSocketProxy *socket, QObject *parent) :
+	TerminalPrivate{static_cast<QIODevice*>(socket), parent}
+{
+	socketProxy = socket;
+	connect(socket, &TerminalSocketProxy::disconnected,
+			this, &TerminalPrivate::socketDisconnected);
+	connect(socket, &TerminalSocketProxy::errorOccurred,
+			this, &TerminalPrivate::socketError);
+}
+
+TerminalPrivate::TerminalPrivate(QIODevice *socket, QObject *parent) :
 	QObject{parent},
 	socket{socket},
 	commandStream{socket}
 {
 	socket->setParent(this);
 
-	connect(socket, &QLocalSocket::disconnected,
+	connect(this, &TerminalPrivate::socketDisconnected,
 			this, &TerminalPrivate::disconnected);
-    connect(socket, &QLocalSocket::errorOccurred,
+	connect(this, &TerminalPrivate::socketError,
 			this, &TerminalPrivate::error);
-	connect(socket, &QLocalSocket::readyRead,
+	connect(socket, &QIODevice::readyRead,
 			this, &TerminalPrivate::readyRead);
+	connect(socket, &QIODevice::bytesWritten,
+			this, &TerminalPrivate::bytesWritten);
+}
+
+QLocalSocket::LocalSocketState TerminalPrivate::socketState() const
+{
+	return localSocket ? localSocket->state() : socketProxy->state();
+}
+
+void TerminalPrivate::disconnectSocket()
+{
+	if (localSocket)
+		localSocket->disconnectFromServer();
+	else
+		socketProxy->disconnectFromServer();
+}
+
+void TerminalPrivate::abortSocket()
+{
+	if (localSocket)
+		localSocket->abort();
+	else
+		socketProxy->abort();
+}
+
+void TerminalPrivate::flushSocket()
+{
+	if (localSocket)
+		localSocket->flush();
+	else
+		socketProxy->flush();
+}
+
+void TerminalPrivate::writeFrameHeader(QIODevice *device, FrameType type, quint32 size)
+{
+	char header[FrameHeaderSize];
+	header[0] = static_cast<char>(type);
+	qToBigEndian(size, header + sizeof(quint8));
+	device->write(header, FrameHeaderSize);
+}
+
+TerminalPrivate::FrameType TerminalPrivate::readFrameHeader(const char *header, quint32 &size)
+{
+	size = qFromBigEndian<quint32>(header + sizeof(quint8));
+	const auto type = static_cast<FrameType>(header[0]);
+	switch (type) {
+	case DataFrame:
+	case CommandFrame:
+		return size <= MaxFramePayload ? type : InvalidFrame;
+	default:
+		return InvalidFrame;
+	}
+}
+
+void TerminalPrivate::writeCommand(RequestType type, qint64 num)
+{
+	// pending output (like a prompt) must reach the client before the request
+	flushWriteBuffer();
+	flushSendQueue();
+
+	// command payload: 1 byte RequestType, followed by the big endian count for MultiCharRequest
+	char payload[sizeof(quint8) + sizeof(qint64)];
+	payload[0] = static_cast<char>(type);
+	auto size = sizeof(quint8);
+	if (type == MultiCharRequest) {
+		qToBigEndian(num, payload + sizeof(quint8));
+		size += sizeof(qint64);
+	}
+	writeFrameHeader(socket, CommandFrame, static_cast<quint32>(size));
+	socket->write(payload, static_cast<qint64>(size));
+	flushSocket();
+}
+
+qint64 TerminalPrivate::writeFramed(const char *data, qint64 len)
+{
+	if (terminalMode == Service::TerminalMode::ReadWriteActive) {
+		// write the header, followed by the payload straight from the callers buffer
+		for (qint64 lIndex = 0; lIndex < len; lIndex += MaxFramePayload) {
+			const auto writeLen = std::min(len - lIndex, MaxFramePayload);
+			writeFrameHeader(socket, DataFrame, static_cast<quint32>(writeLen));
+			if (socket->write(data + lIndex, writeLen) != writeLen)
+				return lIndex == 0 ? -1 : lIndex;
+		}
+		return len;
+	} else
+		return socket->write(data, len);
+}
+
+qint64 TerminalPrivate::writeLimited(const char *data, qint64 len)
+{
+	if (outputLimit <= 0)
+		return writeFramed(data, len);
+
+	// queued output goes first, as far as the client has made room for it
+	drainSendQueue();
+	if (sendQueue.isEmpty() && socket->bytesToWrite() + len <= outputLimit)
+		return writeFramed(data, len);
+
+	setBackpressure(true);
+	switch (overflowPolicy) {
+	case Service::OverflowPolicy::Block:
+		// wait until the data fits - or the socket is empty, for writes larger than the limit
+		while (socket->bytesToWrite() > 0 &&
+			   socket->bytesToWrite() + len > outputLimit) {
+			if (!socket->waitForBytesWritten(-1))
+				break;
+		}
+		if (socketState() != QLocalSocket::ConnectedState)
+			return -1;
+		setBackpressure(false);
+		return writeFramed(data, len);
+	case Service::OverflowPolicy::DropOldest:
+	{
+		// only the newest output of a write larger than the limit can be kept
+		const auto keep = std::min<qint64>(len, outputLimit);
+		sendQueue.append(data + len - keep, static_cast<int>(keep));
+		if (sendQueue.size() > outputLimit) {
+			qCDebug(logTerm) << "Terminal output limit exceeded - dropping"
+							 << sendQueue.size() - outputLimit << "bytes of output";
+			sendQueue.remove(0, static_cast<int>(sendQueue.size() - outputLimit));
+		}
+		return len;
+	}
+	case Service::OverflowPolicy::Disconnect:
+		qCWarning(logTerm) << "Terminal output limit exceeded - disconnecting client";
+		abortSocket();
+		return -1;
+	default:
+		Q_UNREACHABLE();
+		return -1;
+	}
+}
+
+void TerminalPrivate::drainSendQueue()
+{
+	if (sendQueue.isEmpty())
+		return;
+
+	// move as much of the queue to the socket as the limit permits
+	const auto freeSpace = outputLimit - socket->bytesToWrite();
+	if (freeSpace <= 0)
+		return;
+	const auto len = std::min<qint64>(freeSpace, sendQueue.size());
+	writeFramed(sendQueue.constData(), len);
+	sendQueue.remove(0, static_cast<int>(len));
+}
+
+void TerminalPrivate::flushSendQueue()
+{
+	if (sendQueue.isEmpty())
+		return;
+
+	writeFramed(sendQueue.constData(), sendQueue.size());
+	sendQueue.clear();
+	setBackpressure(false);
+}
+
+void TerminalPrivate::setBackpressure(bool backpressure)
+{
+	if (this->backpressure == backpressure)
+		return;
+
+	this->backpressure = backpressure;
+	if (backpressure)
+		qCDebug(logTerm) << "Terminal client does not keep up with the output - backpressure engaged";
+	emit backpressureChanged(this->backpressure);
+}
+
+void TerminalPrivate::bufferWrite(const char *data, qint64 len)
+{
+	// payloads larger than the buffer are sent directly, after whatever is already pending
+	if (len >= writeBufferSize) {
+		flushWriteBuffer();
+		writeLimited(data, len);
+		flushSocket();
+		return;
+	}
+
+	writeBuffer.append(data, static_cast<int>(len));
+	if (writeBuffer.size() >= writeBufferSize) {
+		flushWriteBuffer();
+		flushSocket();
+	} else {
+		if (!flushTimer) {
+			flushTimer = new QTimer{this};
+			flushTimer->setSingleShot(true);
+			flushTimer->setInterval(writeLatency);
+			connect(flushTimer, &QTimer::timeout,
+					this, [this]() {
+				flushWriteBuffer();
+				flushSocket();
+			});
+		}
+		if (!flushTimer->isActive())
+			flushTimer->start();
+	}
+}
+
+void TerminalPrivate::flushWriteBuffer()
+{
+	if (flushTimer)
+		flushTimer->stop();
+	if (writeBuffer.isEmpty())
+		return;
+
+	// all coalesced writes go out as a single frame
+	writeLimited(writeBuffer.constData(), writeBuffer.size());
+	writeBuffer.resize(0);  // keeps the reserved capacity
 }
 
 void TerminalPrivate::disconnected()
@@ -307,8 +614,8 @@ void TerminalPrivate::error()
 	if (isLoading) {
 		qCWarning(logTerm).noquote() << "Terminal closed due to connection error while loading terminal status:"
 									 << socket->errorString();
-		if (socket->state() == QLocalSocket::ConnectedState)
-			socket->disconnectFromServer();
+		if (socketState() == QLocalSocket::ConnectedState)
+			disconnectSocket();
 		else {
 			isLoading = false;
 			emit terminalReady(this, false);
@@ -328,9 +635,9 @@ void TerminalPrivate::readyRead()
 			terminalMode = static_cast<Service::TerminalMode>(tMode);
 			isLoading = false;
 			//disconnect all but "disconencted" - that one is needed for auto-delete
-            disconnect(socket, &QLocalSocket::errorOccurred,
+			disconnect(this, &TerminalPrivate::socketError,
 					   this, &TerminalPrivate::error);
-			disconnect(socket, &QLocalSocket::readyRead,
+			disconnect(socket, &QIODevice::readyRead,
 					   this, &TerminalPrivate::readyRead);
 			emit terminalReady(this, true);
 		}
@@ -338,6 +645,13 @@ void TerminalPrivate::readyRead()
 }
 
 
+void TerminalPrivate::bytesWritten()
+{
+	drainSendQueue();
+	if (sendQueue.isEmpty() &&
+		(outputLimit <= 0 || socket->bytesToWrite() <= outputLimit))
+		setBackpressure(false);
+}
 
 TerminalAwaitablePrivate::TerminalAwaitablePrivate(Terminal *terminal, qint64 readCnt) :
 	terminal{terminal},
@@ -22,6 +22,16 @@ class Q_SERVICE_EXPORT Terminal : public QIODevice
 	Q_PROPERTY(QStringList command READ command CONSTANT)
 	//! If true, the terminal will delete itself as soon as the connection has been closed
 	Q_PROPERTY(bool autoDelete READ isAutoDelete WRITE setAutoDelete NOTIFY autoDeleteChanged)
+	//! The amount of written data to collect before sending it to the client. 0 disables buffering
+	Q_PROPERTY(qint64 writeBufferSize READ writeBufferSize WRITE setWriteBufferSize NOTIFY writeBufferSizeChanged)
+	//! The maximum time in milliseconds buffered data is held back before being sent
+	Q_PROPERTY(int writeLatency READ writeLatency WRITE setWriteLatency NOTIFY writeLatencyChanged)
+	//! The maximum amount of unsent output to hold for the client. 0 means unlimited
+	Q_PROPERTY(qint64 outputLimit READ outputLimit WRITE setOutputLimit NOTIFY outputLimitChanged)
+	//! What to do if the outputLimit is exceeded
+	Q_PROPERTY(QtService::Service::OverflowPolicy overflowPolicy READ overflowPolicy WRITE setOverflowPolicy NOTIFY overflowPolicyChanged)
+	//! Is true as long as the client does not keep up with the output written to the terminal
+	Q_PROPERTY(bool backpressure READ hasBackpressure NOTIFY backpressureChanged)
 
 public:
 	//! A helper class to be used with [QtCoroutines](https://github.com/Skycoder42/QtCoroutines) to await io from a coroutine
@@ -80,6 +90,16 @@ public:
 	QStringList command() const;
 	//! @readAcFn{Terminal::autoDelete}
 	bool isAutoDelete() const;
+	//! @readAcFn{Terminal::writeBufferSize}
+	qint64 writeBufferSize() const;
+	//! @readAcFn{Terminal::writeLatency}
+	int writeLatency() const;
+	//! @readAcFn{Terminal::outputLimit}
+	qint64 outputLimit() const;
+	//! @readAcFn{Terminal::overflowPolicy}
+	Service::OverflowPolicy overflowPolicy() const;
+	//! @readAcFn{Terminal::backpressure}
+	bool hasBackpressure() const;
 
 	//awaitables
 	//! Await a single character
@@ -107,6 +127,14 @@ public Q_SLOTS:
 
 	//! @writeAcFn{Terminal::autoDelete}
 	void setAutoDelete(bool autoDelete);
+	//! @writeAcFn{Terminal::writeBufferSize}
+	void setWriteBufferSize(qint64 writeBufferSize);
+	//! @writeAcFn{Terminal::writeLatency}
+	void setWriteLatency(int writeLatency);
+	//! @writeAcFn{Terminal::outputLimit}
+	void setOutputLimit(qint64 outputLimit);
+	//! @writeAcFn{Terminal::overflowPolicy}
+	void setOverflowPolicy(Service::OverflowPolicy overflowPolicy);
 
 Q_SIGNALS:
 	//! Will be emitted after the terminal has been disconnected
@@ -116,6 +144,16 @@ Q_SIGNALS:
 
 	//! @notifyAcFn{Terminal::autoDelete}
 	void autoDeleteChanged(bool autoDelete);
+	//! @notifyAcFn{Terminal::writeBufferSize}
+	void writeBufferSizeChanged(qint64 writeBufferSize);
+	//! @notifyAcFn{Terminal::writeLatency}
+	void writeLatencyChanged(int writeLatency);
+	//! @notifyAcFn{Terminal::outputLimit}
+	void outputLimitChanged(qint64 outputLimit);
+	//! @notifyAcFn{Terminal::overflowPolicy}
+	void overflowPolicyChanged(QtService::Service::OverflowPolicy overflowPolicy);
+	//! @notifyAcFn{Terminal::backpressure}
+	void backpressureChanged(bool backpressure);
 
 protected:
 	//! @inherit{QIODevice::readData}
@@ -3,9 +3,13 @@
 
 #include "qtservice_global.h"
 #include "terminal.h"
+#include "terminalworker_p.h"
+
+#include <limits>
 
 #include <QtCore/QDataStream>
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QTimer>
 
 #include <QtNetwork/QLocalSocket>
 
@@ -27,18 +31,55 @@ public:
 	};
 	Q_ENUM(RequestType)
 
+	// ReadWriteActive frames: 1 byte FrameType + 4 byte big endian payload size + payload
+	enum FrameType : quint8 {
+		InvalidFrame = 0,
+
+		DataFrame = 1,
+		CommandFrame = 2
+	};
+	Q_ENUM(FrameType)
+
+	static constexpr qint64 FrameHeaderSize = sizeof(quint8) + sizeof(quint32);
+	static constexpr qint64 MaxFramePayload = std::numeric_limits<qint32>::max();
+
 	TerminalPrivate(QLocalSocket *socket, QObject *parent = nullptr);
+	TerminalPrivate(TerminalSocketProxy *socket, QObject *parent = nullptr);
+
+	static void writeFrameHeader(QIODevice *device, FrameType type, quint32 size);
+	static FrameType readFrameHeader(const char *header, quint32 &size);
+
+	void writeCommand(RequestType type, qint64 num = 0);
+	qint64 writeFramed(const char *data, qint64 len);
+	qint64 writeLimited(const char *data, qint64 len);
+	void drainSendQueue();
+	void flushSendQueue();
+	void setBackpressure(bool backpressure);
+
+	QLocalSocket::LocalSocketState socketState() const;
+	void disconnectSocket();
+	void abortSocket();
+	void flushSocket();
+	void bufferWrite(const char *data, qint64 len);
+	void flushWriteBuffer();
 
 Q_SIGNALS:
 	void terminalReady(TerminalPrivate *terminal, bool successful);
+	void backpressureChanged(bool backpressure);
+	void socketDisconnected();
+	void socketError(QLocalSocket::LocalSocketError socketError);
 
 private Q_SLOTS:
 	void disconnected();
 	void error();
 	void readyRead();
+	void bytesWritten();
 
 private:
-	QLocalSocket *socket;
+	// either the local socket itself, or the proxy for a socket on the terminal I/O thread
+	QIODevice *socket;
+	QLocalSocket *localSocket = nullptr;
+	TerminalSocketProxy *socketProxy = nullptr;
 
 	Service::TerminalMode terminalMode = Service::TerminalMode::ReadWriteActive;
 	QStringList command;
@@ -46,6 +87,18 @@ private:
 
 	bool isLoading = true;
 	QDataStream commandStream;
+
+	qint64 writeBufferSize = 0;
+	int writeLatency = 5;
+	QByteArray writeBuffer;
+	QTimer *flushTimer = nullptr;
+
+	qint64 outputLimit = 0;
+	Service::OverflowPolicy overflowPolicy = Service::OverflowPolicy::Block;
+	QByteArray sendQueue;
+	bool backpressure = false;
+
+	TerminalPrivate(QIODevice *socket, QObject *parent);
 };
 
 class TerminalAwaitablePrivate
@@ -4,8 +4,10 @@
 #include "service_p.h"
 #include "servicecontrol.h"
 #include <iostream>
-#include <QtCore/QThread>
+#include <QtCore/QEventLoop>
+#include <QtCore/QTimer>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QtEndian>
 #include "qconsole.h"
 #include "QCtrlSignals"
 using namespace QtService;
@@ -115,57 +117,11 @@ void TerminalClient::error(QLocalSocket::LocalSocketError socketError)
 void TerminalClient::socketReady()
 {
 	if (_mode == Service::TerminalMode::ReadWriteActive) {
-		// in this mode, data is stream to "channel" it
-		while (!_stream.atEnd()) {
-			_stream.startTransaction();
-			bool isCommand = false;
-			_stream >> isCommand;
-			if (isCommand) {
-				int type = 0;
-				int num = 0;
-				_stream >> type;
-				if (type == TerminalPrivate::MultiCharRequest)
-					_stream >> num;
-				// done with reading - commit
-				if (!_stream.commitTransaction())
-					break;
-
-				// read the appropriate amount of data and immediatly return it (synchronously)
-				QByteArray readData;
-				switch (type) {
-				case QtService::TerminalPrivate::CharRequest:
-					num = 1;
-					Q_FALLTHROUGH();
-				case QtService::TerminalPrivate::MultiCharRequest:
-					readData = _inFile->read(num);
-					break;
-				case QtService::TerminalPrivate::LineRequest:
-					readData = _inFile->readLine();
-					break;
-				default:
-					// hard error!!!
-					_stream.setStatus(QDataStream::ReadCorruptData);
-					break;
-				}
-				// and send it if present
-				if (!readData.isEmpty()) {
-					_socket->write(readData);
-					_socket->flush();
-				}
-			} else {
-				QByteArray data;
-				_stream >> data;
-				if (!_stream.commitTransaction())
-					break;
-				_outFile->write(data);
-				_outFile->flush();
-			}
-
-			if (_stream.status() == QDataStream::ReadCorruptData) {
-				qCCritical(logTermClient) << "Invalid data on transmission stream. Canceling terminal";
-				_exitFailed = true;
-				_socket->disconnectFromServer();
-			}
+		// in this mode, data is framed to "channel" it
+		if (!readFrames()) {
+			qCCritical(logTermClient) << "Invalid data on transmission stream. Canceling terminal";
+			_exitFailed = true;
+			_socket->disconnectFromServer();
 		}
 	} else {
 		_outFile->write(_socket->readAll());
@@ -173,6 +129,84 @@ void TerminalClient::socketReady()
 	}
 }
 
+bool TerminalClient::readFrames()
+{
+	auto wroteData = false;
+	while (_socket->bytesAvailable() > 0) {
+		// start a new frame - only the fixed size header must be complete
+		if (_frameRemaining < 0) {
+			if (_socket->bytesAvailable() < TerminalPrivate::FrameHeaderSize)
+				break;
+			char header[TerminalPrivate::FrameHeaderSize];
+			_socket->read(header, TerminalPrivate::FrameHeaderSize);
+			quint32 size = 0;
+			_frameType = TerminalPrivate::readFrameHeader(header, size);
+			if (_frameType == TerminalPrivate::InvalidFrame)
+				return false;
+			_frameRemaining = size;
+		}
+
+		if (_frameType == TerminalPrivate::DataFrame) {
+			// stream data payloads to the output as they arrive, without waiting for the full frame
+			const auto chunkSize = std::min(_frameRemaining, std::min<qint64>(_socket->bytesAvailable(), 64 * 1024));
+			if (_frameBuffer.size() < chunkSize)
+				_frameBuffer.resize(static_cast<int>(chunkSize));
+			const auto readSize = _socket->read(_frameBuffer.data(), chunkSize);
+			if (readSize < 0)
+				return false;
+			_outFile->write(_frameBuffer.constData(), readSize);
+			wroteData = true;
+			_frameRemaining -= readSize;
+		} else {
+			// command payloads are tiny, wait until complete
+			if (_socket->bytesAvailable() < _frameRemaining)
+				break;
+			char payload[sizeof(quint8) + sizeof(qint64)];
+			if (_frameRemaining < 1 || _frameRemaining > static_cast<qint64>(sizeof(payload)))
+				return false;
+			_socket->read(payload, _frameRemaining);
+			handleCommand(payload, _frameRemaining);
+			_frameRemaining = 0;
+		}
+
+		if (_frameRemaining == 0)
+			_frameRemaining = -1;
+	}
+
+	if (wroteData)
+		_outFile->flush();
+	return true;
+}
+
+void TerminalClient::handleCommand(const char *payload, qint64 size)
+{
+	// read the appropriate amount of data and immediatly return it (synchronously)
+	QByteArray readData;
+	switch (static_cast<quint8>(payload[0])) {
+	case TerminalPrivate::CharRequest:
+		readData = _inFile->read(1);
+		break;
+	case TerminalPrivate::MultiCharRequest:
+		if (size < static_cast<qint64>(sizeof(quint8) + sizeof(qint64))) {
+			qCWarning(logTermClient) << "Ignoring incomplete read request";
+			return;
+		}
+		readData = _inFile->read(qFromBigEndian<qint64>(payload + sizeof(quint8)));
+		break;
+	case TerminalPrivate::LineRequest:
+		readData = _inFile->readLine();
+		break;
+	default:
+		qCWarning(logTermClient) << "Ignoring unknown read request" << static_cast<int>(payload[0]);
+		return;
+	}
+	// and send it if present
+	if (!readData.isEmpty()) {
+		_socket->write(readData);
+		_socket->flush();
+	}
+}
+
 void TerminalClient::consoleReady()
 {
 	auto mBytes = _inConsole->bytesAvailable();
@@ -219,10 +253,21 @@ bool TerminalClient::ensureServiceStarted()
 		}
 		// ensure the service is running for controls that can check it
 		if (canStatus) {
-			auto waitCnt = control->blocking() == ServiceControl::BlockMode::Blocking ? 0 : 15;
-			while (control->status() != ServiceControl::Status::Running && waitCnt > 0) {
-				QThread::sleep(1);
-				--waitCnt;
+			// wait for the status change notification instead of polling the status
+			if (control->blocking() != ServiceControl::BlockMode::Blocking &&
+				control->setWatchStatus(true)) {
+				using namespace std::chrono_literals;
+				QEventLoop waitLoop;
+				QTimer::singleShot(15s, &waitLoop, &QEventLoop::quit);
+				connect(control, &ServiceControl::statusChanged,
+						&waitLoop, [&waitLoop](ServiceControl::Status status) {
+					if (status == ServiceControl::Status::Running ||
+						status == ServiceControl::Status::Errored)
+						waitLoop.quit();
+				});
+				if (control->status() != ServiceControl::Status::Running)
+					waitLoop.exec();
+				control->setWatchStatus(false);
 			}
 			if (control->status() != ServiceControl::Status::Running) {
 				if (!control->error().isNull())
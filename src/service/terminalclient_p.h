@@ -43,6 +43,11 @@ private:
 	QDataStream _stream;
 	QFile *_outFile = nullptr;
 
+	// incremental frame parser state for ReadWriteActive
+	quint8 _frameType = 0;
+	qint64 _frameRemaining = -1;
+	QByteArray _frameBuffer;
+
 	QFile *_inFile = nullptr;
 	QConsole *_inConsole = nullptr;
 
@@ -51,6 +56,8 @@ private:
 	bool verifyArgs();
 	bool ensureServiceStarted();
 	void setupChannels();
+	bool readFrames();
+	void handleCommand(const char *payload, qint64 size);
 
 	static void cerrMessageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
 };
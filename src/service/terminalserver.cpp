@@ -1,6 +1,14 @@
 #include "terminalserver_p.h"
 #include "terminal_p.h"
 #include "service_p.h"
+#include "terminalworker_p.h"
+
+#include <QtCore/QFile>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstdio>
+#endif
 using namespace QtService;
 
 Q_LOGGING_CATEGORY(QtService::logTermServer, "qt.service.terminal.server")
@@ -8,10 +16,25 @@ Q_LOGGING_CATEGORY(QtService::logTermServer, "qt.service.terminal.server")
 TerminalServer::TerminalServer(Service *service) :
 	QObject{service},
 	_service{service},
-	_server{new QLocalServer{this}}
+	_server{new QLocalServer{this}},
+	_retryTimer{new QTimer{this}}
 {
 	connect(_server, &QLocalServer::newConnection,
 			this, &TerminalServer::newConnection);
+
+	_retryTimer->setSingleShot(true);
+	_retryTimer->setInterval(RetryInterval);
+	connect(_retryTimer, &QTimer::timeout,
+			this, &TerminalServer::listen);
+}
+
+TerminalServer::~TerminalServer()
+{
+	if (_ioThread) {
+		// the server and all terminal sockets are deleted as the thread finishes
+		_ioThread->quit();
+		_ioThread->wait();
+	}
 }
 
 QString TerminalServer::serverName()
@@ -24,60 +47,252 @@ QString TerminalServer::serverName()
 #endif
 }
 
-bool TerminalServer::start(bool globally)
+void TerminalServer::startThread()
+{
+	_ioThread = new QThread{this};
+	_ioThread->setObjectName(QStringLiteral("QtService terminal I/O"));
+
+	// the server and the sockets accepted by it live on the I/O thread from now on
+	disconnect(_server, &QLocalServer::newConnection,
+			   this, &TerminalServer::newConnection);
+	connect(_server, &QLocalServer::newConnection,
+			_server, [this]() {
+		acceptThreadedConnections();
+	});
+	connect(_ioThread, &QThread::finished,
+			_server, &QLocalServer::deleteLater);
+	_server->setParent(nullptr);
+	_server->moveToThread(_ioThread);
+	_ioThread->start();
+}
+
+template<typename TFunction>
+void TerminalServer::runOnServerThread(const TFunction &fn) const
+{
+	if (_ioThread)
+		QMetaObject::invokeMethod(_server, fn, Qt::BlockingQueuedConnection);
+	else
+		fn();
+}
+
+void TerminalServer::acceptThreadedConnections()
 {
-	_server->setSocketOptions(globally ? QLocalServer::WorldAccessOption : QLocalServer::UserAccessOption);
-	auto activeSockets = _service->getSockets("terminal");
-	if (activeSockets.isEmpty()) {
-		auto name = serverName();
-		if (!_server->listen(name)) {
-			if (_server->serverError() == QAbstractSocket::AddressInUseError) {
-				if (QLocalServer::removeServer(name))
-					_server->listen(name);
+	// runs on the I/O thread - only the proxies are handed over to the service thread
+	while (_server->hasPendingConnections()) {
+		auto buffers = QSharedPointer<TerminalSocketBuffers>::create();
+		auto worker = new TerminalSocketWorker{_server->nextPendingConnection(), buffers, _server};
+		auto proxy = new TerminalSocketProxy{worker, buffers};
+		proxy->moveToThread(_service->thread());
+		QMetaObject::invokeMethod(this, [this, proxy]() {
+			addTerminal(proxy);
+		}, Qt::QueuedConnection);
+	}
+}
+
+template<typename TSocket>
+void TerminalServer::addTerminal(TSocket *socket)
+{
+	const auto maxTerminals = _service->maxTerminals();
+	if (maxTerminals > 0 && _terminals.size() >= maxTerminals) {
+		qCWarning(logTermServer) << "Rejecting terminal connection - already"
+								 << _terminals.size() << "terminals connected";
+		socket->abort();
+		socket->deleteLater();
+		return;
+	}
+
+	auto terminal = new TerminalPrivate {
+		socket,
+		this
+	};
+	// a terminal counts as long as it is connected, even if it is not deleted afterwards
+	_terminals.insert(terminal);
+	connect(terminal, &TerminalPrivate::socketDisconnected,
+			this, [this, terminal]() {
+		_terminals.remove(terminal);
+	});
+	connect(terminal, &TerminalPrivate::destroyed,
+			this, [this, terminal]() {
+		_terminals.remove(terminal);
+	});
+	connect(terminal, &TerminalPrivate::terminalReady,
+			this, &TerminalServer::terminalReady);
+}
+
+bool TerminalServer::start(bool globally, bool threaded)
+{
+	if (threaded && !_ioThread)
+		startThread();
+	else if (!threaded && _ioThread)
+		qCWarning(logTermServer) << "Disabling threadedTerminal will not have any effect until the service is restarted";
+
+	_globally = globally;
+	// a pending retry still counts as active, as the terminals become available once it succeeds
+	return listen() || _retryTimer->isActive();
+}
+
+bool TerminalServer::listen()
+{
+	const auto activeSockets = _service->getSockets("terminal");
+	auto listening = false;
+	auto retry = false;
+	runOnServerThread([&]() {
+		if (_server->isListening()) {
+			listening = true;
+			return;
+		}
+
+		_server->setSocketOptions(_globally ? QLocalServer::WorldAccessOption : QLocalServer::UserAccessOption);
+		if (activeSockets.isEmpty()) {
+			const auto name = serverName();
+#ifdef Q_OS_UNIX
+			// the socket of a running instance, like the previous one during a hot upgrade, is never replaced
+			if (ServicePrivate::isSocketServed(name, ProbeTimeout)) {
+				retry = true;
+				return;
 			}
+
+			// moving the socket into place replaces one left behind by a crashed instance. QLocalServer::close,
+			// which also runs when the I/O thread deletes the server, only removes the private path then
+			const auto listenName = QStringLiteral("%1.%2").arg(name).arg(QCoreApplication::applicationPid());
+			QLocalServer::removeServer(listenName);
+			if (_server->listen(listenName) &&
+				::rename(QFile::encodeName(listenName).constData(), QFile::encodeName(name).constData()) != 0) {
+				qCCritical(logTermServer) << "Failed to create terminal server with error:" << qt_error_string(errno);
+				_server->close();
+				return;
+			}
+			_socketPath = name;
+			_socketInode = ServicePrivate::socketInode(name);
+#else
+			if (!_server->listen(name)) {
+				if (_server->serverError() == QAbstractSocket::AddressInUseError) {
+					if (QLocalServer::removeServer(name))
+						_server->listen(name);
+				}
+			}
+#endif
+		} else {
+			if (_activated)
+				qCWarning(logTermServer) << "Reopening an already closed activated socket is not supported and will result in undefined behaviour!";
+			if (activeSockets.size() > 1)
+				qCWarning(logTermServer) << "Found more then 1 activated terminal socket - using first one:" << activeSockets.first();
+			_activated = _server->listen(activeSockets.first()) || _activated;
 		}
-	} else {
-		if (_activated)
-			qCWarning(logTermServer) << "Reopening an already closed activated socket is not supported and will result in undefined behaviour!";
-		if (activeSockets.size() > 1)
-			qCWarning(logTermServer) << "Found more then 1 activated terminal socket - using first one:" << activeSockets.first();
-		_activated = _server->listen(activeSockets.first()) || _activated;
-	}
 
-	if (_server->isListening())
-		return true;
-	else {
-		qCCritical(logTermServer) << "Failed to create terminal server with error:" << _server->errorString();
-		return false;
+		listening = _server->isListening();
+		if (!listening)
+			qCCritical(logTermServer) << "Failed to create terminal server with error:" << _server->errorString();
+	});
+
+	if (retry) {
+		qCDebug(logTermServer) << "Terminal socket is still served by another instance - retrying in"
+							   << RetryInterval << "ms";
+		_retryTimer->start();
 	}
+	return listening;
 }
 
 void TerminalServer::stop()
 {
-	_server->close();
+	_retryTimer->stop();
+	runOnServerThread([this]() {
+#ifdef Q_OS_UNIX
+		// removed while still listening, so a new instance cannot mistake it for a stale socket in between.
+		// After a hot upgrade, the path already belongs to the new instance and is left alone
+		if (_server->isListening() && _socketInode != 0 && ServicePrivate::socketInode(_socketPath) == _socketInode)
+			QFile::remove(_socketPath);
+		_socketPath.clear();
+		_socketInode = 0;
+#endif
+		_server->close();
+	});
 }
 
 bool TerminalServer::isRunning() const
 {
-	return _server->isListening();
+	auto listening = false;
+	runOnServerThread([&]() {
+		listening = _server->isListening();
+	});
+	return listening;
 }
 
-void TerminalServer::newConnection()
+int TerminalServer::terminalCount() const
 {
-	while (_server->hasPendingConnections()) {
-		auto terminal = new TerminalPrivate {
-			_server->nextPendingConnection(),
-			this
-		};
-		connect(terminal, &TerminalPrivate::terminalReady,
-				this, &TerminalServer::terminalReady);
+	return _terminals.size();
+}
+
+void TerminalServer::addBroadcastTerminal(Terminal *terminal, bool sendHistory)
+{
+	if (_broadcastTerminals.contains(terminal))
+		return;
+	if (!terminal->isWritable()) {
+		qCWarning(logTermServer) << "Cannot broadcast to a terminal that is not writable";
+		return;
 	}
+
+	if (sendHistory) {
+		for (const auto &message : qAsConst(_broadcastHistory))
+			terminal->write(message);
+	}
+	_broadcastTerminals.append(terminal);
+	connect(terminal, &Terminal::terminalDisconnected,
+			this, [this, terminal]() {
+		removeBroadcastTerminal(terminal);
+	});
+	connect(terminal, &Terminal::destroyed,
+			this, [this, terminal]() {
+		_broadcastTerminals.removeOne(terminal);
+	});
+}
+
+void TerminalServer::removeBroadcastTerminal(Terminal *terminal)
+{
+	if (_broadcastTerminals.removeOne(terminal))
+		disconnect(terminal, nullptr, this, nullptr);
+}
+
+void TerminalServer::broadcast(const QByteArray &data)
+{
+	if (data.isEmpty())
+		return;
+
+	// a terminal that overflows with OverflowPolicy::Disconnect removes itself from the list while writing
+	const auto terminals = _broadcastTerminals;
+	for (auto terminal : terminals) {
+		if (_broadcastTerminals.contains(terminal))
+			terminal->write(data);
+	}
+
+	if (_service->broadcastHistorySize() > 0) {
+		_broadcastHistory.enqueue(data);
+		_broadcastHistoryBytes += data.size();
+		trimBroadcastHistory();
+	}
+}
+
+void TerminalServer::trimBroadcastHistory()
+{
+	// only whole messages are dropped, so replayed history never starts in the middle of one
+	const auto historySize = _service->broadcastHistorySize();
+	while (!_broadcastHistory.isEmpty() && _broadcastHistoryBytes > historySize)
+		_broadcastHistoryBytes -= _broadcastHistory.dequeue().size();
+}
+
+void TerminalServer::newConnection()
+{
+	while (_server->hasPendingConnections())
+		addTerminal(_server->nextPendingConnection());
 }
 
 void TerminalServer::terminalReady(TerminalPrivate *terminal, bool success)
 {
-	if (success)
-		emit terminalConnected(new Terminal{terminal, _service});
-	else
+	if (success) {
+		auto term = new Terminal{terminal, _service};
+		term->setOutputLimit(_service->terminalOutputLimit());
+		term->setOverflowPolicy(_service->terminalOverflowPolicy());
+		emit terminalConnected(term);
+	} else
 		terminal->deleteLater();
 }
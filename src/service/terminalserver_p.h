@@ -5,6 +5,10 @@
 #include "service.h"
 
 #include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QQueue>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
 #include <QtCore/QLoggingCategory>
 
 #include <QtNetwork/QLocalServer>
@@ -17,14 +21,24 @@ class TerminalServer : public QObject
 	Q_OBJECT
 
 public:
+	static constexpr int RetryInterval = 500;
+	static constexpr int ProbeTimeout = 1000;
+
 	explicit TerminalServer(Service *service);
+	~TerminalServer() override;
 
 	static QString serverName();
 
-	bool start(bool globally);
+	bool start(bool globally, bool threaded);
 	void stop();
 
 	bool isRunning() const;
+	int terminalCount() const;
+
+	void addBroadcastTerminal(Terminal *terminal, bool sendHistory);
+	void removeBroadcastTerminal(Terminal *terminal);
+	void broadcast(const QByteArray &data);
+	void trimBroadcastHistory();
 
 Q_SIGNALS:
 	void terminalConnected(QtService::Terminal *terminal);
@@ -37,9 +51,31 @@ private Q_SLOTS:
 private:
 	Service *_service;
 	QLocalServer *_server;
+	QThread *_ioThread = nullptr;
+	QTimer *_retryTimer;
+	bool _globally = false;
 	bool _activated = false;
+#ifdef Q_OS_UNIX
+	// identifies the socket file, as it is replaced once another instance took over
+	QString _socketPath;
+	quint64 _socketInode = 0;
+#endif
+	QSet<TerminalPrivate*> _terminals;
+
+	QVector<Terminal*> _broadcastTerminals;
+	// implicitly shared messages, each stored once for all terminals
+	QQueue<QByteArray> _broadcastHistory;
+	qint64 _broadcastHistoryBytes = 0;
 
 	bool setSocketDescriptor(int socket);
+	bool listen();
+
+	void startThread();
+	template <typename TFunction>
+	void runOnServerThread(const TFunction &fn) const;
+	void acceptThreadedConnections();
+	template <typename TSocket>
+	void addTerminal(TSocket *socket);
 };
 
 Q_DECLARE_LOGGING_CATEGORY(logTermServer)
@@ -0,0 +1,294 @@
+#include "terminalworker_p.h"
+
+#include <cstring>
+
+#include <QtCore/QDeadlineTimer>
+using namespace QtService;
+
+TerminalSocketWorker::TerminalSocketWorker(QLocalSocket *socket, QSharedPointer<TerminalSocketBuffers> buffers, QObject *parent) :
+	QObject{parent},
+	_socket{socket},
+	_buffers{std::move(buffers)}
+{
+	_socket->setParent(this);
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->worker = this;
+		_buffers->state = _socket->state();
+	}
+
+	connect(_socket, &QLocalSocket::readyRead,
+			this, &TerminalSocketWorker::readyRead);
+	connect(_socket, &QLocalSocket::bytesWritten,
+			this, &TerminalSocketWorker::bytesWritten);
+	connect(_socket, &QLocalSocket::stateChanged,
+			this, &TerminalSocketWorker::stateChanged);
+	connect(_socket, &QLocalSocket::disconnected,
+			this, [this]() {
+		// hand over whatever arrived before the connection was closed first
+		readyRead();
+		emit disconnected();
+	});
+	connect(_socket, &QLocalSocket::errorOccurred,
+			this, [this](QLocalSocket::LocalSocketError error) {
+		emit errorOccurred(error, _socket->errorString());
+	});
+}
+
+TerminalSocketWorker::~TerminalSocketWorker()
+{
+	// the proxy posts to the worker while holding the mutex, so it never sees a deleted worker
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->worker = nullptr;
+		_buffers->state = QLocalSocket::UnconnectedState;
+		_buffers->socketBytesToWrite = 0;
+	}
+	_buffers->condition.wakeAll();
+}
+
+void TerminalSocketWorker::flushWrites()
+{
+	QByteArray data;
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		data.swap(_buffers->writeBuffer);
+		_buffers->writePosted = false;
+	}
+	if (data.isEmpty())
+		return;
+
+	_socket->write(data);
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->socketBytesToWrite = _socket->bytesToWrite();
+	}
+	_buffers->condition.wakeAll();
+}
+
+void TerminalSocketWorker::disconnectFromServer()
+{
+	flushWrites();
+	_socket->disconnectFromServer();
+}
+
+void TerminalSocketWorker::abort()
+{
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->writeBuffer.clear();
+		_buffers->writePosted = false;
+	}
+	_socket->abort();
+}
+
+void TerminalSocketWorker::readyRead()
+{
+	const auto data = _socket->readAll();
+	if (data.isEmpty())
+		return;
+
+	bool post;
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->readBuffer.append(data);
+		post = !_buffers->readPosted;
+		_buffers->readPosted = true;
+	}
+	_buffers->condition.wakeAll();
+	if (post)
+		emit dataReady();
+}
+
+void TerminalSocketWorker::bytesWritten(qint64 bytes)
+{
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->socketBytesToWrite = _socket->bytesToWrite();
+	}
+	_buffers->condition.wakeAll();
+	emit dataWritten(bytes);
+}
+
+void TerminalSocketWorker::stateChanged(QLocalSocket::LocalSocketState state)
+{
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->state = state;
+		if (state == QLocalSocket::UnconnectedState)
+			_buffers->socketBytesToWrite = 0;
+	}
+	_buffers->condition.wakeAll();
+}
+
+
+
+TerminalSocketProxy::TerminalSocketProxy(TerminalSocketWorker *worker, QSharedPointer<TerminalSocketBuffers> buffers) :
+	QIODevice{},
+	_buffers{std::move(buffers)}
+{
+	QIODevice::open(QIODevice::ReadWrite);
+
+	// the proxy is moved to the service thread, so all of these become queued connections.
+	// The worker cannot be gone yet, as it is created right before the proxy on the I/O thread
+	connect(worker, &TerminalSocketWorker::dataReady,
+			this, &TerminalSocketProxy::dataReady);
+	connect(worker, &TerminalSocketWorker::dataWritten,
+			this, &TerminalSocketProxy::bytesWritten);
+	connect(worker, &TerminalSocketWorker::disconnected,
+			this, &TerminalSocketProxy::disconnected);
+	connect(worker, &TerminalSocketWorker::errorOccurred,
+			this, &TerminalSocketProxy::workerError);
+}
+
+TerminalSocketProxy::~TerminalSocketProxy()
+{
+	invokeWorker(&QObject::deleteLater);
+}
+
+bool TerminalSocketProxy::isSequential() const
+{
+	return true;
+}
+
+void TerminalSocketProxy::close()
+{
+	if (isOpen())
+		disconnectFromServer();
+	QIODevice::close();
+}
+
+qint64 TerminalSocketProxy::bytesAvailable() const
+{
+	QMutexLocker lock{&_buffers->mutex};
+	return QIODevice::bytesAvailable() + _buffers->readBuffer.size();
+}
+
+qint64 TerminalSocketProxy::bytesToWrite() const
+{
+	QMutexLocker lock{&_buffers->mutex};
+	return _buffers->writeBuffer.size() + _buffers->socketBytesToWrite;
+}
+
+bool TerminalSocketProxy::canReadLine() const
+{
+	if (QIODevice::canReadLine())
+		return true;
+	QMutexLocker lock{&_buffers->mutex};
+	return _buffers->readBuffer.contains('\n');
+}
+
+bool TerminalSocketProxy::waitForReadyRead(int msecs)
+{
+	QDeadlineTimer deadline{msecs};
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		while (_buffers->readBuffer.isEmpty() &&
+			   _buffers->state != QLocalSocket::UnconnectedState) {
+			if (!_buffers->condition.wait(&_buffers->mutex, deadline))
+				break;
+		}
+		if (_buffers->readBuffer.isEmpty())
+			return false;
+	}
+	emit readyRead();
+	return true;
+}
+
+bool TerminalSocketProxy::waitForBytesWritten(int msecs)
+{
+	QDeadlineTimer deadline{msecs};
+	QMutexLocker lock{&_buffers->mutex};
+	const auto pending = _buffers->writeBuffer.size() + _buffers->socketBytesToWrite;
+	if (pending == 0)
+		return false;
+
+	while (_buffers->writeBuffer.size() + _buffers->socketBytesToWrite >= pending &&
+		   _buffers->state == QLocalSocket::ConnectedState) {
+		if (!_buffers->condition.wait(&_buffers->mutex, deadline))
+			break;
+	}
+	return _buffers->writeBuffer.size() + _buffers->socketBytesToWrite < pending;
+}
+
+QLocalSocket::LocalSocketState TerminalSocketProxy::state() const
+{
+	QMutexLocker lock{&_buffers->mutex};
+	return _buffers->state;
+}
+
+void TerminalSocketProxy::disconnectFromServer()
+{
+	invokeWorker(&TerminalSocketWorker::disconnectFromServer);
+}
+
+void TerminalSocketProxy::abort()
+{
+	invokeWorker(&TerminalSocketWorker::abort);
+}
+
+bool TerminalSocketProxy::flush()
+{
+	// writes are always passed on to the I/O thread right away
+	return bytesToWrite() > 0;
+}
+
+qint64 TerminalSocketProxy::readData(char *data, qint64 maxlen)
+{
+	QMutexLocker lock{&_buffers->mutex};
+	const auto len = std::min<qint64>(maxlen, _buffers->readBuffer.size());
+	if (len == 0)
+		return _buffers->state == QLocalSocket::UnconnectedState ? -1 : 0;
+	std::memcpy(data, _buffers->readBuffer.constData(), static_cast<size_t>(len));
+	_buffers->readBuffer.remove(0, static_cast<int>(len));
+	return len;
+}
+
+qint64 TerminalSocketProxy::writeData(const char *data, qint64 len)
+{
+	bool post;
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		if (_buffers->state != QLocalSocket::ConnectedState)
+			return -1;
+		_buffers->writeBuffer.append(data, static_cast<int>(len));
+		post = !_buffers->writePosted;
+		_buffers->writePosted = true;
+	}
+	if (post)
+		postWrites();
+	return len;
+}
+
+void TerminalSocketProxy::dataReady()
+{
+	bool hasData;
+	{
+		QMutexLocker lock{&_buffers->mutex};
+		_buffers->readPosted = false;
+		hasData = !_buffers->readBuffer.isEmpty();
+	}
+	if (hasData) {
+		emit channelReadyRead(0);
+		emit readyRead();
+	}
+}
+
+void TerminalSocketProxy::workerError(int error, const QString &errorString)
+{
+	setErrorString(errorString);
+	emit errorOccurred(static_cast<QLocalSocket::LocalSocketError>(error));
+}
+
+void TerminalSocketProxy::postWrites()
+{
+	invokeWorker(&TerminalSocketWorker::flushWrites);
+}
+
+void TerminalSocketProxy::invokeWorker(void (TerminalSocketWorker::*method)())
+{
+	// posting is thread safe, and the worker can only be destroyed after the mutex was released
+	QMutexLocker lock{&_buffers->mutex};
+	if (_buffers->worker)
+		QMetaObject::invokeMethod(_buffers->worker, method, Qt::QueuedConnection);
+}
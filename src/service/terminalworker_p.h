@@ -0,0 +1,111 @@
+#ifndef QTSERVICE_TERMINALWORKER_P_H
+#define QTSERVICE_TERMINALWORKER_P_H
+
+#include "qtservice_global.h"
+
+#include <QtCore/QObject>
+#include <QtCore/QIODevice>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QSharedPointer>
+
+#include <QtNetwork/QLocalSocket>
+
+namespace QtService {
+
+// state shared between a socket on the I/O thread and the proxy on the service thread
+class TerminalSocketWorker;
+struct TerminalSocketBuffers
+{
+	QMutex mutex;
+	QWaitCondition condition;
+
+	// cleared by the worker when it is destroyed on the I/O thread
+	TerminalSocketWorker *worker = nullptr;
+
+	QByteArray readBuffer;
+	QByteArray writeBuffer;
+	qint64 socketBytesToWrite = 0;
+	QLocalSocket::LocalSocketState state = QLocalSocket::ConnectedState;
+
+	// only one notification is posted per direction until it has been handled
+	bool readPosted = false;
+	bool writePosted = false;
+};
+
+// lives on the terminal I/O thread and owns the actual socket
+class TerminalSocketWorker : public QObject
+{
+	Q_OBJECT
+
+public:
+	TerminalSocketWorker(QLocalSocket *socket, QSharedPointer<TerminalSocketBuffers> buffers, QObject *parent = nullptr);
+	~TerminalSocketWorker() override;
+
+public Q_SLOTS:
+	void flushWrites();
+	void disconnectFromServer();
+	void abort();
+
+Q_SIGNALS:
+	void dataReady();
+	void dataWritten(qint64 bytes);
+	void disconnected();
+	void errorOccurred(int error, const QString &errorString);
+
+private Q_SLOTS:
+	void readyRead();
+	void bytesWritten(qint64 bytes);
+	void stateChanged(QLocalSocket::LocalSocketState state);
+
+private:
+	QLocalSocket *_socket;
+	QSharedPointer<TerminalSocketBuffers> _buffers;
+};
+
+// stands in for the socket on the service thread
+class TerminalSocketProxy : public QIODevice
+{
+	Q_OBJECT
+
+public:
+	explicit TerminalSocketProxy(TerminalSocketWorker *worker, QSharedPointer<TerminalSocketBuffers> buffers);
+	~TerminalSocketProxy() override;
+
+	bool isSequential() const override;
+	void close() override;
+	qint64 bytesAvailable() const override;
+	qint64 bytesToWrite() const override;
+	bool canReadLine() const override;
+	bool waitForReadyRead(int msecs) override;
+	bool waitForBytesWritten(int msecs) override;
+
+	QLocalSocket::LocalSocketState state() const;
+	void disconnectFromServer();
+	void abort();
+	bool flush();
+
+Q_SIGNALS:
+	void disconnected();
+	void errorOccurred(QLocalSocket::LocalSocketError socketError);
+
+protected:
+	qint64 readData(char *data, qint64 maxlen) override;
+	qint64 writeData(const char *data, qint64 len) override;
+
+private Q_SLOTS:
+	void dataReady();
+	void workerError(int error, const QString &errorString);
+
+private:
+	// the worker is owned by the server on the I/O thread, which deletes it once the thread finished.
+	// It is only reached via TerminalSocketBuffers::worker, under the mutex
+	QSharedPointer<TerminalSocketBuffers> _buffers;
+
+	void postWrites();
+	void invokeWorker(void (TerminalSocketWorker::*method)());
+};
+
+}
+
+#endif // QTSERVICE_TERMINALWORKER_P_H
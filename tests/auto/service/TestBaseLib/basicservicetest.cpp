@@ -60,6 +60,18 @@ void BasicServiceTest::testStart()
 	TEST_STATUS(ServiceControl::Status::Running);
 }
 
+void BasicServiceTest::testStatusOf()
+{
+	if(!control->supportFlags().testFlag(ServiceControl::SupportFlag::Status))
+		QSKIP("feature Status not supported by backend");
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	const auto states = ServiceControl::statusOf(backend(), {name(), QStringLiteral("qtservice_missing_service")});
+	QCOMPARE(states.size(), 2);
+	QCOMPARE(states.value(name()), ServiceControl::Status::Running);
+	QVERIFY(states.value(QStringLiteral("qtservice_missing_service")) != ServiceControl::Status::Running);
+}
+
 void BasicServiceTest::testReload()
 {
 	TEST_STATUS(ServiceControl::Status::Running);
@@ -21,6 +21,7 @@ private Q_SLOTS:
 	void testNameDetection();
 
 	void testStart();
+	void testStatusOf();
 	void testReload();
 	void testPause();
 	void testResume();
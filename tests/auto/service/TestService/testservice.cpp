@@ -4,13 +4,87 @@
 #include <QTimer>
 #include <QTcpSocket>
 #include <QSettings>
+#include <QFile>
+#include <QThread>
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#endif
 using namespace QtService;
 
+#ifdef Q_OS_UNIX
+namespace {
+
+int socketPort(int socket)
+{
+	sockaddr_in address {};
+	socklen_t addressSize = sizeof(address);
+	if (::getsockname(socket, reinterpret_cast<sockaddr*>(&address), &addressSize) != 0 ||
+		address.sin_family != AF_INET)
+		return -1;
+	return ntohs(address.sin_port);
+}
+
+// checks whether the socket is a duplicate of one of the given ones, or a socket of its own
+bool isDuplicate(int socket, const QList<int> &originals)
+{
+	struct stat info;
+	if (::fstat(socket, &info) != 0)
+		return false;
+	for (const auto original : originals) {
+		struct stat originalInfo;
+		if (::fstat(original, &originalInfo) == 0 &&
+			originalInfo.st_dev == info.st_dev &&
+			originalInfo.st_ino == info.st_ino)
+			return true;
+	}
+	return false;
+}
+
+}
+#endif
+
 TestService::TestService(int &argc, char **argv) :
 	Service{argc, argv}
 {
 	setTerminalActive(true);
 	setStartWithTerminal(true);
+	// set by the terminal tests to run them against the I/O thread as well
+	setThreadedTerminal(qEnvironmentVariableIntValue("QTSERVICE_TEST_THREADED_TERMINAL") != 0);
+	// used by the control channel tests, which do not connect to the test socket
+	addCallback("echo", std::function<QVariant(QVariantList)>{[](const QVariantList &args) {
+		return QVariant{args};
+	}});
+	addCallback("metrics", []() {
+		return QStringLiteral("service");
+	});
+	addCallback("noop", []() {});
+	// has no stream operators, so it cannot be sent to the control
+	addCallback("object", std::function<QVariant(QVariantList)>{[this](const QVariantList &) {
+		return QVariant::fromValue<QObject*>(this);
+	}});
+	addTypedCallback<AddCallback>([](int a, int b) {
+		return a + b;
+	});
+	// reaches the typed callback directly, while "add" itself is called via the variant path
+	addCallback("typedAdd", [this](int a, int b) {
+		return invokeTypedCallback<AddCallback>(a, b);
+	});
+	addCallback("typedAddDouble", [this](double a, double b) {
+		return invokeTypedCallback<AddDoubleCallback>(a, b);
+	});
+	addCallback("typedEcho", [this](int value) {
+		return invokeTypedCallback<EchoCallback>(value);
+	});
+	addCallback("hasTyped", [this]() {
+		return QVariantList {
+			hasTypedCallback<AddCallback>(),
+			hasTypedCallback<AddDoubleCallback>(),
+			hasTypedCallback<EchoCallback>()
+		};
+	});
 }
 
 bool TestService::preStart()
@@ -24,6 +98,7 @@ Service::CommandResult TestService::onStart()
 	qDebug() << Q_FUNC_INFO;
 
 	//first: read mode of operation:
+	auto warmup = 0;
 #ifndef Q_OS_WIN
 	QSettings config{runtimeDir().absoluteFilePath(QStringLiteral("test.conf")), QSettings::IniFormat};
 	if(config.value(QStringLiteral("exit")).toBool()) {
@@ -33,6 +108,26 @@ Service::CommandResult TestService::onStart()
 		qDebug() << "Failing onStart operation";
 		return CommandResult::Failed;
 	}
+	setWorkerThreads(config.value(QStringLiteral("workers"), 0).toInt());
+	warmup = config.value(QStringLiteral("warmup"), 0).toInt();
+
+	// a socket with port reuse enabled, as a socket unit with ReusePort=yes would pass it
+	const auto reusePort = config.value(QStringLiteral("reusePort"), 0).toInt();
+	if (reusePort > 0) {
+		const auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (fd != -1) {
+			const int on = 1;
+			::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+			sockaddr_in address {};
+			address.sin_family = AF_INET;
+			address.sin_port = htons(static_cast<quint16>(reusePort));
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+				::listen(fd, SOMAXCONN) == 0)
+				storeSocket("reuse", fd);
+			::close(fd);
+		}
+	}
 #endif
 
 	_server = new QLocalServer(this);
@@ -69,6 +164,24 @@ Service::CommandResult TestService::onStart()
 		_activatedServer->setSocketDescriptor(socket);
 	}
 
+	// written for the systemd test, to verify the state survived a restart
+	const auto state = restoreState("teststate");
+	if (!state.isNull()) {
+		QFile stateFile{runtimeDir().absoluteFilePath(QStringLiteral("restored.state"))};
+		if (stateFile.open(QIODevice::WriteOnly))
+			stateFile.write(state);
+	}
+
+	// a slow start that asks for more time than the control would wait
+	if (warmup > 0) {
+		reportProgress(QStringLiteral("Warming up"), warmup * 2);
+		QTimer::singleShot(warmup, this, [this]() {
+			qDebug() << "start ready";
+			emit started(true);
+		});
+		return CommandResult::Pending;
+	}
+
 	qDebug() << "start ready";
 	return CommandResult::Completed;
 }
@@ -77,6 +190,7 @@ Service::CommandResult TestService::onStop(int &exitCode)
 {
 	Q_UNUSED(exitCode);
 	qDebug() << Q_FUNC_INFO;
+	storeState("teststate", QByteArrayLiteral("warm state"));
 	_stream << QByteArray("stopping");
 	if(_socket) {
 		_socket->flush();
@@ -85,6 +199,37 @@ Service::CommandResult TestService::onStop(int &exitCode)
 	return CommandResult::Completed;
 }
 
+void TestService::onWorkerStart(int worker)
+{
+	qDebug() << Q_FUNC_INFO << worker;
+	QFile stateFile{runtimeDir().absoluteFilePath(QStringLiteral("worker-%1.state").arg(worker))};
+	if (stateFile.open(QIODevice::WriteOnly))
+		stateFile.write(QThread::currentThread() != thread() ? "started" : "wrong thread");
+
+#ifdef Q_OS_UNIX
+	// lists the port of each socket the worker got, and whether it is a duplicate ("d") or new ("n")
+	QFile socketsFile{runtimeDir().absoluteFilePath(QStringLiteral("worker-%1.sockets").arg(worker))};
+	if (socketsFile.open(QIODevice::WriteOnly)) {
+		for (const auto &name : {QByteArray{}, QByteArray{"pair"}, QByteArray{"reuse"}}) {
+			QByteArrayList entries;
+			for (const auto fd : getWorkerSockets(worker, name)) {
+				entries.append(QByteArray::number(socketPort(fd)) + (isDuplicate(fd, getSockets(name)) ? 'd' : 'n'));
+				::close(fd);
+			}
+			socketsFile.write((name.isNull() ? QByteArrayLiteral("default") : name) + '=' + entries.join(',') + '\n');
+		}
+	}
+#endif
+}
+
+void TestService::onWorkerStop(int worker)
+{
+	qDebug() << Q_FUNC_INFO << worker;
+	QFile stateFile{runtimeDir().absoluteFilePath(QStringLiteral("worker-%1.state").arg(worker))};
+	if (stateFile.open(QIODevice::WriteOnly))
+		stateFile.write("stopped");
+}
+
 Service::CommandResult TestService::onReload()
 {
 	qDebug() << Q_FUNC_INFO;
@@ -122,6 +267,9 @@ Service::CommandResult TestService::onResume()
 QVariant TestService::onCallback(const QByteArray &kind, const QVariantList &args)
 {
 	qDebug() << Q_FUNC_INFO << kind << args;
+	// only the signals and the windows commands are reported to the test
+	if (!kind.startsWith("SIG") && kind != "command")
+		return Service::onCallback(kind, args);
 	_stream << kind << args;
 	_socket->flush();
 	return true;
@@ -142,7 +290,58 @@ void TestService::terminalConnected(Terminal *terminal)
 	qDebug() << Q_FUNC_INFO << terminal->command();
 	if(terminal->command().mid(1).startsWith(QStringLiteral("stop")))
 		quit();
-	else if(terminal->terminalMode() == Service::TerminalMode::ReadWriteActive) {
+	else if(terminal->command().mid(1).startsWith(QStringLiteral("dump"))) {
+		// large, unevenly sized writes to exercise the frame parser
+		for (const auto size : {1, 3 * 1024 * 1024, 65537})
+			terminal->write(QByteArray(size, 'x'));
+		terminal->writeLine("done");
+		terminal->disconnectTerminal();
+	} else if(terminal->command().mid(1).startsWith(QStringLiteral("lines"))) {
+		terminal->setWriteBufferSize(16 * 1024);
+		for (auto i = 0; i < 10000; ++i)
+			terminal->writeLine(QByteArray::number(i));
+		terminal->disconnectTerminal();
+	} else if(terminal->command().mid(1).startsWith(QStringLiteral("limited"))) {
+		terminal->setOutputLimit(4096);
+		terminal->setOverflowPolicy(Service::OverflowPolicy::Block);
+		for (auto i = 0; i < 10000; ++i)
+			terminal->writeLine(QByteArray::number(i));
+		terminal->disconnectTerminal();
+	} else if(terminal->command().mid(1).startsWith(QStringLiteral("dropping"))) {
+		// a single write above the limit always overflows, no matter how fast the client reads
+		terminal->setOutputLimit(4096);
+		terminal->setOverflowPolicy(Service::OverflowPolicy::DropOldest);
+		terminal->write(QByteArray(65536 - 4, 'x') + "tail");
+		terminal->writeLine("done");
+		terminal->disconnectTerminal();
+	} else if(terminal->command().mid(1).startsWith(QStringLiteral("overflow"))) {
+		terminal->setOutputLimit(4096);
+		terminal->setOverflowPolicy(Service::OverflowPolicy::Disconnect);
+		terminal->write(QByteArray(65536, 'x'));
+		terminal->writeLine("done");
+		terminal->disconnectTerminal();
+	} else if(terminal->command().mid(1).startsWith(QStringLiteral("broadcast"))) {
+		setBroadcastHistorySize(1024);
+		broadcast("history\n");
+		addBroadcastTerminal(terminal);
+		broadcast("live\n");
+		terminal->disconnectTerminal();
+	} else if(terminal->command().mid(1).startsWith(QStringLiteral("subscribe"))) {
+		// receives the broadcasts of "flood", without any history
+		setBroadcastHistorySize(0);
+		addBroadcastTerminal(terminal);
+		_subscriber = terminal;
+		terminal->writeLine("subscribed");
+	} else if(terminal->command().mid(1).startsWith(QStringLiteral("flood"))) {
+		// overflows while being broadcasted to, so it is dropped in the middle of the broadcast
+		terminal->setOutputLimit(4096);
+		terminal->setOverflowPolicy(Service::OverflowPolicy::Disconnect);
+		addBroadcastTerminal(terminal);
+		broadcast(QByteArray(65536, 'x'));
+		broadcast("end\n");
+		if (_subscriber)
+			_subscriber->disconnectTerminal();
+	} else if(terminal->terminalMode() == Service::TerminalMode::ReadWriteActive) {
 		connect(terminal, &Terminal::readyRead,
 				terminal, [terminal](){
 			qDebug() << Q_FUNC_INFO << terminal->readAll();
@@ -6,6 +6,24 @@
 #include <QtNetwork/QLocalSocket>
 #include <QtNetwork/QTcpServer>
 #include <QtCore/QDataStream>
+#include <QtCore/QPointer>
+
+struct AddCallback : public QtService::CallbackTag<int(int, int)>
+{
+	static constexpr const char *kind = "add";
+};
+
+// same kind, but a different signature than the registered typed callback
+struct AddDoubleCallback : public QtService::CallbackTag<double(double, double)>
+{
+	static constexpr const char *kind = "add";
+};
+
+// only registered via addCallback, so it is always invoked through onCallback
+struct EchoCallback : public QtService::CallbackTag<QVariantList(int)>
+{
+	static constexpr const char *kind = "echo";
+};
 
 class TestService : public QtService::Service
 {
@@ -21,6 +39,8 @@ protected:
 	CommandResult onReload() override;
 	CommandResult onPause() override;
 	CommandResult onResume() override;
+	void onWorkerStart(int worker) override;
+	void onWorkerStop(int worker) override;
 
 	QVariant onCallback(const QByteArray &kind, const QVariantList &args) override;
 
@@ -35,6 +55,7 @@ private:
 	QDataStream _stream;
 
 	QTcpServer *_activatedServer = nullptr;
+	QPointer<QtService::Terminal> _subscriber;
 };
 
 #endif // TESTSERVICE_H
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <QString>
+#include <QtTest>
+#include <QCoreApplication>
+#include <QtService/ServiceGroup>
+using namespace QtService;
+
+// completes start and stop asynchronously after a delay, like a nonblocking backend
+class MockControl : public ServiceControl
+{
+	Q_OBJECT
+
+public:
+	static int inFlight;
+	static int maxInFlight;
+
+	MockControl(const QString &serviceId, QObject *parent = nullptr) :
+		ServiceControl{QString{serviceId}, parent}
+	{}
+
+	QString backend() const override {
+		return QStringLiteral("mock");
+	}
+
+	SupportFlags supportFlags() const override {
+		return SupportFlag::Status | SupportFlag::Start | SupportFlag::Stop;
+	}
+
+	bool serviceExists() const override {
+		return true;
+	}
+
+	Status status() const override {
+		return currentStatus;
+	}
+
+	QFuture<bool> startAsync() override {
+		return launch(Status::Running);
+	}
+
+	QFuture<bool> stopAsync() override {
+		return launch(Status::Stopped);
+	}
+
+	Status currentStatus = Status::Stopped;
+	int delay = 100;
+	bool succeed = true;
+	bool hang = false;
+	int launchCount = 0;
+
+protected:
+	bool startStatusWatcher() override {
+		// all changes are reported by the mock itself
+		return true;
+	}
+
+	void stopStatusWatcher() override {}
+
+private:
+	QFuture<bool> launch(Status target) {
+		QFutureInterface<bool> futureIface{QFutureInterfaceBase::Started};
+		++launchCount;
+		maxInFlight = std::max(maxInFlight, ++inFlight);
+		if (!hang) {
+			QTimer::singleShot(delay, this, [this, futureIface, target]() mutable {
+				--inFlight;
+				if (succeed) {
+					currentStatus = target;
+					reportStatus(currentStatus);
+				} else
+					setError(QStringLiteral("mock failure"));
+				const auto ok = succeed;
+				futureIface.reportFinished(&ok);
+			});
+		}
+		return futureIface.future();
+	}
+};
+
+int MockControl::inFlight = 0;
+int MockControl::maxInFlight = 0;
+
+class TestServiceGroup : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+	void init();
+
+	void testAddServices();
+	void testConcurrentStartStop();
+	void testStartFailure();
+	void testStartTimeout();
+};
+
+void TestServiceGroup::init()
+{
+	MockControl::inFlight = 0;
+	MockControl::maxInFlight = 0;
+}
+
+void TestServiceGroup::testAddServices()
+{
+	ServiceGroup group;
+	const auto base = new MockControl{QStringLiteral("base"), &group};
+	const auto dependent = new MockControl{QStringLiteral("dependent"), &group};
+	QVERIFY(!group.addService(nullptr));
+	QVERIFY(!group.addService(dependent, {base}));
+	QVERIFY(group.addService(base));
+	QVERIFY(group.addService(dependent, {base}));
+	QVERIFY(!group.addService(base));
+	QCOMPARE(group.services(), (QList<ServiceControl*>{base, dependent}));
+	QCOMPARE(group.dependencies(dependent), QList<ServiceControl*>{base});
+
+	// dependents of a removed service inherit its dependencies
+	const auto top = new MockControl{QStringLiteral("top"), &group};
+	QVERIFY(group.addService(top, {dependent}));
+	QVERIFY(group.removeService(dependent));
+	QCOMPARE(group.dependencies(top), QList<ServiceControl*>{base});
+}
+
+void TestServiceGroup::testConcurrentStartStop()
+{
+	ServiceGroup group;
+	const auto first = new MockControl{QStringLiteral("first"), &group};
+	const auto second = new MockControl{QStringLiteral("second"), &group};
+	const auto dependent = new MockControl{QStringLiteral("dependent"), &group};
+	const auto running = new MockControl{QStringLiteral("running"), &group};
+	running->currentStatus = ServiceControl::Status::Running;
+	QVERIFY(group.addService(first));
+	QVERIFY(group.addService(second));
+	QVERIFY(group.addService(dependent, {first, second}));
+	QVERIFY(group.addService(running));
+
+	QSignalSpy startedSpy{&group, &ServiceGroup::serviceStarted};
+	auto future = group.startAsync();
+	QVERIFY(group.isBusy());
+	// a group can only run one operation at a time
+	QVERIFY(!group.stopAsync().result());
+	QTRY_VERIFY(future.isFinished());
+	QVERIFY2(future.result(), qUtf8Printable(group.error()));
+	QVERIFY(!group.isBusy());
+
+	// independent services are started at the same time, dependents only after their dependencies
+	QCOMPARE(MockControl::maxInFlight, 2);
+	QCOMPARE(startedSpy.size(), 4);
+	QCOMPARE(startedSpy.last()[0].value<ServiceControl*>(), dependent);
+	// services that already are in the target state are not touched
+	QCOMPARE(running->launchCount, 0);
+	for (const auto control : {first, second, dependent, running})
+		QCOMPARE(control->status(), ServiceControl::Status::Running);
+
+	MockControl::maxInFlight = 0;
+	QSignalSpy stoppedSpy{&group, &ServiceGroup::serviceStopped};
+	QVERIFY2(group.stop(), qUtf8Printable(group.error()));
+	QCOMPARE(stoppedSpy.size(), 4);
+	const auto dependentIndex = std::find_if(stoppedSpy.begin(), stoppedSpy.end(), [dependent](const QVariantList &args) {
+		return args[0].value<ServiceControl*>() == dependent;
+	}) - stoppedSpy.begin();
+	for (auto i = 0; i < stoppedSpy.size(); ++i) {
+		const auto control = stoppedSpy[i][0].value<ServiceControl*>();
+		if (control == first || control == second)
+			QVERIFY(i > dependentIndex);
+	}
+	// the dependent and the unrelated service are stopped concurrently
+	QVERIFY(MockControl::maxInFlight >= 2);
+	for (const auto control : {first, second, dependent, running})
+		QCOMPARE(control->status(), ServiceControl::Status::Stopped);
+}
+
+void TestServiceGroup::testStartFailure()
+{
+	ServiceGroup group;
+	const auto failing = new MockControl{QStringLiteral("failing"), &group};
+	failing->succeed = false;
+	const auto dependent = new MockControl{QStringLiteral("dependent"), &group};
+	QVERIFY(group.addService(failing));
+	QVERIFY(group.addService(dependent, {failing}));
+
+	QSignalSpy startedSpy{&group, &ServiceGroup::serviceStarted};
+	QVERIFY(!group.start());
+	QCOMPARE(group.error(), QStringLiteral("mock failure"));
+	QVERIFY(!group.isBusy());
+	QCOMPARE(startedSpy.size(), 0);
+	// services that depend on a failed one are never started
+	QCOMPARE(dependent->launchCount, 0);
+	QCOMPARE(dependent->status(), ServiceControl::Status::Stopped);
+}
+
+void TestServiceGroup::testStartTimeout()
+{
+	ServiceGroup group;
+	group.setTimeout(200);
+	const auto hanging = new MockControl{QStringLiteral("hanging"), &group};
+	hanging->hang = true;
+	const auto other = new MockControl{QStringLiteral("other"), &group};
+	QVERIFY(group.addService(hanging));
+	QVERIFY(group.addService(other));
+
+	QElapsedTimer timer;
+	timer.start();
+	QVERIFY(!group.start());
+	QVERIFY(timer.elapsed() < 5000);
+	QVERIFY2(group.error().contains(QStringLiteral("hanging")), qUtf8Printable(group.error()));
+	QVERIFY(!group.isBusy());
+	QCOMPARE(other->launchCount, 1);
+
+	// the group can be used again after a timeout
+	hanging->hang = false;
+	QVERIFY2(group.start(), qUtf8Printable(group.error()));
+}
+
+QTEST_MAIN(TestServiceGroup)
+
+#include "tst_servicegroup.moc"
@@ -0,0 +1,15 @@
+TEMPLATE = app
+
+QT = core service testlib
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = tst_servicemetrics
+
+DEFINES += SRCDIR=\\\"$$_PRO_FILE_PWD_/\\\"
+
+SOURCES += \
+		tst_servicemetrics.cpp
+
+include(../../testrun.pri)
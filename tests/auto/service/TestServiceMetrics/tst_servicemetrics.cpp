@@ -0,0 +1,145 @@
+#include <numeric>
+#include <QString>
+#include <QtTest>
+#include <QCoreApplication>
+#include <QtService/ServiceMetrics>
+using namespace QtService;
+
+class TestServiceMetrics : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+	void testLatencyBudget();
+	void testBlockedThread();
+	void testHeartbeats();
+	void testDestroyWhileProbing();
+
+private:
+	// blocks the event loop of the thread for the given time
+	static void blockThread(QThread *thread, int msecs);
+};
+
+void TestServiceMetrics::testLatencyBudget()
+{
+	ServiceMetrics metrics;
+	QCOMPARE(metrics.latencyBudget(), 0);
+	QVERIFY(metrics.isHealthy());
+
+	QSignalSpy budgetSpy{&metrics, &ServiceMetrics::latencyBudgetChanged};
+	metrics.setLatencyBudget(100);
+	QCOMPARE(metrics.latencyBudget(), 100);
+	metrics.setLatencyBudget(100);
+	metrics.setLatencyBudget(-5);
+	QCOMPARE(metrics.latencyBudget(), 0);
+	QCOMPARE(budgetSpy.size(), 2);
+	QCOMPARE(budgetSpy[0][0].toInt(), 100);
+	QCOMPARE(budgetSpy[1][0].toInt(), 0);
+
+	// the main loop is always monitored, and probed once there is a budget
+	metrics.setLatencyBudget(100);
+	QTRY_VERIFY(metrics.loopLags().value(QStringLiteral("main")).lag.count > 0);
+	QVERIFY(metrics.isHealthy());
+	QCOMPARE(metrics.toVariantMap().value(QStringLiteral("healthy")).toBool(), true);
+}
+
+void TestServiceMetrics::testBlockedThread()
+{
+	ServiceMetrics metrics;
+	QThread thread;
+	thread.setObjectName(QStringLiteral("worker"));
+	thread.start();
+	metrics.addMonitoredThread(&thread);
+	metrics.setLatencyBudget(50);
+	QTRY_VERIFY(metrics.loopLags().value(QStringLiteral("worker")).lag.count > 0);
+	QVERIFY(metrics.isHealthy());
+
+	// a blocked loop makes the service unhealthy while it is blocked, not only once it measured the delay
+	blockThread(&thread, 700);
+	QTRY_VERIFY_WITH_TIMEOUT(!metrics.isHealthy(), 500);
+	QTRY_VERIFY_WITH_TIMEOUT(metrics.isHealthy(), 5000);
+
+	const auto lag = metrics.loopLags().value(QStringLiteral("worker"));
+	QVERIFY(lag.lag.maxNsecs > 500 * 1000000ll);
+	const auto bounds = ServiceMetrics::lagHistogramBounds();
+	QCOMPARE(lag.histogram.size(), bounds.size() + 1);
+	QCOMPARE(std::accumulate(lag.histogram.begin(), lag.histogram.end(), 0), lag.lag.count);
+	// the stall lies between the two last bounds, so it ends up in the last regular bucket
+	QCOMPARE(lag.histogram[bounds.size() - 1], 1);
+	QCOMPARE(lag.histogram.last(), 0);
+	const auto histogram = metrics.toVariantMap()
+							   .value(QStringLiteral("loops")).toMap()
+							   .value(QStringLiteral("worker")).toMap()
+							   .value(QStringLiteral("histogram")).toList();
+	QCOMPARE(histogram.size(), bounds.size() + 1);
+
+	// finished threads are no longer monitored
+	thread.quit();
+	QVERIFY(thread.wait(5000));
+	QVERIFY(!metrics.loopLags().contains(QStringLiteral("worker")));
+	QVERIFY(metrics.isHealthy());
+}
+
+void TestServiceMetrics::testHeartbeats()
+{
+	ServiceMetrics metrics;
+	metrics.setLatencyBudget(1000);
+	metrics.addHeartbeat("beat", 200);
+	QVERIFY(metrics.isHealthy());
+
+	QTRY_VERIFY_WITH_TIMEOUT(!metrics.isHealthy(), 1000);
+	metrics.heartbeat("beat");
+	QVERIFY(metrics.isHealthy());
+
+	// beats can come from any thread
+	QThread thread;
+	thread.start();
+	const auto context = new QObject{};
+	context->moveToThread(&thread);
+	QTRY_VERIFY_WITH_TIMEOUT(!metrics.isHealthy(), 1000);
+	QMetaObject::invokeMethod(context, [&metrics]() {
+		metrics.heartbeat("beat");
+	}, Qt::BlockingQueuedConnection);
+	QVERIFY(metrics.isHealthy());
+	context->deleteLater();
+	thread.quit();
+	QVERIFY(thread.wait(5000));
+
+	// unknown beats are ignored, removed ones no longer count
+	metrics.heartbeat("unknown");
+	metrics.removeHeartbeat("beat");
+	QTest::qWait(300);
+	QVERIFY(metrics.isHealthy());
+}
+
+void TestServiceMetrics::testDestroyWhileProbing()
+{
+	QThread thread;
+	thread.start();
+	auto metrics = new ServiceMetrics{};
+	metrics->addMonitoredThread(&thread);
+	metrics->setLatencyBudget(20);
+	QTRY_VERIFY(metrics->loopLags().size() == 2 &&
+				metrics->loopLags().value(QStringLiteral("thread-1")).lag.count > 0);
+
+	// the probe of the worker keeps firing while the metrics are gone
+	blockThread(&thread, 50);
+	delete metrics;
+	QTest::qWait(100);
+	thread.quit();
+	QVERIFY(thread.wait(5000));
+}
+
+void TestServiceMetrics::blockThread(QThread *thread, int msecs)
+{
+	const auto context = new QObject{};
+	context->moveToThread(thread);
+	QMetaObject::invokeMethod(context, [context, msecs]() {
+		QThread::msleep(static_cast<unsigned long>(msecs));
+		delete context;
+	}, Qt::QueuedConnection);
+}
+
+QTEST_MAIN(TestServiceMetrics)
+
+#include "tst_servicemetrics.moc"
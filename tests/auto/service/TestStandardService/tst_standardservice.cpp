@@ -1,7 +1,15 @@
 #include <QString>
 #include <QtTest/QtTest>
 #include <QCoreApplication>
+#include <QScopeGuard>
 #include <basicservicetest.h>
+#include <QtService/ServiceGroup>
+#include <QtService/ServiceMetrics>
+#include <QtNetwork/QTcpSocket>
+#ifdef Q_OS_UNIX
+#include <csignal>
+#endif
+using namespace QtService;
 
 class TestStandardService : public BasicServiceTest
 {
@@ -12,6 +20,21 @@ protected:
 	QString backend() override;
 	QString name() override;
 	bool reportsStartErrors() override;
+
+private Q_SLOTS:
+	void testFlightRecorder();
+	void testLoggingRules();
+	void benchmarkStatus();
+#ifdef Q_OS_UNIX
+	void testKillOnTimeout();
+	void testHotUpgrade();
+	void testListenSockets();
+	void testStartProgress();
+	void testWorkerThreads();
+	void testWorkerSockets();
+#endif
+	void testServiceGroup();
+	void testInvokeCallback();
 };
 
 void TestStandardService::init()
@@ -58,6 +81,354 @@ bool TestStandardService::reportsStartErrors()
 	return false;
 }
 
+void TestStandardService::testFlightRecorder()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	QVERIFY(control->setProperty("flightRecorderSize", 64));
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+
+	QLocalSocket recSocket;
+	recSocket.connectToServer(QStringLiteral("__qtservice_testservice"));
+	QVERIFY2(recSocket.waitForConnected(30000), qUtf8Printable(recSocket.errorString()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	const auto records = control->callCommand<QStringList>("readFlightRecorder");
+	QVERIFY2(!records.isEmpty(), qUtf8Printable(control->error()));
+	QVERIFY(records.size() <= 64);
+	QVERIFY(std::any_of(records.begin(), records.end(), [](const QString &record) {
+		return record.endsWith(QStringLiteral("start ready"));
+	}));
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	control->setProperty("flightRecorderSize", 0);
+
+	// the records must survive the service
+	QVERIFY(!control->callCommand<QStringList>("readFlightRecorder").isEmpty());
+}
+
+void TestStandardService::testLoggingRules()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	// rules from the environment, the common case for units, rank above those set via the API
+	qputenv("QT_LOGGING_RULES", "default.debug=false");
+	const auto _sg0 = qScopeGuard([this]() {
+		qunsetenv("QT_LOGGING_RULES");
+		control->setProperty("flightRecorderSize", 0);
+	});
+	QVERIFY(control->setProperty("flightRecorderSize", 256));
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	// the callback logs its arguments as debug message of the default category
+	const auto logged = [this](const QString &marker) {
+		control->callGenericCommand("invokeCallback", {QByteArrayLiteral("echo"), marker});
+		const auto records = control->callCommand<QStringList>("readFlightRecorder");
+		return std::any_of(records.begin(), records.end(), [marker](const QString &record) {
+			return record.contains(marker);
+		});
+	};
+	QVERIFY(!logged(QStringLiteral("hidden-marker")));
+
+	QVERIFY2(control->callCommand<bool>("setLoggingRules", QStringLiteral("default.debug=true")), qUtf8Printable(control->error()));
+	// the service picks up the rules asynchronously
+	QTRY_VERIFY_WITH_TIMEOUT(logged(QStringLiteral("shown-marker")), 10000);
+
+	QVERIFY2(control->callCommand<bool>("setLoggingRules", QString{}), qUtf8Printable(control->error()));
+	auto resetCount = 0;
+	QTRY_VERIFY_WITH_TIMEOUT(!logged(QStringLiteral("reset-marker-%1").arg(resetCount++)), 10000);
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+}
+
+void TestStandardService::benchmarkStatus()
+{
+	const auto lockPath = control->runtimeDir().absoluteFilePath(QStringLiteral("qstandard.lock"));
+	QCOMPARE(control->status(), ServiceControl::Status::Stopped);
+	QVERIFY(!QFile::exists(lockPath));
+
+	QBENCHMARK {
+		control->status();
+	}
+
+	// probing a stopped service must never create the lock file
+	QVERIFY(!QFile::exists(lockPath));
+}
+
+#ifdef Q_OS_UNIX
+void TestStandardService::testKillOnTimeout()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	QCOMPARE(control->blocking(), ServiceControl::BlockMode::Blocking);
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	// a stopped process can not handle SIGTERM
+	const auto pid = control->callCommand<qint64>("getPid");
+	QVERIFY(pid > 0);
+	QCOMPARE(::kill(static_cast<pid_t>(pid), SIGSTOP), 0);
+
+	QVERIFY(control->setProperty("blockingTimeout", 500));
+	QVERIFY(!control->stop());
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	QVERIFY(control->setProperty("killOnTimeout", true));
+	QElapsedTimer timer;
+	timer.start();
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	QVERIFY(timer.elapsed() < 5000);
+	QCOMPARE(control->status(), ServiceControl::Status::Stopped);
+
+	control->setProperty("blockingTimeout", 30000);
+	control->setProperty("killOnTimeout", false);
+}
+
+void TestStandardService::testHotUpgrade()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	QCOMPARE(control->blocking(), ServiceControl::BlockMode::Blocking);
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	const auto pid = control->callCommand<qint64>("getPid");
+	QVERIFY(pid > 0);
+	QVERIFY2(control->callCommand<bool>("upgrade"), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	// the new instance owns the lock as soon as the old one released it while shutting down
+	const auto newPid = control->callCommand<qint64>("getPid");
+	QVERIFY(newPid > 0);
+	QVERIFY(newPid != pid);
+	// the old process may still be running its remaining cleanup, which releases the lock to the new one.
+	// The service must be reported as running all the time, so it cannot be started a second time
+	QDeadlineTimer deadline{10000};
+	while (::kill(static_cast<pid_t>(pid), 0) == 0 && !deadline.hasExpired()) {
+		QCOMPARE(control->status(), ServiceControl::Status::Running);
+		QThread::msleep(1);
+	}
+	QVERIFY(::kill(static_cast<pid_t>(pid), 0) != 0);
+	TEST_STATUS(ServiceControl::Status::Running);
+	// the old instance must not remove the control socket of the new one when stopping
+	const QVariantList echoArgs {QByteArrayLiteral("echo"), 42};
+	QTRY_COMPARE_WITH_TIMEOUT(control->callGenericCommand("invokeCallback", echoArgs).toList(), QVariantList{42}, 5000);
+	// nor the terminal socket, which the new instance binds once the old one stopped serving it
+	const auto terminalServed = [this]() {
+		QLocalSocket termSocket;
+		termSocket.connectToServer(control->runtimeDir().absoluteFilePath(QStringLiteral("terminal.socket")));
+		return termSocket.waitForConnected(1000);
+	};
+	QTRY_VERIFY_WITH_TIMEOUT(terminalServed(), 5000);
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+}
+
+void TestStandardService::testListenSockets()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	QVERIFY(control->setProperty("listenSockets", QVariantMap {
+		{QString{}, QStringLiteral("127.0.0.1:15843")}
+	}));
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	// the service serves the default socket bound by the control
+	QTcpSocket tcpSocket;
+	tcpSocket.connectToHost(QStringLiteral("127.0.0.1"), 15843);
+	QVERIFY2(tcpSocket.waitForConnected(5000), qUtf8Printable(tcpSocket.errorString()));
+	const QByteArray msg = "hello world";
+	tcpSocket.write(msg);
+	QByteArray resMsg;
+	do {
+		QVERIFY(tcpSocket.waitForReadyRead(5000));
+		resMsg += tcpSocket.readAll();
+	} while(resMsg.size() < msg.size());
+	QCOMPARE(resMsg, msg);
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	control->setProperty("listenSockets", QVariantMap{});
+}
+
+void TestStandardService::testStartProgress()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	QCOMPARE(control->blocking(), ServiceControl::BlockMode::Blocking);
+	// the service needs longer than the timeout, but asks for more time right away
+	resetSettings({{QStringLiteral("warmup"), 1500}});
+	QVERIFY(control->setProperty("blockingTimeout", 1000));
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+	QVERIFY(!control->runtimeDir().exists(QStringLiteral("qstandard.progress")));
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	control->setProperty("blockingTimeout", 30000);
+	resetSettings();
+}
+
+void TestStandardService::testWorkerThreads()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	resetSettings({{QStringLiteral("workers"), 2}});
+	auto runDir = control->runtimeDir();
+	for (const auto &file : {QStringLiteral("worker-0.state"), QStringLiteral("worker-1.state")})
+		runDir.remove(file);
+
+	const auto readState = [&](int worker) {
+		QFile stateFile{runDir.absoluteFilePath(QStringLiteral("worker-%1.state").arg(worker))};
+		return stateFile.open(QIODevice::ReadOnly) ? stateFile.readAll() : QByteArray{};
+	};
+
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+	QTRY_COMPARE(readState(0), QByteArray("started"));
+	QTRY_COMPARE(readState(1), QByteArray("started"));
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	QCOMPARE(readState(0), QByteArray("stopped"));
+	QCOMPARE(readState(1), QByteArray("stopped"));
+	resetSettings();
+}
+
+void TestStandardService::testWorkerSockets()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	resetSettings({
+		{QStringLiteral("workers"), 2},
+		{QStringLiteral("reusePort"), 15846}
+	});
+	QVERIFY(control->setProperty("listenSockets", QVariantMap {
+		{QString{}, QStringLiteral("127.0.0.1:15843")},
+		{QStringLiteral("pair"), QStringList{QStringLiteral("127.0.0.1:15844"), QStringLiteral("127.0.0.1:15845")}}
+	}));
+	auto runDir = control->runtimeDir();
+	for (const auto &file : {QStringLiteral("worker-0.sockets"), QStringLiteral("worker-1.sockets")})
+		runDir.remove(file);
+
+	const auto readSockets = [&](int worker) {
+		QFile socketsFile{runDir.absoluteFilePath(QStringLiteral("worker-%1.sockets").arg(worker))};
+		return socketsFile.open(QIODevice::ReadOnly) ? socketsFile.readAll() : QByteArray{};
+	};
+
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+	// a single socket is duplicated for each worker, while two sockets are shared between them.
+	// With port reuse, the second worker gets a new socket bound to the same port instead
+	QTRY_COMPARE(readSockets(0), QByteArray("default=15843d\npair=15844d\nreuse=15846d\n"));
+	QTRY_COMPARE(readSockets(1), QByteArray("default=15843d\npair=15845d\nreuse=15846n\n"));
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	control->setProperty("listenSockets", QVariantMap{});
+	resetSettings();
+}
+#endif
+
+void TestStandardService::testServiceGroup()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+
+	ServiceGroup group;
+	const auto dependent = ServiceControl::create(backend(), name(), &group);
+	QVERIFY(dependent);
+	QVERIFY(!group.addService(dependent, {control}));
+	QVERIFY(group.addService(control));
+	QVERIFY(group.addService(dependent, {control}));
+	QVERIFY(!group.addService(control));
+	QCOMPARE(group.dependencies(dependent), QList<ServiceControl*>{control});
+
+	QSignalSpy startedSpy{&group, &ServiceGroup::serviceStarted};
+	QVERIFY2(group.start(), qUtf8Printable(group.error()));
+	QCOMPARE(startedSpy.size(), 2);
+	QCOMPARE(startedSpy[0][0].value<ServiceControl*>(), control);
+	QCOMPARE(startedSpy[1][0].value<ServiceControl*>(), dependent);
+	QCOMPARE(control->status(), ServiceControl::Status::Running);
+
+	// dependents are stopped first
+	QSignalSpy stoppedSpy{&group, &ServiceGroup::serviceStopped};
+	QVERIFY2(group.stop(), qUtf8Printable(group.error()));
+	QCOMPARE(stoppedSpy.size(), 2);
+	QCOMPARE(stoppedSpy[0][0].value<ServiceControl*>(), dependent);
+	QCOMPARE(stoppedSpy[1][0].value<ServiceControl*>(), control);
+	QCOMPARE(control->status(), ServiceControl::Status::Stopped);
+	QVERIFY(!group.isBusy());
+}
+
+void TestStandardService::testInvokeCallback()
+{
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	const auto echo = control->callGenericCommand("invokeCallback", {QByteArrayLiteral("echo"), 42, QStringLiteral("test")});
+	QVERIFY2(echo.isValid(), qUtf8Printable(control->error()));
+	QCOMPARE(echo.toList(), (QVariantList{42, QStringLiteral("test")}));
+
+	// all calls share one connection and are answered in order
+	QList<QFuture<QVariant>> futures;
+	for (auto i = 0; i < 100; ++i)
+		futures.append(control->invokeCallbackAsync("echo", {i}));
+	for (auto i = 0; i < futures.size(); ++i) {
+		QTRY_VERIFY(futures[i].isFinished());
+		QVERIFY(!futures[i].isCanceled());
+		QCOMPARE(futures[i].result().toList(), (QVariantList{i}));
+	}
+
+	// typed callbacks stay reachable by their kind
+	QCOMPARE(control->callGenericCommand("invokeCallback", {QByteArrayLiteral("add"), 2, 3}).toInt(), 5);
+	QCOMPARE(control->callGenericCommand("invokeCallback", {QByteArrayLiteral("typedAdd"), 4, 5}).toInt(), 9);
+	// tags without a typed callback of their signature use the variant path, which converts the arguments
+	QCOMPARE(control->callGenericCommand("invokeCallback", {QByteArrayLiteral("hasTyped")}).toList(),
+			 (QVariantList{true, false, false}));
+	QCOMPARE(control->callGenericCommand("invokeCallback", {QByteArrayLiteral("typedAddDouble"), 2.0, 4.0}).toDouble(), 6.0);
+	QCOMPARE(control->callGenericCommand("invokeCallback", {QByteArrayLiteral("typedEcho"), 7}).toList(), QVariantList{7});
+
+	// a callback of the service with a common name is not shadowed by the metrics
+	QCOMPARE(control->callGenericCommand("invokeCallback", {QByteArrayLiteral("metrics")}).toString(), QStringLiteral("service"));
+
+	const auto metrics = control->callGenericCommand("invokeCallback", {ServiceMetrics::MetricsCallback}).toMap();
+	const auto startTiming = metrics.value(QStringLiteral("commands")).toMap().value(QStringLiteral("Start")).toMap();
+	QCOMPARE(startTiming.value(QStringLiteral("count")).toInt(), 1);
+	QVERIFY(startTiming.value(QStringLiteral("lastNsecs")).toLongLong() > 0);
+	const auto callbacks = metrics.value(QStringLiteral("callbacks")).toMap();
+	const auto echoTiming = callbacks.value(QStringLiteral("echo")).toMap();
+	QCOMPARE(echoTiming.value(QStringLiteral("count")).toInt(), 101);
+	QVERIFY(echoTiming.value(QStringLiteral("maxNsecs")).toLongLong() >= echoTiming.value(QStringLiteral("averageNsecs")).toLongLong());
+	QCOMPARE(callbacks.value(QStringLiteral("add")).toMap().value(QStringLiteral("count")).toInt(), 1);
+	// the metrics callback is answered by the backend and not timed itself
+	QVERIFY(!callbacks.contains(QString::fromUtf8(ServiceMetrics::MetricsCallback)));
+
+	// a null result is a success, while failed calls are canceled and leave the connection usable
+	const auto noop = control->invokeCallbackAsync("noop", {});
+	QTRY_VERIFY(noop.isFinished());
+	QVERIFY2(!noop.isCanceled(), qUtf8Printable(control->error()));
+	QVERIFY(noop.result().isNull());
+	const auto unknown = control->invokeCallbackAsync("unknown", {});
+	QTRY_VERIFY(unknown.isFinished());
+	QVERIFY(unknown.isCanceled());
+	QVERIFY(control->error().contains(QStringLiteral("unknown")));
+	const auto missingArgs = control->invokeCallbackAsync("add", {2});
+	QTRY_VERIFY(missingArgs.isFinished());
+	QVERIFY(missingArgs.isCanceled());
+	const auto unstreamable = control->invokeCallbackAsync("object", {});
+	QTRY_VERIFY(unstreamable.isFinished());
+	QVERIFY(unstreamable.isCanceled());
+	QCOMPARE(control->callGenericCommand("invokeCallback", {QByteArrayLiteral("add"), 1, 1}).toInt(), 2);
+	// unknown kinds get no timing, so clients cannot grow the metrics without bound
+	const auto timedCallbacks = control->callGenericCommand("invokeCallback", {ServiceMetrics::MetricsCallback})
+									.toMap().value(QStringLiteral("callbacks")).toMap();
+	QVERIFY(timedCallbacks.contains(QStringLiteral("noop")));
+	QVERIFY(!timedCallbacks.contains(QStringLiteral("unknown")));
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Stopped);
+	// the connection is gone with the service, so calls fail instead of blocking
+	QVERIFY(!control->callGenericCommand("invokeCallback", {QByteArrayLiteral("echo")}).isValid());
+}
+
 QTEST_MAIN(TestStandardService)
 
 #include "tst_standardservice.moc"
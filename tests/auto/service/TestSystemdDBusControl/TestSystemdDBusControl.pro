@@ -0,0 +1,13 @@
+TEMPLATE = app
+
+QT = core dbus service testlib
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = tst_systemddbuscontrol
+
+SOURCES += \
+		tst_systemddbuscontrol.cpp
+
+include(../../testrun.pri)
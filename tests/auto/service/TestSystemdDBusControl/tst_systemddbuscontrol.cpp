@@ -0,0 +1,334 @@
+#include <QString>
+#include <QtTest/QtTest>
+#include <QtService/ServiceControl>
+#include <QCoreApplication>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusConnectionInterface>
+#include <QtDBus/QDBusObjectPath>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusArgument>
+#include <QtDBus/QDBusMetaType>
+using namespace QtService;
+
+#define fakeservice QStringLiteral("fakeservice.service")
+#define fakeunitpath QStringLiteral("/org/freedesktop/systemd1/unit/fakeservice_2eservice")
+#define missingunitpath QStringLiteral("/org/freedesktop/systemd1/unit/missing")
+
+struct FakeUnitInfo
+{
+	QString name;
+	QString loadState;
+	QString activeState;
+};
+Q_DECLARE_METATYPE(FakeUnitInfo)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const FakeUnitInfo &info)
+{
+	argument.beginStructure();
+	argument << info.name << QString{} << info.loadState << info.activeState << QString{}
+			 << QString{} << QDBusObjectPath{QStringLiteral("/")} << 0u << QString{}
+			 << QDBusObjectPath{QStringLiteral("/")};
+	argument.endStructure();
+	return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, FakeUnitInfo &info)
+{
+	QString dummy;
+	QDBusObjectPath dummyPath;
+	uint dummyId;
+	argument.beginStructure();
+	argument >> info.name >> dummy >> info.loadState >> info.activeState >> dummy
+			 >> dummy >> dummyPath >> dummyId >> dummy >> dummyPath;
+	argument.endStructure();
+	return argument;
+}
+
+// minimal stand-in for the parts of org.freedesktop.systemd1 used by the control
+class FakeUnit : public QObject
+{
+	Q_OBJECT
+	Q_CLASSINFO("D-Bus Interface", "org.freedesktop.systemd1.Unit")
+
+	Q_PROPERTY(QString LoadState MEMBER loadState)
+	Q_PROPERTY(QString ActiveState MEMBER activeState)
+
+public:
+	FakeUnit(QString loadState, QObject *parent = nullptr) :
+		QObject{parent},
+		loadState{std::move(loadState)}
+	{}
+
+	QString loadState;
+	QString activeState = QStringLiteral("inactive");
+};
+
+class FakeManager : public QObject
+{
+	Q_OBJECT
+	Q_CLASSINFO("D-Bus Interface", "org.freedesktop.systemd1.Manager")
+
+public:
+	FakeManager(QObject *parent = nullptr) :
+		QObject{parent},
+		unit{new FakeUnit{QStringLiteral("loaded"), this}},
+		missing{new FakeUnit{QStringLiteral("not-found"), this}}
+	{}
+
+	FakeUnit *unit;
+	FakeUnit *missing;
+	QString unitFileState = QStringLiteral("disabled");
+	QString nextResult = QStringLiteral("done");
+	int subscriptions = 0;
+	int reloads = 0;
+
+public Q_SLOTS:
+	QDBusObjectPath LoadUnit(const QString &name) {
+		return QDBusObjectPath{name == fakeservice ? fakeunitpath : missingunitpath};
+	}
+
+	QDBusObjectPath StartUnit(const QString &name, const QString &mode) {
+		return runJob(name, mode, QStringLiteral("active"));
+	}
+	QDBusObjectPath StopUnit(const QString &name, const QString &mode) {
+		return runJob(name, mode, QStringLiteral("inactive"));
+	}
+	QDBusObjectPath RestartUnit(const QString &name, const QString &mode) {
+		return runJob(name, mode, QStringLiteral("active"));
+	}
+	QDBusObjectPath ReloadUnit(const QString &name, const QString &mode) {
+		return runJob(name, mode, unit->activeState);
+	}
+
+	QList<FakeUnitInfo> ListUnitsByNames(const QStringList &names) {
+		QList<FakeUnitInfo> infos;
+		for (const auto &name : names) {
+			if (name == fakeservice)
+				infos.append({name, unit->loadState, unit->activeState});
+			else
+				infos.append({name, missing->loadState, missing->activeState});
+		}
+		return infos;
+	}
+
+	QString GetUnitFileState(const QString &name) {
+		Q_UNUSED(name)
+		return unitFileState;
+	}
+	bool EnableUnitFiles(const QStringList &files, bool runtime, bool force) {
+		Q_UNUSED(files)
+		Q_UNUSED(runtime)
+		Q_UNUSED(force)
+		unitFileState = QStringLiteral("enabled");
+		return true;
+	}
+	void DisableUnitFiles(const QStringList &files, bool runtime) {
+		Q_UNUSED(files)
+		Q_UNUSED(runtime)
+		unitFileState = QStringLiteral("disabled");
+	}
+
+	void Subscribe() {
+		++subscriptions;
+	}
+	void Reload() {
+		++reloads;
+	}
+
+Q_SIGNALS:
+	void JobRemoved(uint id, const QDBusObjectPath &job, const QString &unit, const QString &result);
+
+private:
+	uint _jobCounter = 0;
+
+	QDBusObjectPath runJob(const QString &name, const QString &mode, const QString &targetState) {
+		Q_UNUSED(mode)
+		const auto id = ++_jobCounter;
+		const QDBusObjectPath job{QStringLiteral("/org/freedesktop/systemd1/job/%1").arg(id)};
+		const auto result = nextResult;
+		nextResult = QStringLiteral("done");
+		// complete the job asynchronously, just like systemd does
+		QTimer::singleShot(10, this, [this, id, job, name, result, targetState]() {
+			if (result == QStringLiteral("done") && unit->activeState != targetState) {
+				unit->activeState = targetState;
+				auto signal = QDBusMessage::createSignal(fakeunitpath,
+														 QStringLiteral("org.freedesktop.DBus.Properties"),
+														 QStringLiteral("PropertiesChanged"));
+				signal << QStringLiteral("org.freedesktop.systemd1.Unit")
+					   << QVariantMap{{QStringLiteral("ActiveState"), targetState}}
+					   << QStringList{};
+				QDBusConnection::sessionBus().send(signal);
+			}
+			emit JobRemoved(id, job, name, result);
+		});
+		return job;
+	}
+};
+
+class TestSystemdDBusControl : public QObject
+{
+	Q_OBJECT
+
+private Q_SLOTS:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void testExists();
+	void testStartStop();
+	void testReloadFail();
+	void testAutostart();
+	void testWatchStatus();
+	void testAsync();
+
+private:
+	FakeManager *manager = nullptr;
+	ServiceControl *control = nullptr;
+};
+
+void TestSystemdDBusControl::initTestCase()
+{
+	auto bus = QDBusConnection::sessionBus();
+	if (!bus.isConnected())
+		QSKIP("No session bus available - run this test inside dbus-run-session");
+	if (bus.interface()->isServiceRegistered(QStringLiteral("org.freedesktop.systemd1")))
+		QSKIP("A real systemd user instance owns the session bus - run this test inside dbus-run-session");
+
+	qDBusRegisterMetaType<FakeUnitInfo>();
+	qDBusRegisterMetaType<QList<FakeUnitInfo>>();
+
+	manager = new FakeManager{this};
+	QVERIFY(bus.registerObject(QStringLiteral("/org/freedesktop/systemd1"), manager, QDBusConnection::ExportAllContents));
+	QVERIFY(bus.registerObject(fakeunitpath, manager->unit, QDBusConnection::ExportAllContents));
+	QVERIFY(bus.registerObject(missingunitpath, manager->missing, QDBusConnection::ExportAllContents));
+	QVERIFY(bus.registerService(QStringLiteral("org.freedesktop.systemd1")));
+
+	control = ServiceControl::create(QStringLiteral("systemd"), fakeservice, this);
+	QVERIFY(control);
+	QVERIFY(control->setProperty("runAsUser", true));
+	QVERIFY(control->property("useDBus").toBool());
+	QVERIFY(control->setBlocking(true));
+}
+
+void TestSystemdDBusControl::cleanupTestCase()
+{
+	auto bus = QDBusConnection::sessionBus();
+	bus.unregisterService(QStringLiteral("org.freedesktop.systemd1"));
+	bus.unregisterObject(QStringLiteral("/org/freedesktop/systemd1"), QDBusConnection::UnregisterTree);
+}
+
+void TestSystemdDBusControl::testExists()
+{
+	QVERIFY2(control->serviceExists(), qUtf8Printable(control->error()));
+
+	auto missingControl = ServiceControl::create(QStringLiteral("systemd"), QStringLiteral("missing.service"), this);
+	QVERIFY(missingControl);
+	QVERIFY(missingControl->setProperty("runAsUser", true));
+	QVERIFY(!missingControl->serviceExists());
+	QCOMPARE(missingControl->status(), ServiceControl::Status::Unknown);
+}
+
+void TestSystemdDBusControl::testStartStop()
+{
+	QCOMPARE(control->status(), ServiceControl::Status::Stopped);
+
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	QCOMPARE(manager->unit->activeState, QStringLiteral("active"));
+	QCOMPARE(control->status(), ServiceControl::Status::Running);
+	QCOMPARE(manager->subscriptions, 1);
+
+	QVERIFY2(control->restart(), qUtf8Printable(control->error()));
+	QCOMPARE(control->status(), ServiceControl::Status::Running);
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	QCOMPARE(control->status(), ServiceControl::Status::Stopped);
+	QCOMPARE(manager->subscriptions, 1);
+}
+
+void TestSystemdDBusControl::testReloadFail()
+{
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	QVERIFY2(control->reload(), qUtf8Printable(control->error()));
+
+	manager->nextResult = QStringLiteral("failed");
+	QVERIFY(!control->reload());
+	QVERIFY(!control->error().isEmpty());
+	control->clearError();
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+}
+
+void TestSystemdDBusControl::testAutostart()
+{
+	const auto reloads = manager->reloads;
+	QVERIFY(!control->isAutostartEnabled());
+	QVERIFY2(control->enableAutostart(), qUtf8Printable(control->error()));
+	QVERIFY(control->isAutostartEnabled());
+	QVERIFY2(control->disableAutostart(), qUtf8Printable(control->error()));
+	QVERIFY(!control->isAutostartEnabled());
+	QCOMPARE(manager->reloads, reloads + 2);
+}
+
+void TestSystemdDBusControl::testWatchStatus()
+{
+	QSignalSpy statusSpy{control, &ServiceControl::statusChanged};
+	QVERIFY(statusSpy.isValid());
+
+	QVERIFY2(control->setWatchStatus(true), qUtf8Printable(control->error()));
+	QVERIFY(control->watchStatus());
+
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	QTRY_COMPARE(statusSpy.size(), 1);
+	QCOMPARE(statusSpy.takeFirst()[0].value<ServiceControl::Status>(), ServiceControl::Status::Running);
+
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	QTRY_COMPARE(statusSpy.size(), 1);
+	QCOMPARE(statusSpy.takeFirst()[0].value<ServiceControl::Status>(), ServiceControl::Status::Stopped);
+
+	QVERIFY(control->setWatchStatus(false));
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	QVERIFY2(control->stop(), qUtf8Printable(control->error()));
+	QVERIFY(statusSpy.isEmpty());
+}
+
+void TestSystemdDBusControl::testAsync()
+{
+	auto statusFuture = control->statusAsync();
+	QTRY_VERIFY(statusFuture.isFinished());
+	QCOMPARE(statusFuture.result(), ServiceControl::Status::Stopped);
+
+	// multiple operations can be in flight at the same time
+	auto startFuture = control->startAsync();
+	auto reloadFuture = control->reloadAsync();
+	auto enableFuture = control->enableAutostartAsync();
+	QVERIFY(!startFuture.isFinished());
+	QTRY_VERIFY(startFuture.isFinished());
+	QTRY_VERIFY(reloadFuture.isFinished());
+	QTRY_VERIFY(enableFuture.isFinished());
+	QVERIFY2(startFuture.result(), qUtf8Printable(control->error()));
+	QVERIFY2(reloadFuture.result(), qUtf8Printable(control->error()));
+	QVERIFY2(enableFuture.result(), qUtf8Printable(control->error()));
+	QCOMPARE(manager->unit->activeState, QStringLiteral("active"));
+	QVERIFY(control->isAutostartEnabled());
+
+	statusFuture = control->statusAsync();
+	QTRY_VERIFY(statusFuture.isFinished());
+	QCOMPARE(statusFuture.result(), ServiceControl::Status::Running);
+
+	manager->nextResult = QStringLiteral("failed");
+	auto failFuture = control->restartAsync();
+	QTRY_VERIFY(failFuture.isFinished());
+	QVERIFY(!failFuture.result());
+	control->clearError();
+
+	auto stopFuture = control->stopAsync();
+	auto disableFuture = control->disableAutostartAsync();
+	QTRY_VERIFY(stopFuture.isFinished());
+	QTRY_VERIFY(disableFuture.isFinished());
+	QVERIFY2(stopFuture.result(), qUtf8Printable(control->error()));
+	QVERIFY2(disableFuture.result(), qUtf8Printable(control->error()));
+	QCOMPARE(manager->unit->activeState, QStringLiteral("inactive"));
+}
+
+QTEST_MAIN(TestSystemdDBusControl)
+
+#include "tst_systemddbuscontrol.moc"
@@ -27,6 +27,7 @@ protected:
 private Q_SLOTS:
 	void testSocketActivation();
 	void testReloadFail();
+	void testStateStore();
 
 private:
 	bool daemonReload();
@@ -144,6 +145,24 @@ void TestSystemdService::testReloadFail()
 	TEST_STATUS(ServiceControl::Status::Stopped);
 }
 
+void TestSystemdService::testStateStore()
+{
+	QVERIFY(control->setBlocking(true));
+	QVERIFY2(control->start(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	// the fd store is kept by systemd across restarts, the runtime directory is not
+	QVERIFY2(control->restart(), qUtf8Printable(control->error()));
+	TEST_STATUS(ServiceControl::Status::Running);
+
+	QFile stateFile{control->runtimeDir().absoluteFilePath(QStringLiteral("restored.state"))};
+	QVERIFY2(stateFile.open(QIODevice::ReadOnly), qUtf8Printable(stateFile.errorString()));
+	QCOMPARE(stateFile.readAll(), QByteArray("warm state"));
+
+	QVERIFY(control->stop());
+	TEST_STATUS(ServiceControl::Status::Stopped);
+}
+
 bool TestSystemdService::daemonReload()
 {
 	QStringList args {QStringLiteral("daemon-reload")};
@@ -2,6 +2,8 @@
 #include <QtTest>
 #include <QCoreApplication>
 #include <QProcess>
+#include <QtService/ServiceControl>
+using namespace QtService;
 
 class TestTerminalService : public QObject
 {
@@ -11,13 +13,26 @@ private Q_SLOTS:
 	void initTestCase();
 	void cleanupTestCase();
 
+	void testPassiveTerminal_data();
 	void testPassiveTerminal();
+	void testActiveTerminal_data();
 	void testActiveTerminal();
+	void testLargeOutput_data();
+	void testLargeOutput();
+	void testBufferedOutput();
+	void testLimitedOutput();
+	void testDropOldestOutput();
+	void testDisconnectOutput();
+	void testBroadcast();
+	void testBroadcastOverflow();
 	void testTermStop();
 
 private:
 	QString svcPath;
+	bool threaded = false;
 
+	void addModeData();
+	void setThreaded(bool threaded);
 	QProcess *createProc(QStringList args = {});
 };
 
@@ -39,8 +54,16 @@ void TestTerminalService::cleanupTestCase()
 {
 }
 
+void TestTerminalService::testPassiveTerminal_data()
+{
+	addModeData();
+}
+
 void TestTerminalService::testPassiveTerminal()
 {
+	QFETCH(bool, threaded);
+	setThreaded(threaded);
+
 	auto proc = createProc({QStringLiteral("--passive")});
 	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
 	QThread::sleep(2);
@@ -62,8 +85,16 @@ void TestTerminalService::testPassiveTerminal()
 	proc->deleteLater();
 }
 
+void TestTerminalService::testActiveTerminal_data()
+{
+	addModeData();
+}
+
 void TestTerminalService::testActiveTerminal()
 {
+	QFETCH(bool, threaded);
+	setThreaded(threaded);
+
 	auto proc = createProc();
 	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
 
@@ -77,8 +108,126 @@ void TestTerminalService::testActiveTerminal()
 	proc->deleteLater();
 }
 
+void TestTerminalService::testLargeOutput_data()
+{
+	addModeData();
+}
+
+void TestTerminalService::testLargeOutput()
+{
+	QFETCH(bool, threaded);
+	setThreaded(threaded);
+
+	auto proc = createProc({QStringLiteral("dump")});
+	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
+	QVERIFY(proc->waitForFinished(15000));
+
+	const auto data = proc->readAll();
+	const auto dataSize = 1 + 3 * 1024 * 1024 + 65537;
+	QCOMPARE(data.size(), dataSize + 5);
+	QCOMPARE(data.count('x'), dataSize);
+	QVERIFY(data.endsWith("done\n"));
+
+	proc->deleteLater();
+}
+
+void TestTerminalService::testBufferedOutput()
+{
+	auto proc = createProc({QStringLiteral("lines")});
+	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
+	QVERIFY(proc->waitForFinished(15000));
+
+	const auto lines = proc->readAll().split('\n');
+	QCOMPARE(lines.size(), 10001);
+	for (auto i = 0; i < 10000; ++i)
+		QCOMPARE(lines[i], QByteArray::number(i));
+	QVERIFY(lines.last().isEmpty());
+
+	proc->deleteLater();
+}
+
+void TestTerminalService::testLimitedOutput()
+{
+	auto proc = createProc({QStringLiteral("limited")});
+	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
+	QVERIFY(proc->waitForFinished(15000));
+
+	// the blocking policy must not lose any output
+	const auto lines = proc->readAll().split('\n');
+	QCOMPARE(lines.size(), 10001);
+	for (auto i = 0; i < 10000; ++i)
+		QCOMPARE(lines[i], QByteArray::number(i));
+	QVERIFY(lines.last().isEmpty());
+
+	proc->deleteLater();
+}
+
+void TestTerminalService::testDropOldestOutput()
+{
+	auto proc = createProc({QStringLiteral("dropping")});
+	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
+	QVERIFY(proc->waitForFinished(15000));
+
+	// only the newest output of each overflowing write is kept
+	const auto data = proc->readAll();
+	QVERIFY(data.size() <= 2 * 4096);
+	QVERIFY(data.endsWith("taildone\n"));
+
+	proc->deleteLater();
+}
+
+void TestTerminalService::testDisconnectOutput()
+{
+	auto proc = createProc({QStringLiteral("overflow")});
+	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
+	QVERIFY(proc->waitForFinished(15000));
+
+	// the client is dropped on the write that overflows, before anything else is sent
+	const auto data = proc->readAll();
+	QVERIFY(data.size() < 65536);
+	QVERIFY(!data.contains("done"));
+
+	proc->deleteLater();
+}
+
+void TestTerminalService::testBroadcast()
+{
+	auto proc = createProc({QStringLiteral("broadcast")});
+	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
+	QVERIFY(proc->waitForFinished(5000));
+	QCOMPARE(proc->readAll(), QByteArray{"history\nlive\n"});
+
+	proc->deleteLater();
+}
+
+void TestTerminalService::testBroadcastOverflow()
+{
+	auto subscriber = createProc({QStringLiteral("subscribe")});
+	QVERIFY2(subscriber->waitForStarted(5000), qUtf8Printable(subscriber->errorString()));
+	QByteArray data;
+	while (!data.contains("subscribed\n")) {
+		QVERIFY(subscriber->waitForReadyRead(5000));
+		data += subscriber->readAll();
+	}
+
+	// the flooding terminal is dropped in the middle of the broadcast, the subscriber still gets everything
+	auto flooder = createProc({QStringLiteral("flood")});
+	QVERIFY2(flooder->waitForStarted(5000), qUtf8Printable(flooder->errorString()));
+	QVERIFY(flooder->waitForFinished(15000));
+	QVERIFY(flooder->readAll().size() < 65536);
+	QVERIFY(subscriber->waitForFinished(15000));
+	data += subscriber->readAll();
+	QCOMPARE(data, QByteArray{"subscribed\n"} + QByteArray(65536, 'x') + QByteArray{"end\n"});
+
+	flooder->deleteLater();
+	subscriber->deleteLater();
+}
+
 void TestTerminalService::testTermStop()
 {
+	// all remaining tests use the default mode
+	setThreaded(false);
+
 	auto proc = createProc({QStringLiteral("stop")});
 	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
 	QVERIFY(proc->waitForFinished(5000));
@@ -86,6 +235,31 @@ void TestTerminalService::testTermStop()
 	proc->deleteLater();
 }
 
+void TestTerminalService::addModeData()
+{
+	QTest::addColumn<bool>("threaded");
+
+	QTest::newRow("default") << false;
+	QTest::newRow("threaded") << true;
+}
+
+void TestTerminalService::setThreaded(bool threaded)
+{
+	if (threaded == this->threaded)
+		return;
+
+	// the mode is only picked up when the service starts, so a running instance must be stopped
+	auto proc = createProc({QStringLiteral("stop")});
+	QVERIFY2(proc->waitForStarted(5000), qUtf8Printable(proc->errorString()));
+	QVERIFY(proc->waitForFinished(5000));
+	proc->deleteLater();
+
+	QScopedPointer<ServiceControl> control{ServiceControl::create(QStringLiteral("standard"), svcPath)};
+	QVERIFY(control);
+	QTRY_COMPARE_WITH_TIMEOUT(control->status(), ServiceControl::Status::Stopped, 10000);
+	this->threaded = threaded;
+}
+
 QProcess *TestTerminalService::createProc(QStringList args)
 {
 	args.prepend(QStringLiteral("--terminal"));
@@ -93,6 +267,11 @@ QProcess *TestTerminalService::createProc(QStringList args)
 	args.prepend(QStringLiteral("--backend"));
 
 	auto proc = new QProcess{this};
+	// the terminal passes its environment on to the service it starts
+	auto env = QProcessEnvironment::systemEnvironment();
+	if (threaded)
+		env.insert(QStringLiteral("QTSERVICE_TEST_THREADED_TERMINAL"), QStringLiteral("1"));
+	proc->setProcessEnvironment(env);
 	proc->setProgram(svcPath);
 	proc->setArguments(args);
 	proc->setProcessChannelMode(QProcess::ForwardedErrorChannel);
@@ -3,10 +3,13 @@ TEMPLATE = subdirs
 SUBDIRS += \
 	TestBaseLib \
 	TestService \
+	TestServiceGroup \
+	TestServiceMetrics \
 	TestStandardService \
 	TestTerminalService
 
 unix:!android:!ios:packagesExist(libsystemd):system(systemctl --version): SUBDIRS += TestSystemdService
+unix:!android:!ios:packagesExist(libsystemd): SUBDIRS += TestSystemdDBusControl
 win32: SUBDIRS += TestWindowsService
 macx: SUBDIRS += TestLaunchdService
 